@@ -0,0 +1,269 @@
+#ifndef __MONTECARLO_H__
+#define __MONTECARLO_H__
+
+// Monte Carlo integration over a box in D dimensions, with MPI and OpenMP,
+// whose result does not depend on the number of procs and threads.
+//
+// Random numbers: instead of one engine per proc (whose results depend on
+// how the samples are split), every random number is a function of the
+// seed and of the global index of the sample, computed with the Philox4x32
+// counter-based generator (Salmon et al., "Parallel random numbers: as easy
+// as 1, 2, 3", SC11): the counter is the sample index, the key the seed.
+// Any proc or thread can generate any sample, with no state to carry.
+//
+// Samples: the samples are grouped in blocks of `block_size`, and blocks
+// are split among procs and threads. Within a block, the samples are
+// generated and evaluated in batches (the loops are vectorizable, and the
+// integrand is inlined: no std::function), and their mean and sum of
+// squared deviations are accumulated with Welford/Chan merges, which do not
+// suffer from the cancellation of sum_sq - sum^2 / N.
+//
+// Reproducibility: the block statistics are merged along a fixed binary
+// tree over the block indices. Every proc merges the subtrees that fall in
+// its range of blocks and rank 0 merges the rest, so the floating point
+// operations are the same for any number of procs (and threads): with the
+// same executable, the result is bitwise identical (compiler flags such as
+// -march=native, enabling FMA, can change the last bits).
+//
+// Variance reduction: a "sample" can be the mean of several evaluations
+// of f, whose average has a smaller variance than one evaluation, with the
+// samples still independent (so the error estimate stays valid):
+// - antithetic: f(x) and f(x'), with x' the reflection of x in the box;
+// - stratified: the box is split in strata^D cells, and a sample evaluates
+//   f at one random point in every cell.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <mpi.h>
+
+namespace mc {
+
+// Uniform numbers in [0, 1) (53 random bits each) for samples first, ...,
+// first + n - 1 of the stream `seed`: two per sample, in u0 and u1, from
+// the Philox4x32-10 generator with counter (sample, 0, j, 0) and key seed.
+// `j` selects the pair, for samples needing more numbers. The loop over
+// the samples is vectorized (the multiplications are 32 x 32 -> 64 bits).
+inline void uniform(uint64_t seed, uint64_t first, uint32_t j, size_t n,
+                    double* u0, double* u1) {
+  constexpr double scale = 1.0 / (uint64_t(1) << 53);
+#pragma omp simd
+  for (size_t i = 0; i < n; ++i) {
+    const uint64_t sample = first + i;
+    uint32_t c0 = uint32_t(sample), c1 = uint32_t(sample >> 32), c2 = j, c3 = 0;
+    uint32_t k0 = uint32_t(seed), k1 = uint32_t(seed >> 32);
+    for (int round = 0; round < 10; ++round) {
+      const uint64_t p0 = uint64_t(0xD2511F53) * c0;
+      const uint64_t p1 = uint64_t(0xCD9E8D57) * c2;
+      c0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+      c2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+      c1 = uint32_t(p1);
+      c3 = uint32_t(p0);
+      k0 += 0x9E3779B9;
+      k1 += 0xBB67AE85;
+    }
+    u0[i] = double(((uint64_t(c0) << 32) | c1) >> 11) * scale;
+    u1[i] = double(((uint64_t(c2) << 32) | c3) >> 11) * scale;
+  }
+}
+
+template <size_t D>
+struct box {
+  std::array<double, D> lo, hi;
+
+  double measure() const {
+    double m = 1.0;
+    for (size_t d = 0; d < D; ++d) m *= hi[d] - lo[d];
+    return m;
+  }
+};
+
+struct options {
+  uint64_t seed = 0;
+  bool antithetic = false;
+  unsigned strata = 1;          // per dimension
+  size_t block_size = 1 << 14;  // samples
+};
+
+struct result {
+  double integral = 0.0;
+  double variance = 0.0;  // of the integral (the squared error estimate)
+  unsigned long evaluations = 0;
+};
+
+namespace detail {
+
+// Count, mean and sum of squared deviations of a set of values.
+struct summary {
+  double n = 0.0, mean = 0.0, m2 = 0.0;
+};
+
+inline summary merge(const summary& a, const summary& b) {
+  if (b.n == 0) return a;
+  if (a.n == 0) return b;
+  const double n = a.n + b.n, delta = b.mean - a.mean;
+  return {n, a.mean + delta * (b.n / n), a.m2 + b.m2 + delta * delta * (a.n * b.n / n)};
+}
+
+// f at point i of the batch x: on a double if D is 1 and f accepts one,
+// on a std::array<double, D> otherwise.
+template <size_t D, typename F, typename X>
+double call(F& f, const X& x, size_t i) {
+  if constexpr (D == 1) {
+    if constexpr (std::is_invocable_v<F&, double>) return f(x[0][i]);
+    else return f(std::array<double, 1>{x[0][i]});
+  } else {
+    std::array<double, D> p;
+    for (size_t d = 0; d < D; ++d) p[d] = x[d][i];
+    return f(p);
+  }
+}
+
+// Samples evaluated at a time.
+constexpr size_t batch = 256;
+
+// Statistics of samples [first, last).
+template <size_t D, typename F>
+summary sample(F& f, const box<D>& domain, const options& opt, uint64_t first,
+               uint64_t last) {
+  constexpr uint32_t pairs = (D + 1) / 2;  // pairs of random numbers per point
+  const size_t strata = std::max(1u, opt.strata);
+  size_t cells = 1;
+  for (size_t d = 0; d < D; ++d) cells *= strata;
+
+  summary s;
+  std::array<std::array<double, batch>, D> x;
+  std::array<double, batch> y, fx, spare;
+  for (uint64_t i0 = first; i0 < last; i0 += batch) {
+    const size_t nb = std::min<uint64_t>(batch, last - i0);
+    y.fill(0.0);
+    for (size_t c = 0; c < cells; ++c) {
+      // the points, in the cell c (the whole box without strata)
+      for (uint32_t j = 0; j < pairs; ++j)
+        uniform(opt.seed, i0, c * pairs + j, nb, x[2 * j].data(),
+                2 * j + 1 < D ? x[2 * j + 1].data() : spare.data());
+      for (size_t d = 0, cd = c; d < D; ++d, cd /= strata) {
+        const double h = (domain.hi[d] - domain.lo[d]) / strata;
+        const double lo = domain.lo[d] + h * (cd % strata);
+#pragma omp simd
+        for (size_t i = 0; i < nb; ++i) x[d][i] = lo + h * x[d][i];
+      }
+      for (int mirror = 0; mirror <= int(opt.antithetic); ++mirror) {
+        if (mirror)
+          for (size_t d = 0; d < D; ++d) {
+            const double sum = domain.lo[d] + domain.hi[d];
+#pragma omp simd
+            for (size_t i = 0; i < nb; ++i) x[d][i] = sum - x[d][i];
+          }
+#pragma omp simd
+        for (size_t i = 0; i < nb; ++i) fx[i] = call<D>(f, x, i);
+        for (size_t i = 0; i < nb; ++i) y[i] += fx[i];
+      }
+    }
+
+    // merge the statistics of the batch (two passes) into the block ones
+    const double evals = double(cells) * (1 + opt.antithetic);
+    summary b{double(nb), 0.0, 0.0};
+    for (size_t i = 0; i < nb; ++i) b.mean += y[i] / evals;
+    b.mean /= nb;
+    for (size_t i = 0; i < nb; ++i) b.m2 += (y[i] / evals - b.mean) * (y[i] / evals - b.mean);
+    s = merge(s, b);
+  }
+  return s;
+}
+
+// Node (level, k) of the merge tree covers blocks [k 2^level, (k + 1) 2^level).
+using node = std::pair<int, uint64_t>;
+
+// Statistics of the node, from the block statistics of blocks [lo, ...).
+inline summary reduce(const std::vector<summary>& blocks, uint64_t lo, node nd) {
+  const uint64_t first = nd.second << nd.first;
+  if (first - lo >= blocks.size()) return {};
+  if (nd.first == 0) return blocks[first - lo];
+  return merge(reduce(blocks, lo, {nd.first - 1, 2 * nd.second}),
+               reduce(blocks, lo, {nd.first - 1, 2 * nd.second + 1}));
+}
+
+inline summary reduce(const std::map<node, summary>& nodes, node nd) {
+  const auto it = nodes.find(nd);
+  if (it != nodes.end()) return it->second;
+  if (nd.first == 0) return {};
+  return merge(reduce(nodes, {nd.first - 1, 2 * nd.second}),
+               reduce(nodes, {nd.first - 1, 2 * nd.second + 1}));
+}
+
+}  // namespace detail
+
+// Integral of f over `domain` with (about) N evaluations of f, known by
+// rank 0 only; the result is returned on every rank. f is called on a
+// double if D is 1 and it accepts one, otherwise on a std::array<double, D>.
+template <size_t D, typename F>
+result integrate(F f, const box<D>& domain, unsigned long N,
+                 const options& opt = {}, MPI_Comm comm = MPI_COMM_WORLD) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+  MPI_Bcast(&N, 1, MPI_UNSIGNED_LONG, 0, comm);
+
+  size_t evals = 1 + opt.antithetic;
+  for (size_t d = 0; d < D; ++d) evals *= std::max(1u, opt.strata);
+  const uint64_t samples = std::max<uint64_t>(2, N / evals);
+  const uint64_t block_size = std::max<size_t>(1, opt.block_size);
+  const uint64_t n_blocks = (samples + block_size - 1) / block_size;
+  int levels = 0;
+  while ((uint64_t(1) << levels) < n_blocks) ++levels;
+
+  // the statistics of the local blocks
+  const uint64_t lo = n_blocks * rank / size, hi = n_blocks * (rank + 1) / size;
+  std::vector<detail::summary> blocks(hi - lo);
+#pragma omp parallel for schedule(dynamic, 1)
+  for (uint64_t b = lo; b < hi; ++b)
+    blocks[b - lo] = detail::sample(f, domain, opt, b * block_size,
+                                    std::min(samples, (b + 1) * block_size));
+
+  // merged into the largest subtrees within [lo, hi) (the last proc also
+  // takes the empty blocks up to 2^levels)
+  std::vector<double> local;
+  const uint64_t end = rank == size - 1 ? uint64_t(1) << levels : hi;
+  for (uint64_t b = lo; b < end;) {
+    int l = 0;
+    while (l < levels && b % (uint64_t(2) << l) == 0 && b + (uint64_t(2) << l) <= end) ++l;
+    const auto s = detail::reduce(blocks, lo, {l, b >> l});
+    local.insert(local.end(), {double(l), double(b >> l), s.n, s.mean, s.m2});
+    b += uint64_t(1) << l;
+  }
+
+  // rank 0 merges the subtrees into the root
+  int count = local.size();
+  std::vector<int> counts(size), displs(size, 0);
+  MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, comm);
+  for (int r = 1; r < size; ++r) displs[r] = displs[r - 1] + counts[r - 1];
+  std::vector<double> all(rank == 0 ? displs.back() + counts.back() : 0);
+  MPI_Gatherv(local.data(), count, MPI_DOUBLE, all.data(), counts.data(),
+              displs.data(), MPI_DOUBLE, 0, comm);
+  double root[3];
+  if (rank == 0) {
+    std::map<detail::node, detail::summary> nodes;
+    for (size_t i = 0; i < all.size(); i += 5)
+      nodes[{int(all[i]), uint64_t(all[i + 1])}] = {all[i + 2], all[i + 3], all[i + 4]};
+    const auto s = detail::reduce(nodes, {levels, 0});
+    root[0] = s.n;
+    root[1] = s.mean;
+    root[2] = s.m2;
+  }
+  MPI_Bcast(root, 3, MPI_DOUBLE, 0, comm);
+
+  const double measure = domain.measure();
+  return {measure * root[1], measure * measure * root[2] / (root[0] - 1) / root[0],
+          static_cast<unsigned long>(samples * evals)};
+}
+
+}  // namespace mc
+
+#endif
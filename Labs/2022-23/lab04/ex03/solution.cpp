@@ -9,6 +9,8 @@
 
 #include <mpi.h>
 
+#include "montecarlo.hpp"
+
 
 auto timeit(const std::function<void()>& f) {
   using namespace std::chrono;
@@ -84,6 +86,16 @@ std::pair<double, double> montecarlo(const std::function<double(double)>& f,
   }
 }
 
+// The same with the engine of montecarlo.hpp: the result is the same for
+// any number of procs and threads, and f is not called through a
+// std::function
+template <typename F>
+std::pair<double, double> montecarlo_reproducible(F f, unsigned long N,
+                                                  const mc::options& opt = {}) {
+  const auto I = mc::integrate<1>(f, {{-1.0}, {1.0}}, N, opt);
+  return { I.integral, I.variance };
+}
+
 int main(int argc, char* argv[]) {
   // init MPI, get rank and size
   MPI_Init(&argc, &argv);
@@ -105,6 +117,40 @@ int main(int argc, char* argv[]) {
     std::cout << "Error estimator: " << std::sqrt(I.second) << std::endl;
     std::cout << "Error: " << std::abs(I.first - std::numbers::pi / 2) << std::endl;
   }
+
+  const auto dt_r = timeit([&]() {
+    I = montecarlo_reproducible([](auto x) { return std::sqrt(1 - x * x); }, N);
+    });
+  if (rank == 0) {
+    std::cout << "Reproducible, elapsed: " << dt_r << " [ms]" << std::endl;
+    std::cout << "Integral: " << I.first << std::endl;
+    // in hexadecimal: the same bits for any number of procs and threads
+    std::cout << "Integral (bits): " << std::hexfloat << I.first << std::defaultfloat << std::endl;
+    std::cout << "Error estimator: " << std::sqrt(I.second) << std::endl;
+    std::cout << "Error: " << std::abs(I.first - std::numbers::pi / 2) << std::endl;
+  }
+
+  // variance reduction, with the same number of evaluations of f. Antithetic
+  // sampling does not help here: f is even, so f(x) and f(-x) are equal
+  for (const auto& [name, opt] : {std::pair{"antithetic", mc::options{0, true, 1}},
+                                  std::pair{"stratified (64 strata)", mc::options{0, false, 64}}}) {
+    const auto J = montecarlo_reproducible([](auto x) { return std::sqrt(1 - x * x); }, N, opt);
+    if (rank == 0) {
+      std::cout << name << ": integral " << J.first << ", error estimator "
+                << std::sqrt(J.second) << ", error " << std::abs(J.first - std::numbers::pi / 2)
+                << std::endl;
+    }
+  }
+
+  // a 3D integral: the volume of the unit ball (the integrand is called on
+  // std::array<double, 3>)
+  const auto V = mc::integrate<3>(
+      [](const auto& x) { return double(x[0] * x[0] + x[1] * x[1] + x[2] * x[2] <= 1.0); },
+      {{-1.0, -1.0, -1.0}, {1.0, 1.0, 1.0}}, N);
+  if (rank == 0) {
+    std::cout << "Volume of the unit ball: " << V.integral << " +- " << std::sqrt(V.variance)
+              << ", error " << std::abs(V.integral - 4.0 / 3.0 * std::numbers::pi) << std::endl;
+  }
   MPI_Finalize();
   return 0;
 }
\ No newline at end of file
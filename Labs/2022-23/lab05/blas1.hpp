@@ -0,0 +1,279 @@
+#ifndef BLAS1_HPP
+#define BLAS1_HPP
+
+// Mixed-precision BLAS-1 kernels: axpy, scal, dot, nrm2.
+//
+// The vectors can be stored in double, float or bf16 (the upper half of a
+// float: 8 bits of mantissa, same range), while all the arithmetic is done
+// in double. The kernels are memory bound, so storing in float or bf16
+// moves half or a quarter of the bytes of double for the same number of
+// elements; accumulating in double keeps the reductions accurate.
+//
+// The reductions (dot, nrm2) sum with one of:
+// - plain: several independent double accumulators;
+// - kahan: compensated summation, per SIMD lane;
+// - pairwise: blocks of `pairwise_block` elements summed with plain
+//   accumulators, then the block sums summed pairwise (error growing as
+//   log(n) rather than n).
+// With AVX2 and FMA (compile with -march=native) the loops use intrinsics,
+// otherwise `omp simd`. The vectors are split among the OpenMP threads in
+// contiguous chunks and the partial results combined in a fixed order, so
+// that the result depends only on the number of threads.
+//
+// Compensated summation relies on strict IEEE arithmetic: do not compile
+// with -ffast-math.
+//
+// The kernels only work on local data: with MPI, reduce the local results
+// (for nrm2, of the squares: see `sum_of_squares`).
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#define BLAS1_AVX2
+#endif
+
+namespace blas1 {
+
+// bfloat16: a float with the lower 16 bits of the mantissa dropped
+// (rounding to nearest even). NaNs stay NaNs.
+struct bf16 {
+  std::uint16_t bits = 0;
+
+  bf16() = default;
+  bf16(double x) {
+    float f = static_cast<float>(x);
+    std::uint32_t u;
+    std::memcpy(&u, &f, sizeof(u));
+    if ((u & 0x7fffffffu) > 0x7f800000u)
+      bits = static_cast<std::uint16_t>((u >> 16) | 0x40u);  // quiet NaN
+    else
+      bits = static_cast<std::uint16_t>((u + 0x7fffu + ((u >> 16) & 1u)) >> 16);
+  }
+
+  operator double() const { return static_cast<float>(*this); }
+  explicit operator float() const {
+    const std::uint32_t u = static_cast<std::uint32_t>(bits) << 16;
+    float f;
+    std::memcpy(&f, &u, sizeof(f));
+    return f;
+  }
+};
+
+enum class summation { plain, kahan, pairwise };
+
+// Elements summed with plain accumulators by pairwise summation.
+constexpr std::size_t pairwise_block = 256;
+
+namespace detail {
+
+// Sum and compensation of a compensated (Kahan-Babuska) sum.
+struct compensated {
+  double sum = 0.0, c = 0.0;
+
+  void add(double x) {
+    const double t = sum + x;
+    c += std::abs(sum) >= std::abs(x) ? (sum - t) + x : (x - t) + sum;
+    sum = t;
+  }
+  double value() const { return sum + c; }
+};
+
+inline double to_double(double x) { return x; }
+inline double to_double(float x) { return x; }
+inline double to_double(bf16 x) { return static_cast<float>(x); }
+
+#ifdef BLAS1_AVX2
+// 4 consecutive elements, widened to double.
+inline __m256d load4(const double *p) { return _mm256_loadu_pd(p); }
+inline __m256d load4(const float *p) { return _mm256_cvtps_pd(_mm_loadu_ps(p)); }
+inline __m256d load4(const bf16 *p) {
+  const __m128i h = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+  return _mm256_cvtps_pd(_mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), h)));
+}
+
+inline double hsum(__m256d v) {
+  const __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+#endif
+
+// Sum of x[i] * y[i] for i < n, in double, with 'plain' or 'kahan'
+// summation; the result is accumulated into 'acc'.
+template <typename T>
+void dot_kernel(std::size_t n, const T *x, const T *y, summation s,
+                compensated &acc) {
+  std::size_t i = 0;
+#ifdef BLAS1_AVX2
+  if (s == summation::kahan) {
+    // Two independent sums, to hide the latency of the dependency chain.
+    __m256d sum[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+    __m256d c[2] = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+    for (; i + 8 <= n; i += 8) {
+      for (int k = 0; k < 2; ++k) {
+        const __m256d v = _mm256_sub_pd(
+            _mm256_mul_pd(load4(x + i + 4 * k), load4(y + i + 4 * k)), c[k]);
+        const __m256d t = _mm256_add_pd(sum[k], v);
+        c[k] = _mm256_sub_pd(_mm256_sub_pd(t, sum[k]), v);
+        sum[k] = t;
+      }
+    }
+    for (int k = 0; k < 2; ++k) {
+      acc.add(hsum(sum[k]));
+      acc.add(-hsum(c[k]));
+    }
+  } else {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd(),
+            s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+    for (; i + 16 <= n; i += 16) {
+      s0 = _mm256_fmadd_pd(load4(x + i), load4(y + i), s0);
+      s1 = _mm256_fmadd_pd(load4(x + i + 4), load4(y + i + 4), s1);
+      s2 = _mm256_fmadd_pd(load4(x + i + 8), load4(y + i + 8), s2);
+      s3 = _mm256_fmadd_pd(load4(x + i + 12), load4(y + i + 12), s3);
+    }
+    for (; i + 4 <= n; i += 4)
+      s0 = _mm256_fmadd_pd(load4(x + i), load4(y + i), s0);
+    acc.add(hsum(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3))));
+  }
+#else
+  if (s == summation::kahan) {
+    double sum = 0.0, c = 0.0;
+    for (; i < n; ++i) {
+      const double v = to_double(x[i]) * to_double(y[i]) - c;
+      const double t = sum + v;
+      c = (t - sum) - v;
+      sum = t;
+    }
+    acc.add(sum);
+    acc.add(-c);
+  } else {
+    double sum = 0.0;
+#ifdef _OPENMP
+#pragma omp simd reduction(+ : sum)
+#endif
+    for (std::size_t j = 0; j < n; ++j)
+      sum += to_double(x[j]) * to_double(y[j]);
+    acc.add(sum);
+    i = n;
+  }
+#endif
+  for (; i < n; ++i) acc.add(to_double(x[i]) * to_double(y[i]));
+}
+
+// Pairwise sum of the products of the blocks of [0, n).
+template <typename T>
+double dot_pairwise(std::size_t n, const T *x, const T *y) {
+  if (n <= pairwise_block) {
+    compensated acc;
+    dot_kernel(n, x, y, summation::plain, acc);
+    return acc.sum;
+  }
+  // Split at a multiple of the block size, so that the blocks (and the
+  // result) do not depend on where the recursion started.
+  const std::size_t half = (n / pairwise_block + 1) / 2 * pairwise_block;
+  return dot_pairwise(half, x, y) + dot_pairwise(n - half, x + half, y + half);
+}
+
+// Chunk of [0, n) of thread 'tid' of 'nt', aligned to the pairwise blocks.
+inline void chunk(std::size_t n, int tid, int nt, std::size_t &begin,
+                  std::size_t &end) {
+  const std::size_t blocks = (n + pairwise_block - 1) / pairwise_block;
+  begin = std::min(n, blocks * tid / nt * pairwise_block);
+  end = std::min(n, blocks * (tid + 1) / nt * pairwise_block);
+}
+
+}  // namespace detail
+
+// Sum of x[i] * y[i] for i < n.
+template <typename T>
+double dot(std::size_t n, const T *x, const T *y,
+           summation s = summation::pairwise) {
+  // The chunks are dealt among the threads of the team actually delivered,
+  // which may be smaller than requested (nested region, OMP_DYNAMIC).
+  std::vector<double> partial, correction;
+#ifdef _OPENMP
+#pragma omp parallel if (n >= 4 * pairwise_block)
+#endif
+  {
+#ifdef _OPENMP
+    const int tid = omp_get_thread_num();
+    const int nt = omp_get_num_threads();
+#else
+    const int tid = 0;
+    const int nt = 1;
+#endif
+#ifdef _OPENMP
+#pragma omp single
+#endif
+    {
+      partial.assign(nt, 0.0);
+      correction.assign(nt, 0.0);
+    }
+    std::size_t begin, end;
+    detail::chunk(n, tid, nt, begin, end);
+    if (s == summation::pairwise) {
+      partial[tid] = begin < end ? detail::dot_pairwise(end - begin, x + begin, y + begin) : 0.0;
+    } else {
+      detail::compensated acc;
+      detail::dot_kernel(end - begin, x + begin, y + begin, s, acc);
+      partial[tid] = acc.sum;
+      correction[tid] = acc.c;
+    }
+  }
+
+  // Fixed order, compensated: the thread count is small.
+  detail::compensated total;
+  for (std::size_t t = 0; t < partial.size(); ++t) {
+    total.add(partial[t]);
+    total.add(correction[t]);
+  }
+  return total.value();
+}
+
+// Sum of x[i]^2 for i < n: the local contribution to the squared norm of a
+// distributed vector.
+template <typename T>
+double sum_of_squares(std::size_t n, const T *x,
+                      summation s = summation::pairwise) {
+  return dot(n, x, x, s);
+}
+
+// Euclidean norm of x. The squares are summed in double: no overflow for
+// float and bf16 data, nor for double data below 1e154.
+template <typename T>
+double nrm2(std::size_t n, const T *x, summation s = summation::pairwise) {
+  return std::sqrt(sum_of_squares(n, x, s));
+}
+
+// y = a x + y, computed in double and rounded to T.
+template <typename T>
+void axpy(std::size_t n, double a, const T *x, T *y) {
+#ifdef _OPENMP
+#pragma omp parallel for simd schedule(static) if (n >= 4 * pairwise_block)
+#endif
+  for (std::size_t i = 0; i < n; ++i)
+    y[i] = static_cast<T>(a * detail::to_double(x[i]) + detail::to_double(y[i]));
+}
+
+// x = a x, computed in double and rounded to T.
+template <typename T>
+void scal(std::size_t n, double a, T *x) {
+#ifdef _OPENMP
+#pragma omp parallel for simd schedule(static) if (n >= 4 * pairwise_block)
+#endif
+  for (std::size_t i = 0; i < n; ++i)
+    x[i] = static_cast<T>(a * detail::to_double(x[i]));
+}
+
+}  // namespace blas1
+
+#endif
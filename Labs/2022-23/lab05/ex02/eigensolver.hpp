@@ -0,0 +1,394 @@
+#ifndef __EIGENSOLVER_H__
+#define __EIGENSOLVER_H__
+
+// Distributed eigensolver for the dominant eigenpair (largest magnitude) of
+// a matrix split by rows among the MPI ranks.
+//
+// The rows are split in contiguous blocks whose sizes differ at most by
+// one (no need for N to be divisible by the number of ranks). Vectors are
+// distributed in the same way: every rank only stores its own entries, and
+// norms and dot products reduce the local partial sums with one
+// MPI_Allreduce.
+//
+// Two operators:
+// - dense_operator: a dense block of rows; every product gathers the whole
+//   vector (MPI_Allgatherv), as in the power method of the exercise;
+// - csr_operator: a sparse block of rows; every product only receives the
+//   entries of the vector the local rows need (the "halo") from the ranks
+//   owning them: for banded matrices, just the two neighbouring ranks.
+//
+// Four methods (see `method`), all for operators whose dominant eigenvalue
+// is real.
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include <mpi.h>
+
+#include <Eigen/Eigen>
+
+// Mixed-precision BLAS-1 kernels (a copy of those of the 2023-24 MPI lab)
+#include "../blas1.hpp"
+
+namespace eigensolver {
+
+using Matrix = Eigen::Matrix<double, -1, -1, Eigen::RowMajor>;
+using SparseMatrix = Eigen::SparseMatrix<double, Eigen::RowMajor>;
+using Vector = Eigen::VectorXd;
+
+// Contiguous blocks of rows: rank r owns rows [displs[r], displs[r + 1]).
+class row_partition {
+ public:
+  row_partition(unsigned long N, MPI_Comm comm = MPI_COMM_WORLD)
+      : comm(comm), global_rows(N) {
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    counts.resize(size);
+    displs.assign(size + 1, 0);
+    for (int r = 0; r < size; ++r) {
+      counts[r] = N / size + ((unsigned long)r < N % size);
+      displs[r + 1] = displs[r] + counts[r];
+    }
+  }
+
+  int local_rows() const { return counts[rank]; }
+  long offset() const { return displs[rank]; }
+  // rank owning row i
+  int owner(long i) const {
+    return std::upper_bound(displs.begin(), displs.end(), i) - displs.begin() - 1;
+  }
+
+  MPI_Comm comm;
+  int rank, size;
+  unsigned long global_rows;
+  std::vector<int> counts, displs;
+};
+
+// Local part of x, available on rank 0 only.
+inline Vector scatter(const Vector& x, const row_partition& p) {
+  Vector local(p.local_rows());
+  MPI_Scatterv(x.data(), p.counts.data(), p.displs.data(), MPI_DOUBLE,
+               local.data(), p.local_rows(), MPI_DOUBLE, 0, p.comm);
+  return local;
+}
+
+// The whole vector on rank 0 (empty elsewhere).
+inline Vector gather(const Vector& local, const row_partition& p) {
+  Vector x(p.rank == 0 ? p.global_rows : 0);
+  MPI_Gatherv(local.data(), p.local_rows(), MPI_DOUBLE, x.data(),
+              p.counts.data(), p.displs.data(), MPI_DOUBLE, 0, p.comm);
+  return x;
+}
+
+inline double dot(const Vector& x, const Vector& y, const row_partition& p) {
+  double local = blas1::dot(x.size(), x.data(), y.data()), global;
+  MPI_Allreduce(&local, &global, 1, MPI_DOUBLE, MPI_SUM, p.comm);
+  return global;
+}
+
+inline double norm(const Vector& x, const row_partition& p) {
+  double local = blas1::sum_of_squares(x.size(), x.data()), global;
+  MPI_Allreduce(&local, &global, 1, MPI_DOUBLE, MPI_SUM, p.comm);
+  return std::sqrt(global);
+}
+
+// A dense block of rows.
+class dense_operator {
+ public:
+  // Scatter the rows of A, available on rank 0 only.
+  dense_operator(const Matrix& A, const row_partition& p)
+      : part(p), local(p.local_rows(), p.global_rows), x_full(p.global_rows) {
+    // one row as a datatype: the counts in doubles would overflow an int
+    MPI_Datatype row;
+    MPI_Type_contiguous(p.global_rows, MPI_DOUBLE, &row);
+    MPI_Type_commit(&row);
+    MPI_Scatterv(A.data(), p.counts.data(), p.displs.data(), row, local.data(),
+                 p.local_rows(), row, 0, p.comm);
+    MPI_Type_free(&row);
+  }
+
+  const row_partition& partition() const { return part; }
+
+  // y = A x (local parts)
+  void apply(const Eigen::Ref<const Vector>& x, Eigen::Ref<Vector> y) const {
+    MPI_Allgatherv(x.data(), part.local_rows(), MPI_DOUBLE, x_full.data(),
+                   part.counts.data(), part.displs.data(), MPI_DOUBLE, part.comm);
+    y.noalias() = local * x_full;
+  }
+
+ private:
+  row_partition part;
+  Matrix local;
+  mutable Vector x_full;
+};
+
+// A sparse block of rows.
+class csr_operator {
+ public:
+  // `rows`: the local rows (p.local_rows() x N), with global column indices.
+  csr_operator(const SparseMatrix& rows, const row_partition& p) : part(p) {
+    const long lo = p.offset(), hi = lo + p.local_rows();
+    const int n = p.local_rows();
+
+    // the columns owned by other ranks, sorted: grouped by owner
+    std::vector<long> ghosts;
+    for (int i = 0; i < rows.outerSize(); ++i)
+      for (SparseMatrix::InnerIterator it(rows, i); it; ++it)
+        if (it.col() < lo || it.col() >= hi) ghosts.push_back(it.col());
+    std::sort(ghosts.begin(), ghosts.end());
+    ghosts.erase(std::unique(ghosts.begin(), ghosts.end()), ghosts.end());
+
+    // local columns first, then the ghosts
+    std::vector<Eigen::Triplet<double>> entries;
+    entries.reserve(rows.nonZeros());
+    for (int i = 0; i < rows.outerSize(); ++i)
+      for (SparseMatrix::InnerIterator it(rows, i); it; ++it) {
+        const long c = it.col();
+        const long j = c >= lo && c < hi
+                           ? c - lo
+                           : n + (std::lower_bound(ghosts.begin(), ghosts.end(), c) - ghosts.begin());
+        entries.emplace_back(i, j, it.value());
+      }
+    local.resize(n, n + ghosts.size());
+    local.setFromTriplets(entries.begin(), entries.end());
+    x_ext.resize(n + ghosts.size());
+
+    // tell every owner which of its entries we need (once: the products
+    // only talk to the neighbours found here)
+    std::vector<int> need(p.size, 0), give(p.size);
+    for (long g : ghosts) ++need[p.owner(g)];
+    MPI_Alltoall(need.data(), 1, MPI_INT, give.data(), 1, MPI_INT, p.comm);
+    std::vector<int> need_displs(p.size + 1, 0), give_displs(p.size + 1, 0);
+    for (int r = 0; r < p.size; ++r) {
+      need_displs[r + 1] = need_displs[r] + need[r];
+      give_displs[r + 1] = give_displs[r] + give[r];
+    }
+    std::vector<long> requested(give_displs[p.size]);
+    MPI_Alltoallv(ghosts.data(), need.data(), need_displs.data(), MPI_LONG,
+                  requested.data(), give.data(), give_displs.data(), MPI_LONG, p.comm);
+
+    for (int r = 0; r < p.size; ++r) {
+      if (need[r]) recv.push_back({r, need[r], need_displs[r]});
+      if (give[r]) send.push_back({r, give[r], give_displs[r]});
+    }
+    for (long g : requested) send_index.push_back(g - lo);
+    send_buf.resize(send_index.size());
+    requests.resize(recv.size() + send.size());
+  }
+
+  const row_partition& partition() const { return part; }
+
+  // y = A x (local parts)
+  void apply(const Eigen::Ref<const Vector>& x, Eigen::Ref<Vector> y) const {
+    const int n = part.local_rows();
+    size_t k = 0;
+    for (const auto& m : recv)
+      MPI_Irecv(x_ext.data() + n + m.displ, m.count, MPI_DOUBLE, m.rank, 0,
+                part.comm, &requests[k++]);
+    for (size_t i = 0; i < send_index.size(); ++i) send_buf[i] = x[send_index[i]];
+    for (const auto& m : send)
+      MPI_Isend(send_buf.data() + m.displ, m.count, MPI_DOUBLE, m.rank, 0,
+                part.comm, &requests[k++]);
+    x_ext.head(n) = x;
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+    y.noalias() = local * x_ext;
+  }
+
+ private:
+  struct message {
+    int rank, count, displ;
+  };
+
+  row_partition part;
+  SparseMatrix local;
+  std::vector<message> recv, send;
+  std::vector<int> send_index;
+  mutable Vector x_ext;
+  mutable std::vector<double> send_buf;
+  mutable std::vector<MPI_Request> requests;
+};
+
+enum class method {
+  // x = A x / ||A x|| until ||x_k - x_{k-1}|| < tol (the exercise): two
+  // reductions per iteration; does not converge if the dominant eigenvalue
+  // is negative (x changes sign at every iteration)
+  power,
+  // the same iteration, stopping when ||A x - theta x|| < tol |theta|,
+  // with theta = x^T A x the Rayleigh quotient: one reduction per
+  // iteration (the residual is lagged by one iteration to share it), and
+  // it also converges for a negative dominant eigenvalue
+  rayleigh,
+  // restarted Lanczos for symmetric A: the Krylov basis of dimension
+  // krylov_dim is kept fully orthogonal (classical Gram-Schmidt, twice),
+  // to avoid the spurious copies of the eigenvalues of plain Lanczos
+  lanczos,
+  // restarted Arnoldi for general A (the Ritz vector of largest magnitude)
+  arnoldi
+};
+
+struct options {
+  size_t max_iter = 1000000;  // products with A
+  double tol = 1e-8;
+  int krylov_dim = 30;  // lanczos and arnoldi
+};
+
+struct result {
+  double eigenvalue = 0.0;
+  size_t iterations = 0;  // products with A
+  double residual = 0.0;  // ||A x - eigenvalue x||, with ||x|| = 1
+  bool converged = false;
+};
+
+namespace detail {
+
+template <typename Op>
+void power(const Op& A, Vector& x, const options& opt, result& res) {
+  const auto& p = A.partition();
+  const size_t n = x.size();
+  Vector y(n);
+  double err = std::numeric_limits<double>::infinity();
+  while (err > opt.tol && res.iterations < opt.max_iter) {
+    A.apply(x, y);
+    ++res.iterations;
+    blas1::scal(n, 1.0 / norm(y, p), y.data());
+    x -= y;
+    err = norm(x, p);
+    std::swap(x, y);
+  }
+  res.converged = err <= opt.tol;
+}
+
+template <typename Op>
+void rayleigh(const Op& A, Vector& x, const options& opt, result& res) {
+  const auto& p = A.partition();
+  const size_t n = x.size();
+  Vector y(n);
+  double theta = 0.0, residual2 = 0.0;
+  while (res.iterations < opt.max_iter) {
+    A.apply(x, y);
+    ++res.iterations;
+    // x^T A x, ||A x||^2 and the squared residual of the previous
+    // iteration, with one reduction
+    double local[3] = {blas1::dot(n, x.data(), y.data()),
+                       blas1::sum_of_squares(n, y.data()), residual2};
+    double global[3];
+    MPI_Allreduce(local, global, 3, MPI_DOUBLE, MPI_SUM, p.comm);
+    if (res.iterations > 1 && std::sqrt(global[2]) <= opt.tol * std::abs(theta)) {
+      res.converged = true;
+      break;
+    }
+    theta = global[0];
+    residual2 = (y - theta * x).squaredNorm();
+    blas1::scal(n, 1.0 / std::sqrt(global[1]), y.data());
+    std::swap(x, y);
+  }
+}
+
+template <typename Op>
+void krylov(const Op& A, Vector& x, const options& opt, bool symmetric, result& res) {
+  const auto& p = A.partition();
+  const int m = std::max<long>(1, std::min<long>(opt.krylov_dim, p.global_rows));
+  const auto n = x.size();
+  Eigen::MatrixXd V(n, m + 1);
+  Eigen::MatrixXd H(m + 1, m);
+  Vector w(n), h(m), h_global(m);
+
+  while (res.iterations < opt.max_iter) {
+    // Krylov basis V and Hessenberg matrix H = V^T A V
+    V.col(0) = x;
+    H.setZero();
+    int k = m;
+    for (int j = 0; j < m; ++j) {
+      A.apply(V.col(j), w);
+      ++res.iterations;
+      for (int pass = 0; pass < 2; ++pass) {
+        h.head(j + 1).noalias() = V.leftCols(j + 1).transpose() * w;
+        MPI_Allreduce(h.data(), h_global.data(), j + 1, MPI_DOUBLE, MPI_SUM, p.comm);
+        w.noalias() -= V.leftCols(j + 1) * h_global.head(j + 1);
+        H.col(j).head(j + 1) += h_global.head(j + 1);
+      }
+      H(j + 1, j) = norm(w, p);
+      // breakdown: the basis spans an invariant subspace
+      if (H(j + 1, j) <= 1e-14 * H.col(j).head(j + 1).norm()) {
+        k = j + 1;
+        break;
+      }
+      V.col(j + 1) = w / H(j + 1, j);
+    }
+
+    // Ritz pair of largest magnitude
+    Vector s;
+    if (symmetric) {
+      // only the lower triangle is read: the diagonal and the subdiagonal
+      Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> es(H.topLeftCorner(k, k));
+      Eigen::Index i;
+      es.eigenvalues().cwiseAbs().maxCoeff(&i);
+      res.eigenvalue = es.eigenvalues()(i);
+      s = es.eigenvectors().col(i);
+    } else {
+      Eigen::EigenSolver<Eigen::MatrixXd> es(H.topLeftCorner(k, k));
+      Eigen::Index i;
+      es.eigenvalues().cwiseAbs().maxCoeff(&i);
+      res.eigenvalue = es.eigenvalues()(i).real();
+      s = es.eigenvectors().col(i).real();
+      s.normalize();
+    }
+    x.noalias() = V.leftCols(k) * s;
+    x /= norm(x, p);
+
+    // ||A x - theta x|| = |h_{k+1,k} s_k|, without another product
+    const double estimate = k < m ? 0.0 : std::abs(H(m, m - 1) * s(m - 1));
+    if (estimate <= opt.tol * std::abs(res.eigenvalue)) {
+      res.converged = true;
+      break;
+    }
+  }
+}
+
+}  // namespace detail
+
+// Dominant eigenpair of A. `x` is the local part of the initial guess and
+// is overwritten with the local part of the (normalized) eigenvector.
+template <typename Op>
+result solve(const Op& A, Vector& x, method m, const options& opt = {}) {
+  const auto& p = A.partition();
+  result res;
+  x /= norm(x, p);
+  switch (m) {
+    case method::power:
+      detail::power(A, x, opt, res);
+      break;
+    case method::rayleigh:
+      detail::rayleigh(A, x, opt, res);
+      break;
+    case method::lanczos:
+    case method::arnoldi:
+      detail::krylov(A, x, opt, m == method::lanczos, res);
+      break;
+  }
+  // Rayleigh quotient and true residual of the final vector
+  Vector y(x.size());
+  A.apply(x, y);
+  res.eigenvalue = dot(x, y, p);
+  y -= res.eigenvalue * x;
+  res.residual = norm(y, p);
+  return res;
+}
+
+inline const char* name(method m) {
+  switch (m) {
+    case method::power: return "power";
+    case method::rayleigh: return "rayleigh";
+    case method::lanczos: return "lanczos";
+    case method::arnoldi: return "arnoldi";
+  }
+  return "";
+}
+
+}  // namespace eigensolver
+
+#endif
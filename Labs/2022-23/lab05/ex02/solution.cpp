@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <iostream>
 #include <thread>
 
@@ -7,61 +9,33 @@
 #include <Eigen/Eigen>
 
 #include "../utils.hpp"
+// Distributed power, Rayleigh, Lanczos and Arnoldi iterations
+#include "eigensolver.hpp"
 
 using Matrix = Eigen::Matrix<double, -1, -1, Eigen::RowMajor>;
 
 void power_method(const Matrix &A, Eigen::VectorXd &b, size_t max_iter, double toll) {
-  int rank, size;
-  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
   // broadcast the size of b
   unsigned long N = b.size();
   MPI_Bcast(&N, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
-  // we assume the number of rows is divisible by the number of procs
-  const unsigned long local_rows = N / size;
-  const unsigned long local_entries = local_rows * N;
-  // allocate buffer for local data
-  if (rank) {
-    b.resize(N);
-  }
-  Matrix local_A(local_rows, N);
+  // the rows are split in blocks whose sizes differ at most by one,
+  // so N needs not be divisible by the number of procs
+  const eigensolver::row_partition part(N);
+  // scatter the rows of A and the entries of b
+  const eigensolver::dense_operator local_A(A, part);
+  Eigen::VectorXd b_local = eigensolver::scatter(b, part);
 
-  // broadcast the data of b and scatter the data of A
-  MPI_Bcast(b.data(), N, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-  MPI_Scatter(A.data(), local_entries, MPI_DOUBLE, local_A.data(), local_entries,
-              MPI_DOUBLE, 0, MPI_COMM_WORLD);
-
-  double err = 1;
-  size_t iter = 0;
-  while (err > toll && iter < max_iter) {
-    // compute local matrix-vector product
-    Eigen::VectorXd b_local = local_A * b;
-    // allocate memory for the whole b
-    Eigen::VectorXd b_new(b.size());
-    // allgather b
-    MPI_Allgather(
-      b_local.data(),
-      local_rows,
-      MPI_DOUBLE,
-      b_new.data(),
-      local_rows,
-      MPI_DOUBLE,
-      MPI_COMM_WORLD
-    );
-    // norm could be computed in parallel but we settle for serial
-    // this is suboptimal, but in this case it is not that bad of a choice 
-    // since we already have the whole vector b in local memory and 
-    // in this way we avoid extra communications
-    b_new /= b_new.norm();
-    err = (b_new - b).norm();
-    // swap b and b_new
-    std::swap(b, b_new);
-    iter++;
-  }
+  // every product gathers the whole vector, but the norms are computed on
+  // the local entries and reduced
+  const auto res = eigensolver::solve(local_A, b_local, eigensolver::method::power,
+                                      {max_iter, toll});
+  b = eigensolver::gather(b_local, part);
   if(rank == 0) {
-    std::cout << "Iterations: " << iter << "\n";
-    std::cout << "Error: " << err << "\n";
+    std::cout << "Iterations: " << res.iterations << "\n";
+    std::cout << "Residual: " << res.residual << "\n";
   }
 }
 
@@ -71,7 +45,8 @@ int main(int argc, char* argv[]) {
   MPI_Comm_size(MPI_COMM_WORLD, &size);
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-  const unsigned long N = 400;
+  // N can be passed as first argument
+  const unsigned long N = argc > 1 ? std::stoul(argv[1]) : 400;
   Eigen::Matrix<double, -1, -1, Eigen::RowMajor> A;
   Eigen::VectorXd b;
   if (rank == 0) {  // simulate only the main proc has the data
@@ -83,6 +58,7 @@ int main(int argc, char* argv[]) {
     A.diagonal(0).setConstant(2.0);
     A.diagonal(1).setConstant(-1.0);
   }
+  const Eigen::VectorXd b0 = b;
   // time our function
   const auto dt = timeit([&](){power_method(A, b, 1000000, 1e-8);});
   // output result if we are proc 0
@@ -96,7 +72,40 @@ int main(int argc, char* argv[]) {
     Eigen::Index maxRow;
     const auto test_eigenvalue = es.eigenvalues().real().maxCoeff(&maxRow);
     std::cout << "The eigenvalue error against Eigen is: " << (eigenvalue(0, 0) - test_eigenvalue) << std::endl;
-    std::cout << "The eigenvector error against Eigen is: " << (es.eigenvectors().real().col(maxRow) - b).norm() << std::endl;
+    // the eigenvector is defined up to its sign
+    const Eigen::VectorXd v = es.eigenvectors().real().col(maxRow);
+    std::cout << "The eigenvector error against Eigen is: " << std::min((v - b).norm(), (v + b).norm()) << std::endl;
+  }
+
+  // The matrix is tridiagonal: most of the entries scattered above, and
+  // most of the vector gathered at every product, are useless. With the
+  // sparse operator every proc builds its own rows, and every product only
+  // exchanges one entry with each neighbouring proc.
+  const eigensolver::row_partition part(N);
+  eigensolver::SparseMatrix rows(part.local_rows(), N);
+  std::vector<Eigen::Triplet<double>> entries;
+  for (int i = 0; i < part.local_rows(); ++i) {
+    const long row = part.offset() + i;
+    if (row > 0) entries.emplace_back(i, row - 1, -1.0);
+    entries.emplace_back(i, row, 2.0);
+    if (row + 1 < (long)N) entries.emplace_back(i, row + 1, -1.0);
+  }
+  rows.setFromTriplets(entries.begin(), entries.end());
+  const eigensolver::csr_operator sparse(rows, part);
+  const Eigen::VectorXd x0 = eigensolver::scatter(b0, part);
+
+  // the eigenvalues of tridiag(-1, 2, -1) are 2 - 2 cos(k pi / (N + 1))
+  const double exact = 2.0 - 2.0 * std::cos(N * M_PI / (N + 1));
+  for (auto m : {eigensolver::method::power, eigensolver::method::rayleigh,
+                 eigensolver::method::lanczos, eigensolver::method::arnoldi}) {
+    Eigen::VectorXd x = x0;
+    eigensolver::result res;
+    const auto dt = timeit([&]() { res = eigensolver::solve(sparse, x, m); });
+    if (rank == 0) {
+      std::cout << "Sparse " << eigensolver::name(m) << ": " << dt << " [ms], "
+                << res.iterations << " products, eigenvalue error " << res.eigenvalue - exact
+                << ", residual " << res.residual << std::endl;
+    }
   }
 
   MPI_Finalize();
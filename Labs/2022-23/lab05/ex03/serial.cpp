@@ -5,6 +5,7 @@
 #include <vector>
 
 #include "../utils.hpp"
+#include "sieve.hpp"
 
 std::vector<char> get_primes_v1(size_t n) {
   std::vector<char> is_prime(n + 1, 1);
@@ -92,6 +93,11 @@ std::vector<bool> get_primes_v5(size_t n) {
   return is_prime;
 }
 
+// mod-30 wheel, segmented and multithreaded: see sieve.hpp
+sieve::prime_bitmap get_primes_v6(size_t n) {
+  return sieve::prime_bitmap(0, n + 1);
+}
+
 int main() {
   const size_t n = 100'000'000;
   std::cout << "Elapsed: " << timeit([&]() { get_primes_v1(n); }) << " [ms] for naive" << std::endl;
@@ -99,6 +105,13 @@ int main() {
   std::cout << "Elapsed: " << timeit([&]() { get_primes_v3(n); }) << " [ms] for vector-bool+avoid-even" << std::endl;
   std::cout << "Elapsed: " << timeit([&]() { get_primes_v4(n); }) << " [ms] for vector-bool+cache-friendly" << std::endl;
   std::cout << "Elapsed: " << timeit([&]() { get_primes_v5(n); }) << " [ms] for vector-bool+cache-friendly+avoid-even" << std::endl;
+  std::cout << "Elapsed: " << timeit([&]() { get_primes_v6(n); }) << " [ms] for wheel-30+cache-friendly+multithreaded" << std::endl;
+
+  // the bitmap can be queried without decoding it
+  const auto primes = get_primes_v6(n);
+  std::cout << "pi(" << n << ") = " << primes.count() << ", primes in [" << n - 100 << ", " << n << "]:";
+  primes.for_each_prime(n - 100, n + 1, [](uint64_t p) { std::cout << " " << p; });
+  std::cout << std::endl;
 
   return 0;
 }
\ No newline at end of file
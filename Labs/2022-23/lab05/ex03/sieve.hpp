@@ -0,0 +1,381 @@
+#ifndef __SIEVE_H__
+#define __SIEVE_H__
+
+// Segmented sieve of Eratosthenes on a mod-30 wheel.
+//
+// Only the numbers coprime to 30 can be primes (apart from 2, 3 and 5):
+// in every block of 30 numbers there are 8 of them, 30k + {1, 7, 11, 13,
+// 17, 19, 23, 29}, so one byte of the bitmap covers 30 numbers (bit i of
+// byte k is 30k + residues[i]). Compared to the odd-only sieve of
+// `get_primes_v5` (serial.cpp) this is 3.75x less memory, and the
+// multiples of 2, 3 and 5 are never crossed off.
+//
+// The bitmap is sieved in segments of `segment_bytes` bytes, small enough
+// to stay in cache. Each sieving prime p keeps the position of its next
+// multiple (byte and wheel index) from one segment to the next, so it is
+// never recomputed; since the multiples p q with q coprime to 30 repeat
+// with period p bytes, 8 of them are crossed off per step of the inner
+// loop. The multiples of 7, 11 and 13 are not sieved but copied from a
+// precomputed pattern of 7 * 11 * 13 bytes. Chunks of consecutive
+// segments are distributed to the OpenMP threads.
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace sieve {
+
+constexpr std::array<uint32_t, 8> residues{1, 7, 11, 13, 17, 19, 23, 29};
+
+// Bytes sieved at a time (the size of a typical L1 data cache).
+constexpr uint64_t segment_bytes = 32 * 1024;
+
+namespace detail {
+
+// Bit of the residue r (mod 30) in a byte; -1 if r is not coprime to 30.
+constexpr std::array<int, 30> make_bit_of() {
+  std::array<int, 30> bit{};
+  bit.fill(-1);
+  for (int i = 0; i < 8; ++i) bit[residues[i]] = i;
+  return bit;
+}
+constexpr auto bit_of = make_bit_of();
+
+// Primes up to `limit`, with a plain odd-only sieve.
+inline std::vector<uint32_t> small_primes(uint32_t limit) {
+  std::vector<uint32_t> primes;
+  if (limit >= 2) primes.push_back(2);
+  std::vector<char> composite(limit / 2 + 1, 0);
+  for (uint64_t i = 3; i <= limit; i += 2) {
+    if (composite[i / 2]) continue;
+    primes.push_back(i);
+    for (uint64_t j = i * i; j <= limit; j += 2 * i) composite[j / 2] = 1;
+  }
+  return primes;
+}
+
+// Pattern of 7 * 11 * 13 bytes with the multiples of 7, 11 and 13 crossed
+// off: byte k of a segment starts as pattern[k % 1001].
+constexpr uint64_t pattern_bytes = 7 * 11 * 13;
+
+inline const std::vector<uint8_t>& presieve_pattern() {
+  static const std::vector<uint8_t> pattern = [] {
+    std::vector<uint8_t> p(pattern_bytes, 0xff);
+    for (uint64_t k = 0; k < pattern_bytes; ++k)
+      for (int i = 0; i < 8; ++i) {
+        const uint64_t x = 30 * k + residues[i];
+        if (x % 7 == 0 || x % 11 == 0 || x % 13 == 0) p[k] &= ~(1u << i);
+      }
+    return p;
+  }();
+  return pattern;
+}
+
+// A sieving prime p = 30 a + r, with its next multiple p q (q coprime to
+// 30, q >= p): the byte of p q and the index of q mod 30 in `residues`.
+struct sieving_prime {
+  uint32_t a;
+  uint8_t r_index, w_index;
+  uint64_t byte;
+};
+
+// Offsets (bytes) and bit masks of the multiples p (30 c + w_k), k < 8,
+// relative to p (30 c + 1): o_k = a (w_k - 1) + floor(r w_k / 30).
+struct wheel_tables {
+  std::array<std::array<uint32_t, 9>, 8> offset;  // offset[8]: p / 30 excluded, r
+  std::array<std::array<uint8_t, 8>, 8> mask;
+
+  constexpr wheel_tables() : offset{}, mask{} {
+    for (int ri = 0; ri < 8; ++ri) {
+      const uint32_t r = residues[ri];
+      for (int k = 0; k < 8; ++k) {
+        offset[ri][k] = r * residues[k] / 30;
+        mask[ri][k] = static_cast<uint8_t>(~(1u << bit_of[r * residues[k] % 30]));
+      }
+      offset[ri][8] = r;  // r * 31 / 30 = r: the next cycle
+    }
+  }
+};
+constexpr wheel_tables tables{};
+
+// Byte offset of the k-th multiple of the cycle of p = 30 a + r.
+inline uint64_t offset(uint32_t a, int ri, int k) {
+  return uint64_t(a) * (k < 8 ? residues[k] - 1 : 30) + tables.offset[ri][k];
+}
+
+// Sieves consecutive segments, starting from byte `first_byte`, with the
+// primes 17 <= p <= sqrt(limit).
+class segment_sieve {
+ public:
+  segment_sieve(uint64_t first_byte, uint64_t limit,
+                const std::vector<uint32_t>& base_primes)
+      : next_byte(first_byte) {
+    const uint64_t low = 30 * first_byte;
+    for (uint32_t p : base_primes) {
+      if (p < 17) continue;
+      if (uint64_t(p) * p >= limit) break;
+      // First multiple p q >= max(p^2, low) with q coprime to 30.
+      uint64_t q = std::max<uint64_t>(p, (low + p - 1) / p);
+      while (bit_of[q % 30] < 0) ++q;
+      primes.push_back({p / 30, static_cast<uint8_t>(bit_of[p % 30]),
+                        static_cast<uint8_t>(bit_of[q % 30]), p * q / 30});
+    }
+  }
+
+  // Sieve the next `n` bytes into `seg`.
+  void next(uint8_t* seg, uint64_t n) {
+    const auto& pattern = presieve_pattern();
+    for (uint64_t k = 0, j = next_byte % pattern_bytes; k < n;) {
+      const uint64_t len = std::min(n - k, pattern_bytes - j);
+      std::memcpy(seg + k, pattern.data() + j, len);
+      k += len;
+      j = 0;
+    }
+
+    const uint64_t end = next_byte + n;
+    for (auto& sp : primes) {
+      if (sp.byte >= end) continue;
+      uint64_t b = sp.byte - next_byte;
+      int w = sp.w_index;
+      const uint32_t a = sp.a;
+      const int ri = sp.r_index;
+      const auto& mask = tables.mask[ri];
+
+      // Single steps up to the start of a wheel cycle...
+      for (; w != 0 && b < n; w = (w + 1) & 7) {
+        seg[b] &= mask[w];
+        b += offset(a, ri, w + 1) - offset(a, ri, w);
+      }
+      // ...then whole cycles of 8 multiples, p bytes apart...
+      if (w == 0) {
+        const uint64_t o1 = offset(a, ri, 1), o2 = offset(a, ri, 2),
+                       o3 = offset(a, ri, 3), o4 = offset(a, ri, 4),
+                       o5 = offset(a, ri, 5), o6 = offset(a, ri, 6),
+                       o7 = offset(a, ri, 7), p = offset(a, ri, 8);
+        for (; b + o7 < n; b += p) {
+          seg[b] &= mask[0];
+          seg[b + o1] &= mask[1];
+          seg[b + o2] &= mask[2];
+          seg[b + o3] &= mask[3];
+          seg[b + o4] &= mask[4];
+          seg[b + o5] &= mask[5];
+          seg[b + o6] &= mask[6];
+          seg[b + o7] &= mask[7];
+        }
+        // ...and single steps to the end of the segment.
+        for (; b < n; w = (w + 1) & 7) {
+          seg[b] &= mask[w];
+          b += offset(a, ri, w + 1) - offset(a, ri, w);
+        }
+      }
+      sp.byte = next_byte + b;
+      sp.w_index = w;
+    }
+
+    // The pattern crossed off 7, 11 and 13 themselves, and 1 is no prime.
+    if (next_byte == 0) seg[0] = (seg[0] | 0x0e) & ~1u;
+    next_byte = end;
+  }
+
+ private:
+  uint64_t next_byte;
+  std::vector<sieving_prime> primes;
+};
+
+// Mask of the bits of byte k for the numbers in [lo, hi).
+inline uint8_t range_mask(uint64_t k, uint64_t lo, uint64_t hi) {
+  uint8_t m = 0;
+  for (int i = 0; i < 8; ++i) {
+    const uint64_t x = 30 * k + residues[i];
+    if (x >= lo && x < hi) m |= 1u << i;
+  }
+  return m;
+}
+
+// Number of set bits of bytes [first, last) of `data`.
+inline uint64_t popcount(const uint8_t* data, uint64_t first, uint64_t last) {
+  uint64_t count = 0;
+  uint64_t k = first;
+  for (; k + 8 <= last; k += 8) {
+    uint64_t word;
+    std::memcpy(&word, data + k, 8);
+    count += std::popcount(word);
+  }
+  for (; k < last; ++k) count += std::popcount(data[k]);
+  return count;
+}
+
+// Number of 2, 3, 5 in [lo, hi).
+inline uint64_t count_small(uint64_t lo, uint64_t hi) {
+  uint64_t count = 0;
+  for (uint64_t p : {2, 3, 5}) count += p >= lo && p < hi;
+  return count;
+}
+
+// Split bytes [first, last) into chunks of whole segments, one per task;
+// f(chunk_first, chunk_last) is called in parallel.
+template <typename F>
+void parallel_chunks(uint64_t first, uint64_t last, int n_threads, F f) {
+#ifdef _OPENMP
+  const int nt = n_threads > 0 ? n_threads : omp_get_max_threads();
+#else
+  const int nt = 1;
+  (void)n_threads;
+#endif
+  const uint64_t segments = (last - first + segment_bytes - 1) / segment_bytes;
+  // A few chunks per thread, for load balance (the low segments are the
+  // most expensive), and at most 64 segments each.
+  const uint64_t n_chunks = std::min<uint64_t>(
+      segments, std::max<uint64_t>(4 * nt, segments / 64));
+#pragma omp parallel for schedule(dynamic, 1) num_threads(nt)
+  for (uint64_t c = 0; c < n_chunks; ++c) {
+    const uint64_t s0 = segments * c / n_chunks, s1 = segments * (c + 1) / n_chunks;
+    f(first + s0 * segment_bytes, std::min(last, first + s1 * segment_bytes));
+  }
+}
+
+}  // namespace detail
+
+// The sieving primes for the range [lo, hi): the primes up to sqrt(hi).
+inline std::vector<uint32_t> base_primes(uint64_t hi) {
+  return detail::small_primes(std::sqrt(double(hi)) + 1);
+}
+
+// Sieve bytes [first, last) of the bitmap of [lo, hi) into `out` (last -
+// first bytes), single threaded; the bits outside [lo, hi) are cleared.
+// For callers that distribute the segments themselves (e.g. among MPI
+// ranks): the base primes are computed once with `base_primes(hi)`.
+inline void sieve_bytes(uint64_t lo, uint64_t hi, uint64_t first, uint64_t last,
+                        const std::vector<uint32_t>& base, uint8_t* out) {
+  if (first >= last) return;
+  detail::segment_sieve s(first, hi, base);
+  for (uint64_t b = first; b < last; b += segment_bytes)
+    s.next(out + (b - first), std::min(segment_bytes, last - b));
+  out[0] &= detail::range_mask(first, lo, hi);
+  out[last - first - 1] &= detail::range_mask(last - 1, lo, hi);
+}
+
+// Number of set bits of the first `n` bytes of `data`: the number of
+// primes > 5 in a sieved bitmap.
+inline uint64_t count_bits(const uint8_t* data, uint64_t n) {
+  return detail::popcount(data, 0, n);
+}
+
+// The primes in [lo, hi), as a bitmap on the mod-30 wheel.
+class prime_bitmap {
+ public:
+  // Sieve [lo, hi) with `n_threads` OpenMP threads (0: the default).
+  prime_bitmap(uint64_t lo, uint64_t hi, int n_threads = 0)
+      : lo(lo), hi(std::max(lo, hi)), first_byte(lo / 30),
+        bits((this->hi + 29) / 30 - first_byte) {
+    const auto base = base_primes(this->hi);
+    detail::parallel_chunks(first_byte, first_byte + bits.size(), n_threads,
+                            [&](uint64_t b0, uint64_t b1) {
+      sieve_bytes(this->lo, this->hi, b0, b1, base, bits.data() + (b0 - first_byte));
+    });
+  }
+
+  // A bitmap sieved elsewhere (see `sieve_bytes`): bytes lo / 30 up to
+  // (hi - 1) / 30 of the bitmap of [lo, hi).
+  prime_bitmap(uint64_t lo, uint64_t hi, std::vector<uint8_t> bits)
+      : lo(lo), hi(std::max(lo, hi)), first_byte(lo / 30), bits(std::move(bits)) {}
+
+  uint64_t begin() const { return lo; }
+  uint64_t end() const { return hi; }
+
+  // Raw bitmap: bit i of byte k is 30 (first_byte() + k) + residues[i].
+  const std::vector<uint8_t>& bytes() const { return bits; }
+  uint64_t byte_offset() const { return first_byte; }
+
+  bool is_prime(uint64_t x) const {
+    if (x < lo || x >= hi) return false;
+    if (x < 7) return x == 2 || x == 3 || x == 5;
+    const int bit = detail::bit_of[x % 30];
+    return bit >= 0 && (bits[x / 30 - first_byte] >> bit & 1);
+  }
+
+  // Number of primes in [a, b) (restricted to the sieved range).
+  uint64_t count(uint64_t a, uint64_t b) const {
+    a = std::max(a, lo);
+    b = std::min(b, hi);
+    if (a >= b) return 0;
+    const uint64_t k0 = a / 30 - first_byte, k1 = (b - 1) / 30 - first_byte;
+    uint64_t n = detail::count_small(a, b);
+    if (k0 == k1)
+      return n + std::popcount(uint8_t(bits[k0] & detail::range_mask(k0 + first_byte, a, b)));
+    n += std::popcount(uint8_t(bits[k0] & detail::range_mask(k0 + first_byte, a, b)));
+    n += std::popcount(uint8_t(bits[k1] & detail::range_mask(k1 + first_byte, a, b)));
+    return n + detail::popcount(bits.data(), k0 + 1, k1);
+  }
+  uint64_t count() const { return count(lo, hi); }
+
+  // f(p) for the primes p in [a, b), in increasing order.
+  template <typename F>
+  void for_each_prime(uint64_t a, uint64_t b, F f) const {
+    a = std::max(a, lo);
+    b = std::min(b, hi);
+    for (uint64_t p : {2, 3, 5})
+      if (p >= a && p < b) f(p);
+    if (a >= b) return;
+    const uint64_t k0 = a / 30 - first_byte, k1 = (b - 1) / 30 - first_byte;
+    for (uint64_t k = k0; k <= k1; ++k) {
+      unsigned byte = bits[k];
+      if (k == k0 || k == k1) byte &= detail::range_mask(k + first_byte, a, b);
+      for (; byte; byte &= byte - 1)
+        f(30 * (k + first_byte) + residues[std::countr_zero(byte)]);
+    }
+  }
+
+ private:
+  uint64_t lo, hi, first_byte;
+  std::vector<uint8_t> bits;
+};
+
+// Number of primes in [lo, hi), without storing the bitmap (only one
+// segment per thread): for ranges too large for memory.
+inline uint64_t count_primes(uint64_t lo, uint64_t hi, int n_threads = 0) {
+  if (lo >= hi) return 0;
+  const auto base = base_primes(hi);
+  const uint64_t first = lo / 30, last = (hi + 29) / 30;
+  uint64_t total = detail::count_small(lo, hi);
+#ifdef _OPENMP
+  omp_lock_t lock;
+  omp_init_lock(&lock);
+#endif
+  detail::parallel_chunks(first, last, n_threads, [&](uint64_t b0, uint64_t b1) {
+    std::vector<uint8_t> seg(segment_bytes);
+    detail::segment_sieve s(b0, hi, base);
+    uint64_t n = 0;
+    for (uint64_t b = b0; b < b1; b += segment_bytes) {
+      const uint64_t len = std::min(segment_bytes, b1 - b);
+      s.next(seg.data(), len);
+      if (b == first) seg[0] &= detail::range_mask(first, lo, hi);
+      if (b + len == last) seg[len - 1] &= detail::range_mask(last - 1, lo, hi);
+      n += detail::popcount(seg.data(), 0, len);
+    }
+#ifdef _OPENMP
+    omp_set_lock(&lock);
+    total += n;
+    omp_unset_lock(&lock);
+#else
+    total += n;
+#endif
+  });
+#ifdef _OPENMP
+  omp_destroy_lock(&lock);
+#endif
+  return total;
+}
+
+}  // namespace sieve
+
+#endif
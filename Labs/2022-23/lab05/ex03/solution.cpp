@@ -1,70 +1,82 @@
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
-#include <map>
 #include <vector>
 
 #include <mpi.h>
 
 #include "../utils.hpp"
+#include "sieve.hpp"
 
-std::vector<char> get_primes(unsigned long n) {
+// Bytes of the wheel bitmap (see sieve.hpp) in a stripe: the segments
+// are dealt to the ranks cyclically in stripes of this size, so that each
+// rank gets both low (expensive: many multiples per byte) and high
+// segments, while every stripe still fits in the L2 cache.
+constexpr uint64_t stripe_bytes = 8 * sieve::segment_bytes;
+
+// Number of primes <= n, on rank 0. If `primes` is not null, rank 0 also
+// collects in it the bitmap of the primes <= n.
+//
+// Every rank computes the sieving primes up to sqrt(n) by itself and then
+// sieves its stripes with no communication: n is broadcast at the
+// beginning and the counts reduced (or the bitmap gathered) at the end.
+uint64_t get_primes(unsigned long n, sieve::prime_bitmap* primes = nullptr) {
   int rank, size;
   MPI_Comm_size(MPI_COMM_WORLD, &size);
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-  // broadcast n 
-  MPI_Bcast(&n, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
-  // calculate the local segment size
-  const auto local_n = n / size + ((n % size) > (unsigned long)rank);
-  // calculate the start of the segment
-  const auto min = (n / size) * rank + std::min((unsigned long)rank, n % size);
-  // initialize the `is_prime` vector
-  std::vector<char> is_prime(local_n, '1');
-  if (rank == 0) {
-    is_prime[0] = is_prime[1] = '0';
-  }
+  // broadcast n (and whether to collect the bitmap)
+  int gather = primes != nullptr;
+  unsigned long buf[2] = {n, (unsigned long)gather};
+  MPI_Bcast(buf, 2, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+  n = buf[0];
+  gather = buf[1];
 
-  // initialize the current number we are considering (to 2 since it is the first prime)
-  unsigned long curr = 2;
-  while (curr * curr < n) {
-    // find the index of the first number that is multiple of the current prime in our partition
-    unsigned long first_to_remove;
-    if (curr * curr > min) {
-      first_to_remove = curr * curr - min;
-    } else {
-      first_to_remove = (curr - (min % curr)) * ((min % curr) > 0);
-    }
-    // apply the sieve, i.e. from first_to_remove to the end of the segment
-    // flag as false `is_prime` each multiple of the current prime
-    for (unsigned long i = first_to_remove; i < local_n; i += curr) {
-      is_prime[i] = '0';
-    }
-    // just rank 0 search for the next prime
-    // we are assuming that smallest prime greater than sqrt(n) belongs to rank 0
-    // since usually `size` << `n`, this is reasonable
-    if (rank == 0) {
-      while (!is_prime[curr++]) {};
-    }
-    // broadcast the prime number we have found to all proc
-    MPI_Bcast(&curr, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+  // the bitmap of [0, n + 1): stripe k goes to rank k % size
+  const uint64_t hi = n + 1, n_bytes = (hi + 29) / 30;
+  const uint64_t n_stripes = (n_bytes + stripe_bytes - 1) / stripe_bytes;
+  const auto base = sieve::base_primes(hi);
+
+  // the local stripes, one after the other (only the current one, if we
+  // just count)
+  std::vector<uint8_t> local;
+  uint64_t local_count = 0;
+  for (uint64_t k = rank; k < n_stripes; k += size) {
+    const uint64_t first = k * stripe_bytes;
+    const uint64_t last = std::min(n_bytes, first + stripe_bytes);
+    const uint64_t offset = gather ? local.size() : 0;
+    local.resize(offset + last - first);
+    sieve::sieve_bytes(0, hi, first, last, base, local.data() + offset);
+    local_count += sieve::count_bits(local.data() + offset, last - first);
   }
 
-  // allocate buffer to collect at rank 0
-  std::vector<char> is_prime_global;
-  // calculate counts and displacements for MPI_Gatherv
-  std::vector<int> counts, displs;
-  if (rank == 0) {
-    is_prime_global.resize(n);
-    displs.push_back(0);
-    counts.push_back(local_n);
-    for(int i = 1; i < size; ++i) {
-      displs.push_back(counts.back() + displs.back());
-      counts.push_back(n / size + (((int)n % size) > i));
+  uint64_t count = 0;
+  MPI_Reduce(&local_count, &count, 1, MPI_UINT64_T, MPI_SUM, 0, MPI_COMM_WORLD);
+  // 2, 3 and 5 are not in the bitmap
+  count += (n >= 2) + (n >= 3) + (n >= 5);
+
+  if (gather) {
+    // the size of the stripes of every rank is known: no need to communicate it
+    std::vector<int> counts(size, 0), displs(size, 0);
+    for (uint64_t k = 0; k < n_stripes; ++k)
+      counts[k % size] += std::min(stripe_bytes, n_bytes - k * stripe_bytes);
+    for (int r = 1; r < size; ++r) displs[r] = displs[r - 1] + counts[r - 1];
+
+    std::vector<uint8_t> gathered(rank == 0 ? n_bytes : 0);
+    MPI_Gatherv(local.data(), local.size(), MPI_UINT8_T, gathered.data(),
+                counts.data(), displs.data(), MPI_UINT8_T, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+      // put the stripes back in order
+      std::vector<uint8_t> bits(n_bytes);
+      for (uint64_t k = 0; k < n_stripes; ++k) {
+        const uint64_t len = std::min(stripe_bytes, n_bytes - k * stripe_bytes);
+        std::copy_n(gathered.begin() + displs[k % size] + (k / size) * stripe_bytes,
+                    len, bits.begin() + k * stripe_bytes);
+      }
+      *primes = sieve::prime_bitmap(0, hi, std::move(bits));
     }
   }
-  // do the MPI_Gatherv
-  MPI_Gatherv(&is_prime[0], is_prime.size(), MPI_CHAR, &is_prime_global[0],
-              &counts[0], &displs[0], MPI_CHAR, 0, MPI_COMM_WORLD);
-  return is_prime_global;
+  return count;
 }
 
 int main(int argc, char* argv[]) {
@@ -73,13 +85,30 @@ int main(int argc, char* argv[]) {
   MPI_Comm_size(MPI_COMM_WORLD, &size);
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-  std::vector<char> is_prime;
-  const auto dt = timeit([&]() { is_prime = get_primes(100); });
+  // n can be passed as first argument
+  const unsigned long n = argc > 1 ? std::stod(argv[1]) : 100;
+  // collect the bitmap only to print the primes
+  sieve::prime_bitmap primes(0, 0, std::vector<uint8_t>{});
+  uint64_t count;
+  const double t0 = MPI_Wtime();
+  const auto dt = timeit([&]() { count = get_primes(n, n <= 1000 ? &primes : nullptr); });
+  // time of the slowest rank, for the timing record
+  const double local_seconds = MPI_Wtime() - t0;
+  double seconds;
+  MPI_Reduce(&local_seconds, &seconds, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
   if (rank == 0) {
     std::cout << "Elapsed: " << dt << " [ms] " << std::endl;
-    std::cout << is_prime << std::endl;
+    std::cout << "Number of primes <= " << n << ": " << count << std::endl;
+    if (n <= 1000) {
+      primes.for_each_prime(0, n + 1, [](uint64_t p) { std::cout << p << " "; });
+      std::cout << std::endl;
+    }
+    // timing record for the scaling driver
+    // (2025-26/05-PBS-algorithms_and_execution_policies/PBS/scaling.cpp)
+    std::cout << "TIMING app=primes ranks=" << size << " threads=1 size=" << n
+              << " seconds=" << seconds << std::endl;
   }
 
   MPI_Finalize();
   return 0;
-}
\ No newline at end of file
+}
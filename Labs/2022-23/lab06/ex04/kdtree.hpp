@@ -0,0 +1,214 @@
+#ifndef __KDTREE_H__
+#define __KDTREE_H__
+
+// K-d tree of points in Dim dimensions, with k-nearest-neighbour and
+// radius queries.
+//
+// Compared to `build_kdtree` of solution.cpp:
+// - the leaves are buckets of up to `bucket_size` points (scanned
+//   linearly), rather than single points;
+// - every node splits its points in two halves with std::nth_element along
+//   the axis of largest extent, which is O(n) per level instead of the
+//   O(n log n) of a full sort: O(n log n) in total;
+// - the two halves are built by OpenMP tasks, but only down to
+//   `task_cutoff` points: smaller subtrees are built by the thread that
+//   reaches them;
+// - since a node always splits its range [begin, end) at the midpoint, and
+//   all the leaves are at the same depth, the tree is complete: the nodes
+//   are stored in breadth-first order (the children of node i are 2 i + 1
+//   and 2 i + 2, as in a binary heap), with no child indices, and the top
+//   levels, visited by every query, are packed in a few cache lines. The
+//   points are stored in leaf order, so that a leaf is contiguous memory.
+//
+// Build it inside or outside of an OpenMP parallel region; the batched
+// queries are parallel over the query points.
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+template <size_t Dim>
+class kd_tree {
+ public:
+  using point = std::array<double, Dim>;
+
+  // Subtrees with fewer points are built without spawning tasks.
+  static constexpr size_t task_cutoff = 1 << 15;
+
+  explicit kd_tree(const std::vector<point>& points, size_t bucket_size = 16)
+      : entries(points.size()) {
+    for (size_t i = 0; i < points.size(); ++i) entries[i] = {points[i], i};
+    // the leaves are at depth `levels`, with at most bucket_size points
+    levels = 0;
+    while ((entries.size() >> levels) > std::max<size_t>(bucket_size, 1)) ++levels;
+    nodes.resize((size_t(1) << levels) - 1);
+
+#ifdef _OPENMP
+    if (!omp_in_parallel()) {
+#pragma omp parallel
+#pragma omp single
+      build(0, 0, 0, entries.size());
+      return;
+    }
+#endif
+    build(0, 0, 0, entries.size());
+  }
+
+  size_t size() const { return entries.size(); }
+
+  // The (up to) k nearest points to q, by increasing distance: their
+  // indices in `ids` and, if not null, their squared distances in `dist2`.
+  void knn(const point& q, size_t k, std::vector<size_t>& ids,
+           std::vector<double>* dist2 = nullptr) const {
+    std::vector<std::pair<double, size_t>> heap;  // max-heap of the best k
+    heap.reserve(k);
+    if (k > 0) knn(q, k, 0, 0, 0, entries.size(), heap);
+    std::sort_heap(heap.begin(), heap.end());
+    ids.resize(heap.size());
+    for (size_t i = 0; i < heap.size(); ++i) ids[i] = heap[i].second;
+    if (dist2) {
+      dist2->resize(heap.size());
+      for (size_t i = 0; i < heap.size(); ++i) (*dist2)[i] = heap[i].first;
+    }
+  }
+
+  // The k nearest points to each of the queries: row i of the (queries x
+  // min(k, size())) result, stored row-wise, holds those of queries[i].
+  std::vector<size_t> knn(const std::vector<point>& queries, size_t k) const {
+    k = std::min(k, size());
+    std::vector<size_t> result(queries.size() * k);
+#pragma omp parallel
+    {
+      std::vector<size_t> ids;
+#pragma omp for schedule(dynamic, 256)
+      for (size_t i = 0; i < queries.size(); ++i) {
+        knn(queries[i], k, ids);
+        std::copy(ids.begin(), ids.end(), result.begin() + i * k);
+      }
+    }
+    return result;
+  }
+
+  // The points at distance <= r from q (in no particular order).
+  void radius(const point& q, double r, std::vector<size_t>& ids) const {
+    ids.clear();
+    radius(q, r * r, 0, 0, 0, entries.size(), ids);
+  }
+
+  // The points at distance <= r from each of the queries.
+  std::vector<std::vector<size_t>> radius(const std::vector<point>& queries,
+                                          double r) const {
+    std::vector<std::vector<size_t>> result(queries.size());
+#pragma omp parallel for schedule(dynamic, 256)
+    for (size_t i = 0; i < queries.size(); ++i) radius(queries[i], r, result[i]);
+    return result;
+  }
+
+ private:
+  struct entry {
+    point x;
+    size_t id;
+  };
+  struct node {
+    double split;
+    size_t axis;
+  };
+
+  std::vector<entry> entries;  // in leaf order
+  std::vector<node> nodes;     // breadth-first
+  size_t levels;
+
+  static double distance2(const point& a, const point& b) {
+    double d2 = 0.0;
+    for (size_t j = 0; j < Dim; ++j) d2 += (a[j] - b[j]) * (a[j] - b[j]);
+    return d2;
+  }
+
+  void build(size_t i, size_t depth, size_t begin, size_t end) {
+    if (depth == levels) return;
+
+    // axis of largest extent
+    point lo, hi;
+    lo.fill(std::numeric_limits<double>::infinity());
+    hi.fill(-std::numeric_limits<double>::infinity());
+    for (size_t p = begin; p < end; ++p)
+      for (size_t j = 0; j < Dim; ++j) {
+        lo[j] = std::min(lo[j], entries[p].x[j]);
+        hi[j] = std::max(hi[j], entries[p].x[j]);
+      }
+    size_t axis = 0;
+    for (size_t j = 1; j < Dim; ++j)
+      if (hi[j] - lo[j] > hi[axis] - lo[axis]) axis = j;
+
+    // median split: the left half <= split <= the right half
+    const size_t mid = begin + (end - begin) / 2;
+    std::nth_element(entries.begin() + begin, entries.begin() + mid,
+                     entries.begin() + end, [axis](const entry& a, const entry& b) {
+                       return a.x[axis] < b.x[axis];
+                     });
+    nodes[i] = {entries[mid].x[axis], axis};
+
+    if (end - begin > task_cutoff) {
+#pragma omp task
+      build(2 * i + 1, depth + 1, begin, mid);
+#pragma omp task
+      build(2 * i + 2, depth + 1, mid, end);
+#pragma omp taskwait
+    } else {
+      build(2 * i + 1, depth + 1, begin, mid);
+      build(2 * i + 2, depth + 1, mid, end);
+    }
+  }
+
+  void knn(const point& q, size_t k, size_t i, size_t depth, size_t begin,
+           size_t end, std::vector<std::pair<double, size_t>>& heap) const {
+    if (depth == levels) {
+      for (size_t p = begin; p < end; ++p) {
+        const double d2 = distance2(q, entries[p].x);
+        if (heap.size() < k) {
+          heap.emplace_back(d2, entries[p].id);
+          std::push_heap(heap.begin(), heap.end());
+        } else if (d2 < heap.front().first) {
+          std::pop_heap(heap.begin(), heap.end());
+          heap.back() = {d2, entries[p].id};
+          std::push_heap(heap.begin(), heap.end());
+        }
+      }
+      return;
+    }
+    const size_t mid = begin + (end - begin) / 2;
+    const double d = q[nodes[i].axis] - nodes[i].split;
+    // the side of q first, then the other one if it can be closer
+    if (d < 0) {
+      knn(q, k, 2 * i + 1, depth + 1, begin, mid, heap);
+      if (heap.size() < k || d * d < heap.front().first)
+        knn(q, k, 2 * i + 2, depth + 1, mid, end, heap);
+    } else {
+      knn(q, k, 2 * i + 2, depth + 1, mid, end, heap);
+      if (heap.size() < k || d * d < heap.front().first)
+        knn(q, k, 2 * i + 1, depth + 1, begin, mid, heap);
+    }
+  }
+
+  void radius(const point& q, double r2, size_t i, size_t depth, size_t begin,
+              size_t end, std::vector<size_t>& ids) const {
+    if (depth == levels) {
+      for (size_t p = begin; p < end; ++p)
+        if (distance2(q, entries[p].x) <= r2) ids.push_back(entries[p].id);
+      return;
+    }
+    const size_t mid = begin + (end - begin) / 2;
+    const double d = q[nodes[i].axis] - nodes[i].split;
+    if (d <= 0 || d * d <= r2) radius(q, r2, 2 * i + 1, depth + 1, begin, mid, ids);
+    if (d >= 0 || d * d <= r2) radius(q, r2, 2 * i + 2, depth + 1, mid, end, ids);
+  }
+};
+
+#endif
@@ -5,9 +5,12 @@
 #include <iomanip>
 #include <numeric> 
 #include <algorithm> 
+#include <cmath>
 
 #include <omp.h> 
 
+#include "kdtree.hpp"
+
 constexpr size_t dim = 2;
 using Point = std::array<double, dim>;
 using KDTree = std::vector<std::pair<size_t, size_t>>;
@@ -65,5 +68,50 @@ int main(int argc, char *argv[]) {
   for(const auto &pp : kdtree)
     std::cout << pp.first << " " << pp.second << std::endl;
 
+  // kdtree.hpp: bucketed leaves, O(n log n) build and queries
+  const kd_tree<dim> tree(points, 1);
+  std::vector<size_t> ids;
+  tree.knn({6, 3}, 2, ids);
+  std::cout << "2 nearest to (6, 3):";
+  for (auto i : ids) std::cout << " (" << points[i][0] << ", " << points[i][1] << ")";
+  std::cout << std::endl;
+
+  // benchmark on n random points in 3D (n can be passed as first argument)
+  const size_t n = argc > 1 ? std::stod(argv[1]) : 1'000'000;
+  const size_t n_queries = 100'000, k = 8;
+  std::mt19937 gen(0);
+  std::uniform_real_distribution<double> unif(0, 1);
+  std::vector<std::array<double, 3>> particles(n), queries(n_queries);
+  for (auto &p : particles) p = {unif(gen), unif(gen), unif(gen)};
+  for (auto &q : queries) q = {unif(gen), unif(gen), unif(gen)};
+
+  double t = omp_get_wtime();
+  const kd_tree<3> tree3(particles);
+  std::cout << "Build of " << n << " points: " << omp_get_wtime() - t << " [s]" << std::endl;
+  t = omp_get_wtime();
+  const auto neighbours = tree3.knn(queries, k);
+  std::cout << n_queries << " " << k << "-NN queries: " << omp_get_wtime() - t << " [s]" << std::endl;
+  // about k neighbours per query
+  const double r = std::cbrt(k / (4.0 / 3.0 * M_PI * n));
+  t = omp_get_wtime();
+  const auto in_radius = tree3.radius(queries, r);
+  std::cout << n_queries << " radius queries: " << omp_get_wtime() - t << " [s]" << std::endl;
+
+  // check a few queries against brute force
+  size_t errors = 0;
+  for (size_t i = 0; i < 10; ++i) {
+    std::vector<std::pair<double, size_t>> d2(n);
+    for (size_t j = 0; j < n; ++j) {
+      double s = 0;
+      for (size_t l = 0; l < 3; ++l) s += (particles[j][l] - queries[i][l]) * (particles[j][l] - queries[i][l]);
+      d2[j] = {s, j};
+    }
+    std::sort(d2.begin(), d2.end());
+    for (size_t j = 0; j < k; ++j) errors += d2[j].second != neighbours[i * k + j];
+    const auto within = std::count_if(d2.begin(), d2.end(), [r](const auto &p) { return p.first <= r * r; });
+    errors += (size_t)within != in_radius[i].size();
+  }
+  std::cout << "Errors against brute force: " << errors << std::endl;
+
   return 0;
 }
\ No newline at end of file
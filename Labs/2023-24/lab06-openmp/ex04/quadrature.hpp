@@ -0,0 +1,125 @@
+#ifndef QUADRATURE_HPP
+#define QUADRATURE_HPP
+
+// Composite Simpson rule with MPI and OpenMP, with dynamic load balancing.
+//
+// `simpson_multithreaded` in solution.cpp evaluates f three times per
+// interval, although the right end of an interval is the left end of the
+// next one: here every node is evaluated once, n + 1 nodes and n midpoints
+// (2 n + 1 evaluations instead of 3 n):
+//
+//   h / 6 (f(x_0) + 4 f(x_1/2) + 2 f(x_1) + ... + 4 f(x_n-1/2) + f(x_n)).
+//
+// Moreover, splitting [a, b] in equal parts, one per proc and thread, is
+// efficient only if f costs the same everywhere. Here the intervals are
+// grouped in chunks that are handed out dynamically:
+// - among the procs, with a counter of the next chunk stored on rank 0 and
+//   incremented with MPI_Fetch_and_op (one-sided: rank 0 computes like the
+//   others, there is no master);
+// - within a proc, the threads take the chunks from a shared queue, which
+//   the first thread to find it empty refills from the counter.
+// The calls to MPI happen inside a critical section: MPI_THREAD_SERIALIZED
+// is needed.
+//
+// Every chunk result is stored in its slot of an array, and the array is
+// summed in order at the end: the result does not depend on which proc or
+// thread computed what. The chunks themselves must not depend on the
+// decomposition either: by default there are `default_chunks` of them,
+// whatever the number of procs and threads.
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace quadrature {
+
+// Number of chunks when the chunk size is not given: enough for 16 chunks
+// per thread on 256 threads in total.
+constexpr unsigned long default_chunks = 4096;
+
+// Integral of f over [a, b] with n intervals, on every proc of comm, with
+// `num_threads` threads per proc (0: the OpenMP default) and chunks of
+// `chunk` intervals (0: n / default_chunks, rounded up). The result is
+// bitwise the same for any number of procs and threads with the same
+// chunk size.
+template <typename F>
+double simpson(const F &f, double a, double b, unsigned long n,
+               unsigned num_threads = 0, MPI_Comm comm = MPI_COMM_WORLD,
+               unsigned long chunk = 0) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+#ifdef _OPENMP
+  const int nt = num_threads ? num_threads : omp_get_max_threads();
+#else
+  const int nt = 1;
+  (void)num_threads;
+#endif
+  if (chunk == 0) chunk = std::max(1ul, (n + default_chunks - 1) / default_chunks);
+  const long n_chunks = (n + chunk - 1) / chunk;
+  const double h = (b - a) / n;
+
+  // the counter of the next chunk, on rank 0
+  long *counter;
+  MPI_Win win;
+  MPI_Win_allocate(rank == 0 ? sizeof(long) : 0, sizeof(long), MPI_INFO_NULL,
+                   comm, &counter, &win);
+  MPI_Win_lock_all(0, win);
+  if (rank == 0) {
+    *counter = 0;
+    MPI_Win_sync(win);
+  }
+  MPI_Barrier(comm);
+
+  // the chunks taken by this proc and not yet computed: [next, end)
+  long next = 0, end = 0;
+  bool exhausted = false;
+  // chunks taken from the counter at a time: one per thread
+  const long batch = nt;
+  std::vector<double> sums(n_chunks, 0.0);
+
+#pragma omp parallel num_threads(nt)
+  while (true) {
+    long c;
+#pragma omp critical(quadrature_queue)
+    {
+      if (next == end && !exhausted) {
+        long first;
+        MPI_Fetch_and_op(&batch, &first, MPI_LONG, 0, 0, MPI_SUM, win);
+        MPI_Win_flush(0, win);
+        next = std::min(first, n_chunks);
+        end = std::min(first + batch, n_chunks);
+        exhausted = next == end;
+      }
+      c = next < end ? next++ : -1;
+    }
+    if (c < 0) break;
+
+    // the nodes x_k of the chunk, from its left end, and the midpoints
+    const unsigned long first = c * chunk, last = std::min(n, first + chunk);
+    double sum = 0.0;
+#pragma omp simd reduction(+ : sum)
+    for (unsigned long k = first; k < last; ++k)
+      sum += (k == 0 ? 1.0 : 2.0) * f(a + k * h) + 4.0 * f(a + (k + 0.5) * h);
+    if (last == n) sum += f(b);
+    sums[c] = sum;
+  }
+
+  MPI_Win_unlock_all(win);
+  MPI_Win_free(&win);
+
+  // every chunk was computed by one proc, the others hold 0
+  MPI_Allreduce(MPI_IN_PLACE, sums.data(), n_chunks, MPI_DOUBLE, MPI_SUM, comm);
+  double integral = 0.0;
+  for (double s : sums) integral += s;
+  return h / 6.0 * integral;
+}
+
+}  // namespace quadrature
+
+#endif
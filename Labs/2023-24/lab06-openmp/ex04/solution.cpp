@@ -11,6 +11,8 @@
 #include <tuple>
 #include <vector>
 
+#include "quadrature.hpp"
+
 using namespace std::chrono;
 
 inline double simpson_multithreaded(std::function<double(double)> const& f,
@@ -84,6 +86,59 @@ int main(int argc, char** argv) {
               << "\n";
     std::cout << "Elapsed:" << dt << " [ms]\n";
   }
+
+  // the same integral with quadrature.hpp: every node is evaluated once
+  // and the chunks of intervals are distributed dynamically (the threads
+  // call MPI one at a time)
+  if (provided < MPI_THREAD_SERIALIZED) {
+    if (rank == 0) std::cerr << "MPI_THREAD_SERIALIZED is not supported\n";
+    MPI_Finalize();
+    return 0;
+  }
+  const auto quarter_circle = [](double x) { return std::sqrt(1 - x * x); };
+  auto t2 = high_resolution_clock::now();
+  integral = quadrature::simpson(quarter_circle, 0.0, 1.0, n, nthreads);
+  auto t3 = high_resolution_clock::now();
+  if (rank == 0) {
+    std::cout << "Dynamic scheduling, integral value: " << integral << "\n";
+    std::cout << "Error: " << std::abs(integral * 4.0 - std::numbers::pi)
+              << "\n";
+    std::cout << "Elapsed:" << duration_cast<milliseconds>(t3 - t2).count()
+              << " [ms]\n";
+  }
+
+  // an integrand whose cost is concentrated in [0.9, 1] (the same value,
+  // computed with a slowly converging series): with a static split the
+  // last proc does most of the work
+  const auto expensive = [](double x) {
+    if (x < 0.9) return std::sqrt(1 - x * x);
+    // sqrt(1 - t) = 1 - sum_k c_k t^k, c_1 = 1/2, c_k+1 = c_k (2k - 1) / (2k + 2)
+    const double t = x * x;
+    double sum = 1.0, c = 0.5, p = t;
+    for (int k = 1; k < 2000; ++k) {
+      sum -= c * p;
+      c *= (2.0 * k - 1) / (2.0 * k + 2);
+      p *= t;
+    }
+    return sum;
+  };
+  const auto n_exp = n / 100;
+  t2 = high_resolution_clock::now();
+  const double local_exp = simpson_multithreaded(
+      expensive, a_local, a_local + local_interval_size,
+      n_exp / size + (n_exp % size > rank), nthreads);
+  MPI_Reduce(&local_exp, &integral, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  t3 = high_resolution_clock::now();
+  const double dynamic = quadrature::simpson(expensive, 0.0, 1.0, n_exp, nthreads);
+  const auto t4 = high_resolution_clock::now();
+  if (rank == 0) {
+    std::cout << "Localized cost, " << n_exp << " intervals: static "
+              << duration_cast<milliseconds>(t3 - t2).count()
+              << " [ms] (error " << std::abs(integral * 4.0 - std::numbers::pi)
+              << "), dynamic " << duration_cast<milliseconds>(t4 - t3).count()
+              << " [ms] (error " << std::abs(dynamic * 4.0 - std::numbers::pi)
+              << ")\n";
+  }
   MPI_Finalize();
   return 0;
 }
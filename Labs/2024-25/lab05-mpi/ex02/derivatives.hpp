@@ -0,0 +1,139 @@
+#ifndef DERIVATIVES_HPP
+#define DERIVATIVES_HPP
+
+// Gradient and Hessian of f : R^N -> R by centred finite differences, with
+// MPI and OpenMP.
+//
+// The partial derivatives are independent tasks (N for the gradient,
+// N (N + 1) / 2 for the symmetric Hessian), whose cost depends on f and may
+// vary from task to task. Instead of a fixed assignment of the tasks to the
+// procs, the tasks are handed out dynamically in chunks: every proc takes
+// the next chunk from a counter on rank 0 with MPI_Fetch_and_op (passive
+// target one-sided communication, so rank 0 does not need to answer), and
+// splits it among its threads with `schedule(dynamic)`. Every proc writes
+// its results in a zeroed array, and one MPI_Allreduce assembles them, on
+// every proc.
+//
+// The point can be a std::vector<double> (N known at run time) or a
+// std::array<double, N>: f is called on the same type. The calls to MPI are
+// made outside of the OpenMP parallel regions (MPI_THREAD_FUNNELED is
+// enough).
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace derivatives {
+
+namespace detail {
+
+// Calls body(t) for t in [0, n_tasks): the tasks are distributed
+// dynamically among the procs of comm and their threads.
+template <typename Body>
+void distribute(size_t n_tasks, MPI_Comm comm, const Body &body) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  // about 8 chunks per proc: enough for load balance, and few
+  // round-trips to rank 0
+  const long chunk = std::max<long>(1, n_tasks / (8 * size));
+
+  // the counter of the next task, on rank 0
+  long *counter;
+  MPI_Win win;
+  MPI_Win_allocate(rank == 0 ? sizeof(long) : 0, sizeof(long), MPI_INFO_NULL,
+                   comm, &counter, &win);
+  MPI_Win_lock_all(0, win);
+  if (rank == 0) {
+    *counter = 0;
+    MPI_Win_sync(win);
+  }
+  MPI_Barrier(comm);  // the counter is initialized before anyone reads it
+
+  while (true) {
+    long first;
+    MPI_Fetch_and_op(&chunk, &first, MPI_LONG, 0, 0, MPI_SUM, win);
+    MPI_Win_flush(0, win);
+    if (first >= long(n_tasks)) break;
+    const long last = std::min<long>(n_tasks, first + chunk);
+#pragma omp parallel for schedule(dynamic, 1)
+    for (long t = first; t < last; ++t) body(t);
+  }
+
+  MPI_Win_unlock_all(win);
+  MPI_Win_free(&win);
+}
+
+}  // namespace detail
+
+// Gradient of f at x, with step h, on every proc.
+template <typename Function, typename Vector>
+Vector gradient(const Function &f, const Vector &x, double h,
+                MPI_Comm comm = MPI_COMM_WORLD) {
+  const size_t n = x.size();
+  Vector g(x);
+  std::fill(g.begin(), g.end(), 0.0);
+
+  detail::distribute(n, comm, [&](size_t i) {
+    Vector y(x);
+    y[i] = x[i] + h;
+    const double f_plus = f(y);
+    y[i] = x[i] - h;
+    const double f_minus = f(y);
+    g[i] = (f_plus - f_minus) / 2.0 / h;
+  });
+
+  // every component was computed by one proc, the others hold 0
+  MPI_Allreduce(MPI_IN_PLACE, g.data(), n, MPI_DOUBLE, MPI_SUM, comm);
+  return g;
+}
+
+// Hessian of f at x, with step h, on every proc: N x N, row-major.
+template <typename Function, typename Vector>
+std::vector<double> hessian(const Function &f, const Vector &x, double h,
+                            MPI_Comm comm = MPI_COMM_WORLD) {
+  const size_t n = x.size();
+  const double fx = f(x);
+  std::vector<double> H(n * n, 0.0);
+
+  // task t is the entry (i, j), j >= i, of the upper triangle, row by row:
+  // row i starts at task i n - i (i - 1) / 2
+  const auto row_start = [n](size_t i) { return i * n - i * (i - 1) / 2; };
+  detail::distribute(n * (n + 1) / 2, comm, [&](size_t t) {
+    size_t lo = 0, hi = n;  // the last row i with row_start(i) <= t
+    while (hi - lo > 1) {
+      const size_t mid = (lo + hi) / 2;
+      (row_start(mid) <= t ? lo : hi) = mid;
+    }
+    const size_t i = lo, j = i + (t - row_start(i));
+
+    Vector y(x);
+    if (i == j) {
+      y[i] = x[i] + h;
+      const double f_plus = f(y);
+      y[i] = x[i] - h;
+      const double f_minus = f(y);
+      H[i * n + i] = (f_plus - 2.0 * fx + f_minus) / (h * h);
+    } else {
+      double sum = 0.0;
+      for (int si : {1, -1})
+        for (int sj : {1, -1}) {
+          y[i] = x[i] + si * h;
+          y[j] = x[j] + sj * h;
+          sum += si * sj * f(y);
+        }
+      H[i * n + j] = H[j * n + i] = sum / (4.0 * h * h);
+    }
+  });
+
+  MPI_Allreduce(MPI_IN_PLACE, H.data(), n * n, MPI_DOUBLE, MPI_SUM, comm);
+  return H;
+}
+
+}  // namespace derivatives
+
+#endif
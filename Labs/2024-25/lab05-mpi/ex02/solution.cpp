@@ -1,54 +1,40 @@
 #include <mpi.h>
 
 #include <array>
+#include <chrono>
 #include <cmath>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <numbers>
+#include <string>
+#include <vector>
 
+#include "derivatives.hpp"
+
+// The components of the gradient are handed out dynamically to the procs
+// (and to their threads), and assembled with one MPI_Allreduce: the result
+// is available on every proc. See derivatives.hpp.
 template <size_t N>
 std::array<double, N> compute_gradient(
     const std::function<double(const std::array<double, N> &)> &f,
     const std::array<double, N> &x, double h) {
-  // initialize gradient
-  std::array<double, N> gradient;
-
-  // get rank and size
-  int rank, size;
-  MPI_Comm_size(MPI_COMM_WORLD, &size);
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-
-  // subdivide computations by processor
-  for (size_t i = rank; i < N; i += size) {
-    auto x_plus_h(x), x_minus_h(x);
-    x_plus_h[i] += h;
-    x_minus_h[i] -= h;
-    gradient[i] = (f(x_plus_h) - f(x_minus_h)) / 2.0 / h;
-  }
-
-  // send result to main proc
-  for (size_t i = 0; i < N; ++i) {
-    const int belongs_to_proc = i % size;
-    const int tag = i / size;
-    if (belongs_to_proc /*!= 0*/) {
-      if (rank == belongs_to_proc) {
-        MPI_Send(&gradient[i], 1, MPI_DOUBLE, 0, tag, MPI_COMM_WORLD);
-      } else if (rank == 0) {
-        MPI_Recv(&gradient[i], 1, MPI_DOUBLE, belongs_to_proc, tag,
-                 MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-      }
-    }
-  }
-  return gradient;
+  return derivatives::gradient(f, x, h);
 }
 
 int main(int argc, char *argv[]) {
-  // init MPI
-  MPI_Init(&argc, &argv);
+  // init MPI: only the main thread makes MPI calls
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
   int rank, size;
   MPI_Comm_size(MPI_COMM_WORLD, &size);
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (provided < MPI_THREAD_FUNNELED) {
+    if (rank == 0)
+      std::cerr << "ERROR: the MPI library does not support MPI_THREAD_FUNNELED"
+                << std::endl;
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
 
   // define types
   using Vector = std::array<double, 4>;
@@ -74,6 +60,65 @@ int main(int argc, char *argv[]) {
                 << std::endl;
     }
   }
+
+  // the Hessian is diagonal: -sin(0), e, -cos(pi), 12 * 2
+  const auto H = derivatives::hessian(f, y, 1e-4);
+  const Vector h_true = {0, std::exp(1), 1, 24};
+  if (rank == 0) {
+    size_t n_wrong = 0;
+    for (size_t i = 0; i < 4; ++i)
+      for (size_t j = 0; j < 4; ++j) {
+        const auto err = std::abs(H[i * 4 + j] - (i == j ? h_true[i] : 0.0));
+        if (err > 1e-5) {
+          std::cout << "H(" << i << ", " << j << ") = " << H[i * 4 + j]
+                    << ", expected " << (i == j ? h_true[i] : 0.0) << " FAIL"
+                    << std::endl;
+          ++n_wrong;
+        }
+      }
+    if (n_wrong == 0)
+      std::cout << "Hessian checked" << std::endl;
+    else
+      std::cout << "Hessian FAIL: " << n_wrong << " of 16 entries off by more than 1e-5"
+                << std::endl;
+  }
+
+  // N known at run time (first argument): f(x) = sum_i x_i^2 / 2 + x_i x_{i+1},
+  // whose gradient is x_{i-1} + x_i + x_{i+1} and whose Hessian is
+  // tridiagonal with all ones
+  const size_t n = argc > 1 ? std::stoul(argv[1]) : 300;
+  const auto f_n = [](const std::vector<double> &v) {
+    double sum = 0.0;
+    for (size_t i = 0; i < v.size(); ++i)
+      sum += v[i] * v[i] / 2 + (i + 1 < v.size() ? v[i] * v[i + 1] : 0.0);
+    return sum;
+  };
+  std::vector<double> x(n);
+  for (size_t i = 0; i < n; ++i) x[i] = std::sin(i);
+
+  const auto t0 = std::chrono::steady_clock::now();
+  const auto g_n = derivatives::gradient(f_n, x, 1e-6);
+  const auto t1 = std::chrono::steady_clock::now();
+  const auto H_n = derivatives::hessian(f_n, x, 1e-4);
+  const auto t2 = std::chrono::steady_clock::now();
+
+  double g_err = 0.0, H_err = 0.0;
+  for (size_t i = 0; i < n; ++i) {
+    const double gi = x[i] + (i > 0 ? x[i - 1] : 0.0) + (i + 1 < n ? x[i + 1] : 0.0);
+    g_err = std::max(g_err, std::abs(g_n[i] - gi));
+    for (size_t j = 0; j < n; ++j) {
+      const double Hij = (i > j ? i - j : j - i) <= 1 ? 1.0 : 0.0;
+      H_err = std::max(H_err, std::abs(H_n[i * n + j] - Hij));
+    }
+  }
+  if (rank == 0) {
+    using ms = std::chrono::duration<double, std::milli>;
+    std::cout << "N = " << n << ": gradient " << ms(t1 - t0).count()
+              << " [ms], max error " << g_err << "; Hessian "
+              << ms(t2 - t1).count() << " [ms], max error " << H_err
+              << std::endl;
+  }
+
   MPI_Finalize();
   return 0;
-}
\ No newline at end of file
+}
@@ -16,10 +16,18 @@ public:
     , data(a)
   {}
 
+  // deletes the following nodes one at a time: a recursive "delete next"
+  // would nest one call per node and overflow the stack on long lists
   ~Node()
   {
-    if (next)
-      delete next;
+    Node *t = next;
+    while (t)
+      {
+        Node *n = t->next;
+        t->next = nullptr;
+        delete t;
+        t = n;
+      }
   }
 
   // set/get interface
@@ -0,0 +1,236 @@
+// Throughput of append, find and erase on lists of integers: the Node
+// class of integer-list.hpp, std::list, std::vector, and the containers
+// of pool-list.hpp (intrusive_list linking the elements of a vector).
+//
+// - append: n values pushed at the back (Node::appendNew walks the whole
+//   list at every call: its n is capped to keep the run short);
+// - find: searches of values spread over the list (linear scans);
+// - erase: every other value erased during one traversal (for
+//   std::vector, with the erase-remove idiom: erasing one value at a time
+//   would be O(n) per erasure).
+//
+// Usage: ./list-benchmark [n (default: 1000000)]
+#include "integer-list.hpp"
+#include "pool-list.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+// Number of searches.
+constexpr int n_find = 200;
+
+// Maximum length of the Node list.
+constexpr int max_node = 20000;
+
+template <class F>
+double
+seconds(F &&f)
+{
+  const auto t0 = std::chrono::steady_clock::now();
+  f();
+  const auto t1 = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(t1 - t0).count();
+}
+
+void
+report(const std::string &name, int n, double t_append, double t_find,
+       double t_erase, long checksum)
+{
+  std::cout << std::setw(22) << std::left << name << std::right
+            << std::setw(9) << n << std::setw(12) << std::setprecision(3)
+            << n / t_append / 1e6 << std::setw(14)
+            << double(n_find) * n / t_find / 1e9 << std::setw(12)
+            << n / 2 / t_erase / 1e6 << std::setw(16) << checksum
+            << std::endl;
+}
+
+// The values searched: spread over [0, n), plus one that is missing.
+int
+target(int k, int n)
+{
+  return k + 1 < n_find ? int((long(k) * 7919) % n) : -1;
+}
+
+// std::list, pool_list and unrolled_list.
+template <class List>
+void
+benchmark(const std::string &name, int n)
+{
+  List l;
+  long checksum = 0;
+
+  const double t_append = seconds([&] {
+    for (int i = 0; i < n; ++i)
+      l.push_back(i);
+  });
+
+  const double t_find = seconds([&] {
+    for (int k = 0; k < n_find; ++k)
+      checksum += std::find(l.begin(), l.end(), target(k, n)) != l.end();
+  });
+
+  const double t_erase = seconds([&] {
+    for (auto it = l.begin(); it != l.end();)
+      {
+        it = l.erase(it);
+        if (it != l.end())
+          ++it;
+      }
+  });
+
+  for (int x : l)
+    checksum += x;
+  report(name, n, t_append, t_find, t_erase, checksum);
+}
+
+void
+benchmark_vector(int n)
+{
+  std::vector<int> v;
+  long             checksum = 0;
+
+  const double t_append = seconds([&] {
+    for (int i = 0; i < n; ++i)
+      v.push_back(i);
+  });
+
+  const double t_find = seconds([&] {
+    for (int k = 0; k < n_find; ++k)
+      checksum += std::find(v.begin(), v.end(), target(k, n)) != v.end();
+  });
+
+  const double t_erase = seconds([&] {
+    std::size_t i = 0;
+    v.erase(std::remove_if(v.begin(), v.end(),
+                           [&i](int) { return i++ % 2 == 0; }),
+            v.end());
+  });
+
+  for (int x : v)
+    checksum += x;
+  report("std::vector", n, t_append, t_find, t_erase, checksum);
+}
+
+// The values live in a vector allocated up front: appending only links
+// them, and erasing only unlinks them.
+struct item
+{
+  int             value;
+  list_hook<item> hook;
+};
+
+void
+benchmark_intrusive(int n)
+{
+  std::vector<item>    items(n);
+  intrusive_list<item> l;
+  long                 checksum = 0;
+
+  const double t_append = seconds([&] {
+    for (int i = 0; i < n; ++i)
+      {
+        items[i].value = i;
+        l.push_back(items[i]);
+      }
+  });
+
+  const double t_find = seconds([&] {
+    for (int k = 0; k < n_find; ++k)
+      {
+        const int x = target(k, n);
+        checksum += std::find_if(l.begin(), l.end(), [x](const item &e) {
+                      return e.value == x;
+                    }) != l.end();
+      }
+  });
+
+  const double t_erase = seconds([&] {
+    for (auto it = l.begin(); it != l.end();)
+      {
+        it = l.erase(it);
+        if (it != l.end())
+          ++it;
+      }
+  });
+
+  for (const item &e : l)
+    checksum += e.value;
+  report("intrusive_list", n, t_append, t_find, t_erase, checksum);
+}
+
+void
+benchmark_node(int n)
+{
+  n             = std::min(n, max_node);
+  Node *start   = new Node(0);
+  long checksum = 0;
+
+  const double t_append = seconds([&] {
+    for (int i = 1; i < n; ++i)
+      start->appendNew(i);
+  });
+
+  const double t_find = seconds([&] {
+    for (int k = 0; k < n_find; ++k)
+      checksum += start->find(target(k, n)) != NULL;
+  });
+
+  // Node::erase needs a previous and a next node: the first and the last
+  // ones are erased by hand.
+  const double t_erase = seconds([&] {
+    Node *t = start->getNext();
+    start->setNext(nullptr);
+    t->setPrevious(nullptr);
+    delete start;
+    start = t;
+    while (t && !t->isLast())
+      {
+        t = t->getNext();
+        if (t->isLast())
+          {
+            t->getPrevious()->setNext(nullptr);
+            delete t;
+            break;
+          }
+        Node *next = t->getNext();
+        t->erase();
+        t = next;
+      }
+  });
+
+  for (Node *t = start; t; t = t->getNext())
+    checksum += t->getData();
+  delete start;
+  report("Node (integer-list)", n, t_append, t_find, t_erase, checksum);
+}
+
+int
+main(int argc, char **argv)
+{
+  const int n = argc > 1 ? std::atoi(argv[1]) : 1000000;
+
+  std::cout << std::setw(22) << std::left << "container" << std::right
+            << std::setw(9) << "n" << std::setw(12) << "append" << std::setw(14)
+            << "find" << std::setw(12) << "erase" << std::setw(16) << "checksum"
+            << std::endl
+            << std::setw(22) << "" << std::setw(9) << "" << std::setw(12)
+            << "[M/s]" << std::setw(14) << "[G values/s]" << std::setw(12)
+            << "[M/s]" << std::endl;
+
+  benchmark_node(n);
+  benchmark<std::list<int>>("std::list", n);
+  benchmark_vector(n);
+  benchmark_intrusive(n);
+  benchmark<pool_list<int>>("pool_list", n);
+  benchmark<unrolled_list<int, 16>>("unrolled_list<16>", n);
+  benchmark<unrolled_list<int, 32>>("unrolled_list<32>", n);
+  benchmark<unrolled_list<int, 64>>("unrolled_list<64>", n);
+
+  return 0;
+}
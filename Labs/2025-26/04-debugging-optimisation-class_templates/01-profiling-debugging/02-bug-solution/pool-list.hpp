@@ -0,0 +1,1042 @@
+#ifndef HAVE_POOL_LIST_H
+#define HAVE_POOL_LIST_H
+
+// Linked lists that avoid the costs of the Node class of
+// integer-list.hpp:
+// - the list object stores the first and last node and the size, so
+//   push_back and size are O(1) instead of a walk of the whole list;
+// - the nodes are taken from a node_pool, which allocates them in slabs
+//   of many nodes and recycles the erased ones through a free list,
+//   instead of one new/delete per node: nodes allocated one after the
+//   other are contiguous in memory;
+// - the destructor walks the list in a loop, instead of the recursive
+//   "delete next" that overflows the stack for long lists;
+// - bidirectional iterators, so that the lists work with the STL
+//   algorithms and range-based for loops.
+//
+// intrusive_list<T> links objects through a list_hook member, without
+// any allocation; pool_list<T> stores one value per node, the nodes being
+// linked by an intrusive_list; unrolled_list<T, B> stores up to B values
+// per node (an "unrolled" linked list): scanning it reads contiguous
+// arrays, with a pointer chase every B values instead of every value, and
+// the two pointers are shared by B values. All of them provide iterators
+// and const_iterators.
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Storage for objects of type N, allocated in slabs of geometrically
+// growing size (up to max_slab objects). allocate() returns raw
+// storage: constructing and destroying the objects is up to the
+// caller. All the storage is released by the destructor.
+template <class N>
+class node_pool
+{
+public:
+  static constexpr std::size_t first_slab = 16;
+  static constexpr std::size_t max_slab   = 4096;
+
+  node_pool() = default;
+
+  node_pool(const node_pool &) = delete;
+  node_pool &
+  operator=(const node_pool &) = delete;
+
+  ~node_pool()
+  {
+    for (auto &s : slabs)
+      ::operator delete(s.first, std::align_val_t(alignof(N)));
+  }
+
+  N *
+  allocate()
+  {
+    if (free_list)
+      {
+        slot *s   = free_list;
+        free_list = s->next;
+        return reinterpret_cast<N *>(s);
+      }
+    if (slabs.empty() || used == slabs.back().second)
+      {
+        const std::size_t n =
+          slabs.empty() ? first_slab :
+                          std::min(2 * slabs.back().second, max_slab);
+        slabs.emplace_back(::operator new(n * sizeof(slot),
+                                          std::align_val_t(alignof(N))),
+                           n);
+        used = 0;
+      }
+    return reinterpret_cast<N *>(static_cast<slot *>(slabs.back().first) +
+                                 used++);
+  }
+
+  void
+  deallocate(N *p)
+  {
+    slot *s   = reinterpret_cast<slot *>(p);
+    s->next   = free_list;
+    free_list = s;
+  }
+
+private:
+  // An object, or the link of the free list when it is not in use.
+  union slot
+  {
+    alignas(N) unsigned char object[sizeof(N)];
+    slot *next;
+  };
+
+  std::vector<std::pair<void *, std::size_t>> slabs;
+  std::size_t                                 used      = 0;
+  slot                                       *free_list = nullptr;
+};
+
+// Links of an element of an intrusive_list: a class T becomes a list
+// element by having a list_hook<T> member.
+template <class T>
+struct list_hook
+{
+  T *next     = nullptr;
+  T *previous = nullptr;
+};
+
+// Doubly linked list of objects that it does not own: the links are the
+// member Hook of the objects themselves, so linking and unlinking never
+// allocate, and an object can be unlinked in O(1) without a search. An
+// object is in at most one list per hook at a time, and must stay alive
+// (and in place) while it is linked.
+template <class T, list_hook<T> T::*Hook = &T::hook>
+class intrusive_list
+{
+public:
+  template <bool Const>
+  class basic_iterator
+  {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type        = T;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = std::conditional_t<Const, const T *, T *>;
+    using reference         = std::conditional_t<Const, const T &, T &>;
+
+    basic_iterator() = default;
+
+    // iterator to const_iterator
+    template <bool C = Const, class = std::enable_if_t<C>>
+    basic_iterator(const basic_iterator<false> &other)
+      : x(other.x)
+      , list(other.list)
+    {}
+
+    reference
+    operator*() const
+    {
+      return *x;
+    }
+
+    pointer
+    operator->() const
+    {
+      return x;
+    }
+
+    basic_iterator &
+    operator++()
+    {
+      x = (x->*Hook).next;
+      return *this;
+    }
+
+    basic_iterator
+    operator++(int)
+    {
+      basic_iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    // from end(), goes to the last element
+    basic_iterator &
+    operator--()
+    {
+      x = x ? (x->*Hook).previous : list->tail;
+      return *this;
+    }
+
+    basic_iterator
+    operator--(int)
+    {
+      basic_iterator old = *this;
+      --*this;
+      return old;
+    }
+
+    friend bool
+    operator==(const basic_iterator &a, const basic_iterator &b)
+    {
+      return a.x == b.x;
+    }
+
+    friend bool
+    operator!=(const basic_iterator &a, const basic_iterator &b)
+    {
+      return a.x != b.x;
+    }
+
+  private:
+    friend class intrusive_list;
+    template <bool>
+    friend class basic_iterator;
+
+    basic_iterator(T *x, const intrusive_list *list)
+      : x(x)
+      , list(list)
+    {}
+
+    T                    *x    = nullptr;
+    const intrusive_list *list = nullptr;
+  };
+
+  using iterator       = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  intrusive_list() = default;
+
+  // the objects would be in two lists through the same hook
+  intrusive_list(const intrusive_list &) = delete;
+  intrusive_list &
+  operator=(const intrusive_list &) = delete;
+
+  ~intrusive_list()
+  {
+    clear();
+  }
+
+  std::size_t
+  size() const
+  {
+    return n_elements;
+  }
+
+  bool
+  empty() const
+  {
+    return n_elements == 0;
+  }
+
+  iterator
+  begin()
+  {
+    return iterator(head, this);
+  }
+
+  iterator
+  end()
+  {
+    return iterator(nullptr, this);
+  }
+
+  const_iterator
+  begin() const
+  {
+    return cbegin();
+  }
+
+  const_iterator
+  end() const
+  {
+    return cend();
+  }
+
+  const_iterator
+  cbegin() const
+  {
+    return const_iterator(head, this);
+  }
+
+  const_iterator
+  cend() const
+  {
+    return const_iterator(nullptr, this);
+  }
+
+  T &
+  front()
+  {
+    return *head;
+  }
+
+  const T &
+  front() const
+  {
+    return *head;
+  }
+
+  T &
+  back()
+  {
+    return *tail;
+  }
+
+  const T &
+  back() const
+  {
+    return *tail;
+  }
+
+  void
+  push_back(T &x)
+  {
+    insert(end(), x);
+  }
+
+  void
+  push_front(T &x)
+  {
+    insert(begin(), x);
+  }
+
+  // links x before pos, and returns its position
+  iterator
+  insert(const_iterator pos, T &x)
+  {
+    list_hook<T> &h = x.*Hook;
+    h.next          = pos.x;
+    h.previous      = pos.x ? (pos.x->*Hook).previous : tail;
+    (h.previous ? (h.previous->*Hook).next : head) = &x;
+    (h.next ? (h.next->*Hook).previous : tail)     = &x;
+    ++n_elements;
+    return iterator(&x, this);
+  }
+
+  // unlinks the object at pos (without destroying it), and returns the
+  // position of the next one
+  iterator
+  erase(const_iterator pos)
+  {
+    list_hook<T> &h                                = pos.x->*Hook;
+    T            *next                             = h.next;
+    (h.previous ? (h.previous->*Hook).next : head) = h.next;
+    (h.next ? (h.next->*Hook).previous : tail)     = h.previous;
+    h.next = h.previous = nullptr;
+    --n_elements;
+    return iterator(next, this);
+  }
+
+  // the position of x, which must be in this list
+  iterator
+  iterator_to(T &x)
+  {
+    return iterator(&x, this);
+  }
+
+  // unlinks all the objects, in a loop
+  void
+  clear()
+  {
+    for (T *x = head; x;)
+      {
+        list_hook<T> &h = x->*Hook;
+        x               = h.next;
+        h.next = h.previous = nullptr;
+      }
+    head = tail = nullptr;
+    n_elements  = 0;
+  }
+
+private:
+  T          *head       = nullptr;
+  T          *tail       = nullptr;
+  std::size_t n_elements = 0;
+};
+
+// Doubly linked list with one value per node: an intrusive_list of nodes
+// taken from a node_pool.
+template <class T>
+class pool_list
+{
+  struct node
+  {
+    list_hook<node> hook;
+    T               data;
+  };
+
+  using node_list = intrusive_list<node>;
+
+public:
+  template <bool Const>
+  class basic_iterator
+  {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type        = T;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = std::conditional_t<Const, const T *, T *>;
+    using reference         = std::conditional_t<Const, const T &, T &>;
+
+    basic_iterator() = default;
+
+    // iterator to const_iterator
+    template <bool C = Const, class = std::enable_if_t<C>>
+    basic_iterator(const basic_iterator<false> &other)
+      : it(other.it)
+    {}
+
+    reference
+    operator*() const
+    {
+      return it->data;
+    }
+
+    pointer
+    operator->() const
+    {
+      return &it->data;
+    }
+
+    basic_iterator &
+    operator++()
+    {
+      ++it;
+      return *this;
+    }
+
+    basic_iterator
+    operator++(int)
+    {
+      basic_iterator old = *this;
+      ++it;
+      return old;
+    }
+
+    // from end(), goes to the last node
+    basic_iterator &
+    operator--()
+    {
+      --it;
+      return *this;
+    }
+
+    basic_iterator
+    operator--(int)
+    {
+      basic_iterator old = *this;
+      --it;
+      return old;
+    }
+
+    friend bool
+    operator==(const basic_iterator &a, const basic_iterator &b)
+    {
+      return a.it == b.it;
+    }
+
+    friend bool
+    operator!=(const basic_iterator &a, const basic_iterator &b)
+    {
+      return a.it != b.it;
+    }
+
+  private:
+    friend class pool_list;
+    template <bool>
+    friend class basic_iterator;
+
+    explicit basic_iterator(
+      typename node_list::template basic_iterator<Const> it)
+      : it(it)
+    {}
+
+    typename node_list::template basic_iterator<Const> it;
+  };
+
+  using iterator       = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  pool_list() = default;
+
+  pool_list(const pool_list &other)
+  {
+    for (const T &x : other)
+      push_back(x);
+  }
+
+  pool_list &
+  operator=(const pool_list &) = delete;
+
+  ~pool_list()
+  {
+    clear();
+  }
+
+  std::size_t
+  size() const
+  {
+    return nodes.size();
+  }
+
+  bool
+  empty() const
+  {
+    return nodes.empty();
+  }
+
+  iterator
+  begin()
+  {
+    return iterator(nodes.begin());
+  }
+
+  iterator
+  end()
+  {
+    return iterator(nodes.end());
+  }
+
+  const_iterator
+  begin() const
+  {
+    return cbegin();
+  }
+
+  const_iterator
+  end() const
+  {
+    return cend();
+  }
+
+  const_iterator
+  cbegin() const
+  {
+    return const_iterator(nodes.cbegin());
+  }
+
+  const_iterator
+  cend() const
+  {
+    return const_iterator(nodes.cend());
+  }
+
+  T &
+  front()
+  {
+    return nodes.front().data;
+  }
+
+  const T &
+  front() const
+  {
+    return nodes.front().data;
+  }
+
+  T &
+  back()
+  {
+    return nodes.back().data;
+  }
+
+  const T &
+  back() const
+  {
+    return nodes.back().data;
+  }
+
+  void
+  push_back(const T &value)
+  {
+    insert(end(), value);
+  }
+
+  void
+  push_front(const T &value)
+  {
+    insert(begin(), value);
+  }
+
+  // inserts value before pos, and returns its position
+  iterator
+  insert(const_iterator pos, const T &value)
+  {
+    node *n = ::new (static_cast<void *>(pool.allocate())) node{{}, value};
+    return iterator(nodes.insert(pos.it, *n));
+  }
+
+  // removes the value at pos, and returns the position of the next one
+  iterator
+  erase(const_iterator pos)
+  {
+    node &n    = const_cast<node &>(*pos.it); // the list owns its nodes
+    auto  next = nodes.erase(pos.it);
+    n.~node();
+    pool.deallocate(&n);
+    return iterator(next);
+  }
+
+  // the first position holding value, or end()
+  iterator
+  find(const T &value)
+  {
+    return std::find(begin(), end(), value);
+  }
+
+  const_iterator
+  find(const T &value) const
+  {
+    return std::find(begin(), end(), value);
+  }
+
+  // iterative: no recursion, whatever the length of the list
+  void
+  clear()
+  {
+    for (auto it = nodes.begin(); it != nodes.end();)
+      {
+        node &n = *it;
+        it      = nodes.erase(it);
+        n.~node();
+        pool.deallocate(&n);
+      }
+  }
+
+private:
+  node_pool<node> pool;
+  node_list       nodes;
+};
+
+// Doubly linked list with up to B values per node, stored contiguously.
+// The values of a node are kept packed at the front of its array: an
+// insertion shifts the following values of the node (a full node is
+// split in two halves), an erasure shifts them back. A node left with
+// fewer than B / 2 values by an erasure is merged with a neighbour if
+// they fit in one node, and takes one value from it otherwise, so that
+// the nodes stay at least half full (except the last node filled by
+// push_back). Insertions and erasures invalidate the iterators to the
+// node(s) involved.
+template <class T, unsigned B = 32>
+class unrolled_list
+{
+  static_assert(B >= 2, "a node must hold at least two values");
+
+  struct node
+  {
+    node    *next;
+    node    *previous;
+    unsigned count;
+    alignas(T) unsigned char storage[B * sizeof(T)];
+
+    T *
+    data()
+    {
+      return std::launder(reinterpret_cast<T *>(storage));
+    }
+  };
+
+public:
+  template <bool Const>
+  class basic_iterator
+  {
+  public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type        = T;
+    using difference_type   = std::ptrdiff_t;
+    using pointer           = std::conditional_t<Const, const T *, T *>;
+    using reference         = std::conditional_t<Const, const T &, T &>;
+
+    basic_iterator() = default;
+
+    // iterator to const_iterator
+    template <bool C = Const, class = std::enable_if_t<C>>
+    basic_iterator(const basic_iterator<false> &other)
+      : n(other.n)
+      , i(other.i)
+      , list(other.list)
+    {}
+
+    reference
+    operator*() const
+    {
+      return n->data()[i];
+    }
+
+    pointer
+    operator->() const
+    {
+      return n->data() + i;
+    }
+
+    basic_iterator &
+    operator++()
+    {
+      if (++i == n->count)
+        {
+          n = n->next;
+          i = 0;
+        }
+      return *this;
+    }
+
+    basic_iterator
+    operator++(int)
+    {
+      basic_iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    // from end(), goes to the last value
+    basic_iterator &
+    operator--()
+    {
+      if (i > 0)
+        --i;
+      else
+        {
+          n = n ? n->previous : list->tail;
+          i = n->count - 1;
+        }
+      return *this;
+    }
+
+    basic_iterator
+    operator--(int)
+    {
+      basic_iterator old = *this;
+      --*this;
+      return old;
+    }
+
+    friend bool
+    operator==(const basic_iterator &a, const basic_iterator &b)
+    {
+      return a.n == b.n && a.i == b.i;
+    }
+
+    friend bool
+    operator!=(const basic_iterator &a, const basic_iterator &b)
+    {
+      return !(a == b);
+    }
+
+  private:
+    friend class unrolled_list;
+    template <bool>
+    friend class basic_iterator;
+
+    basic_iterator(node *n, unsigned i, const unrolled_list *list)
+      : n(n)
+      , i(i)
+      , list(list)
+    {}
+
+    node                *n    = nullptr;
+    unsigned             i    = 0;
+    const unrolled_list *list = nullptr;
+  };
+
+  using iterator       = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  unrolled_list() = default;
+
+  unrolled_list(const unrolled_list &other)
+  {
+    for (const T &x : other)
+      push_back(x);
+  }
+
+  unrolled_list &
+  operator=(const unrolled_list &) = delete;
+
+  ~unrolled_list()
+  {
+    clear();
+  }
+
+  std::size_t
+  size() const
+  {
+    return n_values;
+  }
+
+  bool
+  empty() const
+  {
+    return n_values == 0;
+  }
+
+  iterator
+  begin()
+  {
+    return iterator(head, 0, this);
+  }
+
+  iterator
+  end()
+  {
+    return iterator(nullptr, 0, this);
+  }
+
+  const_iterator
+  begin() const
+  {
+    return cbegin();
+  }
+
+  const_iterator
+  end() const
+  {
+    return cend();
+  }
+
+  const_iterator
+  cbegin() const
+  {
+    return const_iterator(head, 0, this);
+  }
+
+  const_iterator
+  cend() const
+  {
+    return const_iterator(nullptr, 0, this);
+  }
+
+  T &
+  front()
+  {
+    return head->data()[0];
+  }
+
+  const T &
+  front() const
+  {
+    return head->data()[0];
+  }
+
+  T &
+  back()
+  {
+    return tail->data()[tail->count - 1];
+  }
+
+  const T &
+  back() const
+  {
+    return tail->data()[tail->count - 1];
+  }
+
+  void
+  push_back(const T &value)
+  {
+    if (!tail || tail->count == B)
+      link_after(tail, new_node());
+    ::new (static_cast<void *>(tail->data() + tail->count)) T(value);
+    ++tail->count;
+    ++n_values;
+  }
+
+  // inserts value before pos, and returns its position
+  iterator
+  insert(const_iterator pos, const T &value)
+  {
+    if (!pos.n)
+      {
+        push_back(value);
+        return iterator(tail, tail->count - 1, this);
+      }
+
+    node    *n = pos.n;
+    unsigned i = pos.i;
+    if (n->count == B)
+      {
+        // move the second half to a new node
+        node *m = new_node();
+        link_after(n, m);
+        move_values(n, B / 2, B, m, 0);
+        m->count = B - B / 2;
+        n->count = B / 2;
+        if (i > n->count)
+          {
+            i -= n->count;
+            n = m;
+          }
+      }
+    shift(n, i, n->count, +1);
+    ::new (static_cast<void *>(n->data() + i)) T(value);
+    ++n->count;
+    ++n_values;
+    return iterator(n, i, this);
+  }
+
+  // removes the value at pos, and returns the position of the next one
+  iterator
+  erase(const_iterator pos)
+  {
+    node    *n = pos.n;
+    unsigned i = pos.i;
+    n->data()[i].~T();
+    shift(n, i + 1, n->count, -1);
+    --n->count;
+    --n_values;
+
+    if (n->count >= B / 2)
+      return i < n->count ? iterator(n, i, this) : iterator(n->next, 0, this);
+
+    // underfull: merge with or borrow from the next node, if any
+    if (node *m = n->next)
+      {
+        if (n->count + m->count <= B)
+          {
+            move_values(m, 0, m->count, n, n->count);
+            n->count += m->count;
+            m->count = 0;
+            unlink(m);
+          }
+        else
+          {
+            move_values(m, 0, 1, n, n->count);
+            shift(m, 1, m->count, -1);
+            ++n->count;
+            --m->count;
+          }
+        // the value after the erased one is now at i in n
+        return iterator(n, i, this);
+      }
+
+    // otherwise with the previous node: the erased value was in the last
+    // node, and the next value (if any) is still in n
+    if (node *m = n->previous)
+      {
+        if (n->count + m->count <= B)
+          {
+            const unsigned offset = m->count;
+            move_values(n, 0, n->count, m, offset);
+            m->count += n->count;
+            const bool at_end = i == n->count;
+            unlink(n);
+            return at_end ? end() : iterator(m, offset + i, this);
+          }
+        shift(n, 0, n->count, +1);
+        move_values(m, m->count - 1, m->count, n, 0);
+        ++n->count;
+        --m->count;
+        return i + 1 < n->count ? iterator(n, i + 1, this) : end();
+      }
+
+    // the only node
+    if (n->count == 0)
+      {
+        unlink(n);
+        return end();
+      }
+    return i < n->count ? iterator(n, i, this) : end();
+  }
+
+  // the first position holding value, or end()
+  iterator
+  find(const T &value)
+  {
+    const const_iterator it = std::as_const(*this).find(value);
+    return iterator(it.n, it.i, this);
+  }
+
+  const_iterator
+  find(const T &value) const
+  {
+    for (node *n = head; n; n = n->next)
+      {
+        const T *d = n->data();
+        for (unsigned i = 0; i < n->count; ++i)
+          if (d[i] == value)
+            return const_iterator(n, i, this);
+      }
+    return end();
+  }
+
+  // iterative: no recursion, whatever the length of the list
+  void
+  clear()
+  {
+    for (node *n = head; n;)
+      {
+        node *next = n->next;
+        for (unsigned i = 0; i < n->count; ++i)
+          n->data()[i].~T();
+        pool.deallocate(n);
+        n = next;
+      }
+    head = tail = nullptr;
+    n_values    = 0;
+  }
+
+private:
+  node *
+  new_node()
+  {
+    node *n  = ::new (static_cast<void *>(pool.allocate())) node;
+    n->count = 0;
+    return n;
+  }
+
+  // links m after n (at the front if n is null)
+  void
+  link_after(node *n, node *m)
+  {
+    m->previous                          = n;
+    m->next                              = n ? n->next : head;
+    (m->next ? m->next->previous : tail) = m;
+    (n ? n->next : head)                 = m;
+  }
+
+  void
+  unlink(node *n)
+  {
+    (n->previous ? n->previous->next : head) = n->next;
+    (n->next ? n->next->previous : tail)     = n->previous;
+    pool.deallocate(n);
+  }
+
+  // moves the values [first, last) of n to m, from position to
+  void
+  move_values(node *n, unsigned first, unsigned last, node *m, unsigned to)
+  {
+    for (unsigned i = first; i < last; ++i, ++to)
+      {
+        ::new (static_cast<void *>(m->data() + to)) T(std::move(n->data()[i]));
+        n->data()[i].~T();
+      }
+  }
+
+  // moves the values [first, last) of n by one position, forwards
+  // (+1) or backwards (-1), into the free slot at last or first - 1
+  void
+  shift(node *n, unsigned first, unsigned last, int direction)
+  {
+    T *d = n->data();
+    if (direction > 0)
+      for (unsigned i = last; i > first; --i)
+        {
+          ::new (static_cast<void *>(d + i)) T(std::move(d[i - 1]));
+          d[i - 1].~T();
+        }
+    else
+      for (unsigned i = first; i < last; ++i)
+        {
+          ::new (static_cast<void *>(d + i - 1)) T(std::move(d[i]));
+          d[i].~T();
+        }
+  }
+
+  node_pool<node> pool;
+  node           *head     = nullptr;
+  node           *tail     = nullptr;
+  std::size_t     n_values = 0;
+};
+
+#endif
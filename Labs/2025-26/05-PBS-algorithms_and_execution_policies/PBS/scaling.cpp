@@ -0,0 +1,416 @@
+// Driver for scaling studies: runs a solver over a matrix of (ranks x threads x problem size),
+// locally with mpirun or as a PBS job array, and turns the timings into strong and weak
+// scaling tables and efficiency plots.
+//
+// Every solver prints one timing record on rank 0, on a line of its own:
+//   TIMING app=<name> ranks=<P> threads=<T> size=<N> seconds=<wall-clock time>
+// (further key=value pairs are allowed and ignored). 'size' is the global problem size, e.g.
+// the number of unknowns: the report makes a strong scaling series of the runs with the same
+// size and a weak scaling series of the runs with the same size per core, whatever the
+// arguments of the solver. The records are collected from any text file, so the output of a
+// job can be used as is. The solvers that print them: 07-mpi-openmp/02-mpi (06-pi, 07 and 09
+// matrix-vector products), 08-mpi-stl/solution.cpp (heat) and 2022-23/lab05/ex03 (primes).
+//
+//   g++ -std=c++20 -O2 -Wall -o scaling scaling.cpp
+//
+//   ./scaling run --ranks 1,2,4 --threads 1,2 --sizes 1e8 --log pi.log -- ../../07-mpi-openmp/02-mpi/06-pi {size}
+//   ./scaling pbs --name heat --ranks 1,2,4,8 --threads 1,2 --sizes 4096 -- ./solution {size} {size} 100 --threads {threads}
+//   qsub jobs/heat.job
+//   ./scaling report --plot heat pi.log jobs/*.out
+//
+// In the command, {size}, {ranks} and {threads} are replaced by the values of each run. With
+// --weak, the sizes are per core: each run gets size * ranks * threads. The heat solver takes
+// the grid of each rank (nx x ny) rather than the global one, so a fixed size already makes a
+// weak scaling series over the ranks; its threads are set by --threads, not OMP_NUM_THREADS.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+struct record {
+  std::string app;
+  long ranks = 0, threads = 0;
+  double size = 0, seconds = 0;
+
+  long cores() const { return ranks * threads; }
+};
+
+/// Parse the TIMING record of 'line'; false if there is none or it misses a field. The record
+/// may start mid-line: mpirun forwards stdout and stderr separately, so the record of a solver
+/// that reports on both can be appended to an unfinished line of the other stream.
+bool parse(std::string const &line, record &r) {
+  const auto at = line.find("TIMING ");
+  if (at == std::string::npos) return false;
+  std::istringstream in(line.substr(at));
+  std::string token;
+  in >> token;
+  r = record();
+  while (in >> token) {
+    const auto eq = token.find('=');
+    if (eq == std::string::npos) continue;
+    const auto key = token.substr(0, eq), value = token.substr(eq + 1);
+    try {
+      if (key == "app") r.app = value;
+      else if (key == "ranks") r.ranks = std::stol(value);
+      else if (key == "threads") r.threads = std::stol(value);
+      else if (key == "size") r.size = std::stod(value);
+      else if (key == "seconds") r.seconds = std::stod(value);
+    } catch (std::exception const &) {
+      return false;
+    }
+  }
+  return !r.app.empty() && r.ranks > 0 && r.threads > 0 && r.seconds > 0;
+}
+
+/// Comma-separated list of numbers (e.g. 1e8 is accepted)
+std::vector<double> parse_list(std::string const &s) {
+  std::vector<double> v;
+  std::istringstream in(s);
+  std::string item;
+  while (std::getline(in, item, ','))
+    if (!item.empty()) v.push_back(std::stod(item));
+  return v;
+}
+
+std::string replace_all(std::string s, std::string const &from, std::string const &to) {
+  for (auto pos = s.find(from); pos != std::string::npos; pos = s.find(from, pos + to.size()))
+    s.replace(pos, from.size(), to);
+  return s;
+}
+
+std::string integer(double x) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(0) << x;
+  return out.str();
+}
+
+struct options {
+  std::string name, mpirun = "mpirun", log = "scaling.log", dir = "jobs", walltime = "00:30:00", select;
+  std::vector<double> ranks{1}, threads{1}, sizes;
+  bool weak = false;
+  int repeat = 1;
+  std::string command;
+};
+
+/// One run of the matrix
+struct run_case {
+  long ranks, threads;
+  double size;
+};
+
+std::vector<run_case> cases(options const &o) {
+  std::vector<run_case> v;
+  for (double s : o.sizes)
+    for (double r : o.ranks)
+      for (double t : o.threads)
+        v.push_back({static_cast<long>(r), static_cast<long>(t), o.weak ? s * r * t : s});
+  return v;
+}
+
+std::string command_of(options const &o, run_case const &c) {
+  auto cmd = replace_all(o.command, "{size}", integer(c.size));
+  cmd = replace_all(cmd, "{ranks}", std::to_string(c.ranks));
+  return replace_all(cmd, "{threads}", std::to_string(c.threads));
+}
+
+/// Run every case locally, appending the timing records to the log
+int run(options const &o) {
+  std::ofstream log(o.log, std::ios::app);
+  int failures = 0;
+  for (auto const &c : cases(o)) {
+    const auto cmd = "OMP_NUM_THREADS=" + std::to_string(c.threads) + " " + o.mpirun + " -n " +
+                     std::to_string(c.ranks) + " " + command_of(o, c) + " 2>&1";
+    for (int rep = 0; rep < o.repeat; ++rep) {
+      std::cerr << "[" << c.ranks << " x " << c.threads << ", size " << integer(c.size) << "] " << cmd << std::endl;
+      const auto start = std::chrono::steady_clock::now();
+      FILE *pipe = popen(cmd.c_str(), "r");
+      if (!pipe) {
+        std::cerr << "ERROR: cannot run " << cmd << std::endl;
+        return 1;
+      }
+      std::string output;
+      char buffer[4096];
+      while (std::fgets(buffer, sizeof(buffer), pipe)) output += buffer;
+      const int status = pclose(pipe);
+      const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+      int n_records = 0;
+      std::istringstream lines(output);
+      std::string line;
+      record r;
+      while (std::getline(lines, line))
+        if (parse(line, r)) {
+          log << line.substr(line.find("TIMING ")) << std::endl;
+          ++n_records;
+        }
+
+      if (status != 0) {
+        std::cerr << "WARNING: exit status " << status << ", output:" << std::endl << output;
+        ++failures;
+      } else if (n_records == 0) {
+        // No record: fall back to the time of the whole launch
+        std::cerr << "WARNING: no TIMING record, using the time of the launch (" << seconds << " s)" << std::endl;
+        log << "TIMING app=" << (o.name.empty() ? "unnamed" : o.name) << " ranks=" << c.ranks
+            << " threads=" << c.threads << " size=" << integer(c.size) << " seconds=" << seconds
+            << " source=driver" << std::endl;
+      }
+    }
+  }
+  return failures > 0;
+}
+
+/// Write a PBS job array with one sub-job per case (and repetition)
+int pbs(options const &o) {
+  if (o.name.empty()) {
+    std::cerr << "ERROR: pbs needs --name" << std::endl;
+    return 1;
+  }
+  std::vector<run_case> all;
+  for (auto const &c : cases(o))
+    for (int rep = 0; rep < o.repeat; ++rep) all.push_back(c);
+
+  long max_ranks = 0, max_cores = 0;
+  for (auto const &c : all) {
+    max_ranks = std::max(max_ranks, c.ranks);
+    max_cores = std::max(max_cores, c.ranks * c.threads);
+  }
+
+  std::filesystem::create_directories(o.dir);
+  const auto path = std::filesystem::path(o.dir) / (o.name + ".job");
+  std::ofstream job(path);
+  job << "#!/bin/bash\n";
+  // A PBS array needs at least two sub-jobs
+  if (all.size() > 1) job << "#PBS -J 0-" << all.size() - 1 << "\n";
+  job << "#PBS -l select="
+      << (o.select.empty() ? "1:ncpus=" + std::to_string(max_cores) + ":mpiprocs=" + std::to_string(max_ranks)
+                           : o.select)
+      << "\n#PBS -l walltime=" << o.walltime << "\n#PBS -N scaling_" << o.name << "\n#PBS -j oe\n\n";
+  job << "# Generated by scaling.cpp: one sub-job per (ranks, threads, size)\n";
+  job << "cd $PBS_O_WORKDIR\n";
+  job << "i=${PBS_ARRAY_INDEX:-0}\n";
+  job << "case $i in\n";
+  for (std::size_t i = 0; i < all.size(); ++i)
+    job << "  " << i << ") ranks=" << all[i].ranks << " threads=" << all[i].threads << " cmd=\""
+        << replace_all(command_of(o, all[i]), "\"", "\\\"") << "\" ;;\n";
+  job << "esac\n\n";
+  job << "export OMP_NUM_THREADS=$threads\n";
+  job << o.mpirun << " -n $ranks $cmd > " << (std::filesystem::path(o.dir) / o.name).string() << ".$i.out 2>&1\n";
+
+  std::cerr << "Wrote " << path.string() << " (" << all.size() << " runs): submit with qsub " << path.string()
+            << ", then run: scaling report " << (std::filesystem::path(o.dir) / o.name).string() << ".*.out"
+            << std::endl;
+  return 0;
+}
+
+double median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  const auto n = v.size();
+  return n % 2 ? v[n / 2] : .5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+/// Median time of the records of each (app, size, ranks, threads)
+using record_key = std::tuple<std::string, double, long, long>;
+
+struct row {
+  long ranks, threads;
+  double size, seconds;
+  std::size_t samples;
+};
+
+/// Print a scaling table of 'rows' (sorted by cores), relative to the first one. For strong
+/// scaling, the efficiency is T_1 c_1 / (T c), for weak scaling T_1 / T.
+void table(std::ostream &out, std::vector<row> const &rows, bool weak, std::ofstream *dat) {
+  const auto &base = rows.front();
+  const double base_cores = base.ranks * base.threads;
+  out << std::setw(6) << "ranks" << std::setw(8) << "threads" << std::setw(7) << "cores" << std::setw(14) << "size"
+      << std::setw(12) << "time [s]" << std::setw(9) << "samples" << std::setw(10) << "speedup" << std::setw(12)
+      << "efficiency" << "\n";
+  for (auto const &r : rows) {
+    const double cores = r.ranks * r.threads;
+    const double speedup = weak ? base.seconds / r.seconds * cores / base_cores : base.seconds / r.seconds;
+    const double efficiency = weak ? base.seconds / r.seconds : speedup * base_cores / cores;
+    out << std::setw(6) << r.ranks << std::setw(8) << r.threads << std::setw(7) << cores << std::setw(14)
+        << integer(r.size) << std::setw(12) << std::setprecision(4) << r.seconds << std::setw(9) << r.samples
+        << std::setw(10) << std::setprecision(3) << speedup << std::setw(12) << efficiency << "\n";
+    if (dat) *dat << cores << " " << r.ranks << " " << r.threads << " " << r.seconds << " " << speedup << " " << efficiency << "\n";
+  }
+  out << "\n";
+}
+
+/// Strong scaling tables (one per app and size) and weak scaling tables (one per app and size
+/// per core), from the records in 'files'; with a plot prefix, also gnuplot data and script.
+int report(std::vector<std::string> const &files, std::string const &plot) {
+  std::map<record_key, std::vector<double>> times;
+  for (auto const &file : files) {
+    std::ifstream in(file);
+    if (!in) {
+      std::cerr << "WARNING: cannot read " << file << std::endl;
+      continue;
+    }
+    std::string line;
+    record r;
+    while (std::getline(in, line))
+      if (parse(line, r)) times[{r.app, r.size, r.ranks, r.threads}].push_back(r.seconds);
+  }
+  if (times.empty()) {
+    std::cerr << "ERROR: no TIMING records found" << std::endl;
+    return 1;
+  }
+
+  // Rows of each table: by (app, size) and by (app, size per core)
+  std::map<std::pair<std::string, double>, std::vector<row>> strong, weak;
+  for (auto const &[k, t] : times) {
+    const auto &[app, size, ranks, threads] = k;
+    const row r{ranks, threads, size, median(t), t.size()};
+    strong[{app, size}].push_back(r);
+    if (size > 0) weak[{app, size / (ranks * threads)}].push_back(r); // Sizeless runs: strong only
+  }
+
+  auto by_cores = [](row const &a, row const &b) {
+    return std::make_pair(a.ranks * a.threads, a.ranks) < std::make_pair(b.ranks * b.threads, b.ranks);
+  };
+  auto distinct_cores = [](std::vector<row> const &rows) {
+    for (auto const &r : rows)
+      if (r.ranks * r.threads != rows.front().ranks * rows.front().threads) return true;
+    return false;
+  };
+
+  std::ofstream gp;
+  if (!plot.empty()) {
+    gp.open(plot + ".gp");
+    gp << "# gnuplot " << plot << ".gp: parallel efficiency against the number of cores\n"
+       << "set terminal pngcairo size 800,600\nset logscale x 2\nset xlabel 'cores'\nset ylabel 'efficiency'\n"
+       << "set yrange [0:1.2]\nset key outside\nset grid\n";
+  }
+
+  for (auto *tables : {&strong, &weak}) {
+    const bool is_weak = tables == &weak;
+    std::map<std::string, std::vector<std::pair<double, std::string>>> plotted; // app -> (size, dat file)
+    for (auto &[k, rows] : *tables) {
+      if (!distinct_cores(rows)) continue;
+      std::sort(rows.begin(), rows.end(), by_cores);
+      const auto &[app, size] = k;
+      std::cout << (is_weak ? "Weak" : "Strong") << " scaling of " << app << ", size "
+                << (is_weak ? integer(size) + " per core" : integer(size)) << ":\n";
+
+      std::ofstream dat;
+      if (!plot.empty()) {
+        const auto name = plot + "_" + app + (is_weak ? "_weak_" : "_strong_") + integer(size) + ".dat";
+        dat.open(name);
+        dat << "# cores ranks threads time speedup efficiency\n";
+        plotted[app].emplace_back(size, name);
+      }
+      table(std::cout, rows, is_weak, plot.empty() ? nullptr : &dat);
+    }
+
+    for (auto const &[app, dats] : plotted) {
+      gp << "\nset output '" << plot << "_" << app << (is_weak ? "_weak" : "_strong") << ".png'\n"
+         << "set title '" << (is_weak ? "Weak" : "Strong") << " scaling of " << app << "'\nplot ";
+      for (std::size_t i = 0; i < dats.size(); ++i)
+        gp << (i ? ", \\\n     " : "") << "'" << dats[i].second << "' using 1:6 with linespoints title 'size "
+           << integer(dats[i].first) << (is_weak ? " per core" : "") << "'";
+      gp << "\n";
+    }
+  }
+
+  if (!plot.empty()) std::cerr << "Plot with: gnuplot " << plot << ".gp" << std::endl;
+  return 0;
+}
+
+void usage(const char *argv0) {
+  std::cerr << "Usage:\n"
+            << "  " << argv0 << " run|pbs [options] -- <command with {size}, {ranks}, {threads}>\n"
+            << "  " << argv0 << " report [--plot <prefix>] <files with TIMING records>...\n"
+            << "Options:\n"
+            << "  --name <app>          name of the study (pbs: job name; run: records of binaries without one)\n"
+            << "  --ranks <list>        MPI processes, e.g. 1,2,4 (default 1)\n"
+            << "  --threads <list>      OpenMP threads per process (default 1)\n"
+            << "  --sizes <list>        problem sizes, e.g. 1e7,1e8\n"
+            << "  --weak                sizes are per core (weak scaling)\n"
+            << "  --repeat <n>          runs per case (default 1; the report takes the median)\n"
+            << "  --mpirun <launcher>   default 'mpirun', e.g. 'mpirun --oversubscribe'\n"
+            << "  --log <file>          run: file the records are appended to (default scaling.log)\n"
+            << "  --dir <dir>           pbs: directory of the job script and of its outputs (default jobs)\n"
+            << "  --walltime <hh:mm:ss> pbs: walltime of each sub-job (default 00:30:00)\n"
+            << "  --select <resources>  pbs: resources of each sub-job (default: one node, the largest case)\n";
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+  const std::string mode = argv[1];
+
+  if (mode == "report") {
+    std::string plot;
+    std::vector<std::string> files;
+    for (int i = 2; i < argc; ++i) {
+      const std::string arg = argv[i];
+      if (arg == "--plot" && i + 1 < argc) plot = argv[++i];
+      else files.push_back(arg);
+    }
+    if (files.empty()) {
+      usage(argv[0]);
+      return 1;
+    }
+    return report(files, plot);
+  }
+
+  if (mode != "run" && mode != "pbs") {
+    usage(argv[0]);
+    return 1;
+  }
+
+  options o;
+  int i = 2;
+  try {
+    for (; i < argc; ++i) {
+      const std::string arg = argv[i];
+      auto value = [&]() -> std::string {
+        if (i + 1 >= argc) throw std::invalid_argument(arg + " needs a value");
+        return argv[++i];
+      };
+      if (arg == "--") {
+        ++i;
+        break;
+      } else if (arg == "--name") o.name = value();
+      else if (arg == "--ranks") o.ranks = parse_list(value());
+      else if (arg == "--threads") o.threads = parse_list(value());
+      else if (arg == "--sizes") o.sizes = parse_list(value());
+      else if (arg == "--weak") o.weak = true;
+      else if (arg == "--repeat") o.repeat = std::max(1, std::stoi(value()));
+      else if (arg == "--mpirun") o.mpirun = value();
+      else if (arg == "--log") o.log = value();
+      else if (arg == "--dir") o.dir = value();
+      else if (arg == "--walltime") o.walltime = value();
+      else if (arg == "--select") o.select = value();
+      else throw std::invalid_argument("unknown option " + arg);
+    }
+  } catch (std::exception const &e) {
+    std::cerr << "ERROR: " << e.what() << std::endl;
+    usage(argv[0]);
+    return 1;
+  }
+
+  for (; i < argc; ++i) o.command += (o.command.empty() ? "" : " ") + std::string(argv[i]);
+  if (o.command.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+  // A command without {size} runs once per (ranks, threads)
+  if (o.sizes.empty()) o.sizes = {0};
+
+  return mode == "run" ? run(o) : pbs(o);
+}
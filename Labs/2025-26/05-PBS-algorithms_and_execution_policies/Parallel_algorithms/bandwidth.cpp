@@ -27,28 +27,26 @@
 #include <limits>
 #include <string>
 #include <vector>
-#include <algorithm>
-#include <ranges>
-#include <execution>
+
+#include "execution_backend.hpp"
 
 using real_t = float;
 
-/// Intialize vectors `x` and `y`: raw loop sequential version
-void initialize(std::vector<real_t> &x, std::vector<real_t> &y) {
+/// Intialize vectors `x` and `y` with the execution backend `p`
+void initialize(exec::policy const &p, std::vector<real_t> &x, std::vector<real_t> &y) {
   assert(x.size() == y.size());
-  //Parallelize initialization of `x`. Notice that `x.data()` is captured by value.
-  auto ints = std::views::iota(0);
-  std::for_each_n(std::execution::par_unseq, ints.begin(), x.size(), [x = x.data()](int i) { x[i] = (real_t)i; });
-  //Parallelize initialization of `y`
-  std::fill_n(std::execution::par_unseq, y.begin(), y.size(), 2.);
+  //Parallelize initialization of `x` and `y`. Notice that the pointers are captured by value.
+  exec::for_each_index(p, x.size(), [x = x.data(), y = y.data()](std::size_t i) {
+    x[i] = (real_t)i;
+    y[i] = 2.;
+  });
 }
 
 /// DAXPY: AX + Y
-void daxpy(real_t a, std::vector<real_t> const &x, std::vector<real_t> &y) {
+void daxpy(exec::policy const &p, real_t a, std::vector<real_t> const &x, std::vector<real_t> &y) {
   assert(x.size() == y.size());
   ///Parallelize DAXPY computation. Notice that `a` is captured by value.
-  std::transform(std::execution::par_unseq, x.begin(), x.end(), y.begin(), y.begin(),
-                 [a](real_t x, real_t y) { return a * x + y; });
+  exec::for_each_index(p, x.size(), [a, x = x.data(), y = y.data()](std::size_t i) { y[i] = a * x[i] + y[i]; });
 }
 
 // Check solution
@@ -64,13 +62,17 @@ int main(int argc, char *argv[]) {
   // Read length of vector elements
   long long n = std::stoll(argv[1]);
 
+  // Backend from EXEC_BACKEND / EXEC_NUM_THREADS (see execution_backend.hpp)
+  const auto p = exec::default_policy();
+  exec::report(p);
+
   // Allocate the vector
   std::vector<real_t> x(n, 0.), y(n, 0.);
   real_t a = 2.0;
 
-  initialize(x, y);
+  initialize(p, x, y);
 
-  daxpy(a, x, y);
+  daxpy(p, a, x, y);
 
   if (!check(a, y)) {
     std::cerr << "ERROR!" << std::endl;
@@ -81,11 +83,11 @@ int main(int argc, char *argv[]) {
 
   // Measure bandwidth in [GB/s]
   using clk_t = std::chrono::steady_clock;
-  daxpy(a, x, y);
+  daxpy(p, a, x, y);
   auto start = clk_t::now();
   int nit = 100;
   for (int it = 0; it < nit; ++it) {
-    daxpy(a, x, y);
+    daxpy(p, a, x, y);
   }
   auto seconds = std::chrono::duration<real_t>(clk_t::now() - start).count(); // Duration in [s]
   // Amount of bytes transferred from/to chip.
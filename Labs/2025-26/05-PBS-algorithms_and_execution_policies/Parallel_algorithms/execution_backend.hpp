@@ -0,0 +1,302 @@
+#ifndef EXECUTION_BACKEND_HPP
+#define EXECUTION_BACKEND_HPP
+
+// Execution backends for kernels over an index space [0, n).
+//
+// With g++ and clang++, std::execution::par_unseq runs in parallel only if the standard
+// library finds TBB (and the program is linked with -ltbb): otherwise the "parallel" code
+// silently runs serially. Here the backend is chosen explicitly:
+//   seq      serial loop
+//   std      std::for_each / std::transform_reduce with std::execution::par_unseq
+//            (whatever the toolchain provides, e.g. nvc++ -stdpar=gpu)
+//   tbb      tbb::parallel_for / tbb::parallel_reduce, if compiled with -DEXEC_TBB -ltbb
+//   openmp   parallel for, if compiled with -fopenmp
+//   threads  persistent pool of std::threads, static partition
+// The default is set at build time with -DEXEC_DEFAULT_BACKEND=<name> (otherwise: std under
+// nvc++ -stdpar, then tbb, openmp, threads, whichever is compiled in) and can be overridden
+// at run time with the environment variables EXEC_BACKEND and EXEC_NUM_THREADS.
+// check() measures the parallelism actually obtained: call report() at startup.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <execution>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "thread_team.hpp"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef EXEC_TBB
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/task_arena.h>
+#endif
+
+#define EXEC_STRINGIFY_(x) #x
+#define EXEC_STRINGIFY(x) EXEC_STRINGIFY_(x)
+
+namespace exec {
+
+enum class backend { seq, std_par, tbb, openmp, threads };
+
+inline const char *name(backend b) {
+  switch (b) {
+  case backend::seq: return "seq";
+  case backend::std_par: return "std";
+  case backend::tbb: return "tbb";
+  case backend::openmp: return "openmp";
+  default: return "threads";
+  }
+}
+
+inline std::optional<backend> parse(std::string_view s) {
+  for (auto b : {backend::seq, backend::std_par, backend::tbb, backend::openmp, backend::threads})
+    if (s == name(b)) return b;
+  return std::nullopt;
+}
+
+/// Whether backend 'b' was compiled in
+constexpr bool available(backend b) {
+  switch (b) {
+  case backend::tbb:
+#ifdef EXEC_TBB
+    return true;
+#else
+    return false;
+#endif
+  case backend::openmp:
+#ifdef _OPENMP
+    return true;
+#else
+    return false;
+#endif
+  default:
+    return true;
+  }
+}
+
+/// Persistent team of worker threads: 'run' executes f(tid, nthreads) on every worker
+/// and returns when all of them are done (the team shared with the other labs)
+using thread_pool = threads::team;
+
+/// Object shared by all the calls with the same number of threads (a pool, an arena),
+/// created on first use
+template <class T> T &shared_instance(int nthreads) {
+  static std::mutex mutex;
+  static std::map<int, std::unique_ptr<T>> instances;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto &p = instances[nthreads];
+  if (!p) p = std::make_unique<T>(nthreads);
+  return *p;
+}
+
+inline int hardware_threads() {
+  return static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+struct policy {
+  backend kind;
+  int threads = 0; ///< 0: default of the backend (not settable for seq and std)
+
+  /// Number of threads the backend is asked to use
+  int requested_threads() const {
+    switch (kind) {
+    case backend::seq: return 1;
+#ifdef _OPENMP
+    case backend::openmp: return threads > 0 ? threads : omp_get_max_threads();
+#endif
+#ifdef EXEC_TBB
+    case backend::tbb: return threads > 0 ? threads : tbb::this_task_arena::max_concurrency();
+#endif
+    default: return threads > 0 ? threads : hardware_threads();
+    }
+  }
+};
+
+constexpr backend build_default() {
+#if defined(EXEC_DEFAULT_BACKEND)
+  // E.g. -DEXEC_DEFAULT_BACKEND=openmp
+  constexpr std::string_view s = EXEC_STRINGIFY(EXEC_DEFAULT_BACKEND);
+  for (auto b : {backend::seq, backend::std_par, backend::tbb, backend::openmp, backend::threads})
+    if (s == name(b)) return b;
+  return backend::threads;
+#elif defined(_NVHPC_STDPAR_GPU) || defined(_NVHPC_STDPAR_MULTICORE)
+  return backend::std_par;
+#elif defined(EXEC_TBB)
+  return backend::tbb;
+#elif defined(_OPENMP)
+  return backend::openmp;
+#else
+  return backend::threads;
+#endif
+}
+
+/// Policy from EXEC_BACKEND and EXEC_NUM_THREADS, falling back to the build default for a
+/// backend that is unknown or not compiled in
+inline policy default_policy() {
+  policy p{build_default()};
+  if (const char *env = std::getenv("EXEC_BACKEND")) {
+    auto b = parse(env);
+    if (b && available(*b))
+      p.kind = *b;
+    else
+      std::cerr << "WARNING: EXEC_BACKEND=" << env << " is not available, using " << name(p.kind) << std::endl;
+  }
+  if (const char *env = std::getenv("EXEC_NUM_THREADS")) p.threads = std::max(0, std::atoi(env));
+  return p;
+}
+
+/// f(i) for i in [0, n)
+template <class F> void for_each_index(policy const &p, std::size_t n, F f) {
+  switch (p.kind) {
+  case backend::std_par: {
+    auto ints = std::views::iota(std::size_t(0), n);
+    std::for_each(std::execution::par_unseq, ints.begin(), ints.end(), f);
+    return;
+  }
+#ifdef EXEC_TBB
+  case backend::tbb: {
+    auto body = [&f](tbb::blocked_range<std::size_t> const &r) {
+      for (std::size_t i = r.begin(); i != r.end(); ++i) f(i);
+    };
+    if (p.threads > 0)
+      shared_instance<tbb::task_arena>(p.threads).execute(
+        [&]() { tbb::parallel_for(tbb::blocked_range<std::size_t>(0, n), body); });
+    else
+      tbb::parallel_for(tbb::blocked_range<std::size_t>(0, n), body);
+    return;
+  }
+#endif
+#ifdef _OPENMP
+  case backend::openmp: {
+    const int nthreads = p.requested_threads();
+#pragma omp parallel for simd schedule(static) num_threads(nthreads)
+    for (std::size_t i = 0; i < n; ++i) f(i);
+    return;
+  }
+#endif
+  case backend::threads:
+    shared_instance<thread_pool>(p.requested_threads()).run([n, &f](int tid, int nthreads) {
+      const std::size_t begin = n * tid / nthreads, end = n * (tid + 1) / nthreads;
+      for (std::size_t i = begin; i < end; ++i) f(i);
+    });
+    return;
+  default:
+    for (std::size_t i = 0; i < n; ++i) f(i);
+  }
+}
+
+/// init + sum of f(i) for i in [0, n); the order of the sum depends on the backend
+template <class T, class F> T reduce_index(policy const &p, std::size_t n, T init, F f) {
+  switch (p.kind) {
+  case backend::std_par: {
+    auto ints = std::views::iota(std::size_t(0), n);
+    return std::transform_reduce(std::execution::par_unseq, ints.begin(), ints.end(), init, std::plus<>(), f);
+  }
+#ifdef EXEC_TBB
+  case backend::tbb: {
+    auto reduce = [&]() {
+      return tbb::parallel_reduce(
+        tbb::blocked_range<std::size_t>(0, n), init,
+        [&f](tbb::blocked_range<std::size_t> const &r, T sum) {
+          for (std::size_t i = r.begin(); i != r.end(); ++i) sum += f(i);
+          return sum;
+        },
+        std::plus<>());
+    };
+    // The identity of parallel_reduce seeds every chunk: add init once, at the end
+    const T offset = init;
+    init = T{};
+    return offset + (p.threads > 0 ? shared_instance<tbb::task_arena>(p.threads).execute(reduce) : reduce());
+  }
+#endif
+#ifdef _OPENMP
+  case backend::openmp: {
+    const int nthreads = p.requested_threads();
+    T sum = init;
+#pragma omp parallel for simd schedule(static) num_threads(nthreads) reduction(+ : sum)
+    for (std::size_t i = 0; i < n; ++i) sum += f(i);
+    return sum;
+  }
+#endif
+  case backend::threads: {
+    auto &pool = shared_instance<thread_pool>(p.requested_threads());
+    constexpr int pad = 64 / sizeof(T) > 0 ? 64 / sizeof(T) : 1; // One cache line per partial sum
+    std::vector<T> partial(pool.size() * pad, T{});
+    pool.run([n, &f, &partial](int tid, int nthreads) {
+      const std::size_t begin = n * tid / nthreads, end = n * (tid + 1) / nthreads;
+      T sum{};
+      for (std::size_t i = begin; i < end; ++i) sum += f(i);
+      partial[tid * pad] = sum;
+    });
+    for (int tid = 0; tid < pool.size(); ++tid) init += partial[tid * pad];
+    return init;
+  }
+  default:
+    for (std::size_t i = 0; i < n; ++i) init += f(i);
+    return init;
+  }
+}
+
+struct check_result {
+  int requested;      ///< Threads the backend was asked for
+  int observed;       ///< Distinct threads that ran some work
+  double parallelism; ///< Busy time of all the threads / elapsed time
+};
+
+/// Run 'tasks' tasks of 'busy' seconds of spinning each and measure how many threads ran
+/// them, and how much they overlapped
+inline check_result check(policy const &p, std::size_t tasks = 0, double busy = 20e-6) {
+  using clk_t = std::chrono::steady_clock;
+  const int requested = p.requested_threads();
+#ifdef _NVHPC_STDPAR_GPU
+  // The kernels of the std backend run on the GPU, where threads cannot be inspected
+  if (p.kind == backend::std_par) return {requested, 0, 0.};
+#endif
+  if (tasks == 0) tasks = 16 * static_cast<std::size_t>(requested);
+
+  std::vector<std::thread::id> ids(tasks);
+  std::vector<double> seconds(tasks);
+  auto start = clk_t::now();
+  for_each_index(p, tasks, [&](std::size_t i) {
+    auto t0 = clk_t::now();
+    while (std::chrono::duration<double>(clk_t::now() - t0).count() < busy)
+      ;
+    seconds[i] = std::chrono::duration<double>(clk_t::now() - t0).count();
+    ids[i] = std::this_thread::get_id();
+  });
+  const double elapsed = std::chrono::duration<double>(clk_t::now() - start).count();
+
+  double total = 0;
+  for (double s : seconds) total += s;
+  return {requested, static_cast<int>(std::set<std::thread::id>(ids.begin(), ids.end()).size()), total / elapsed};
+}
+
+/// Print the backend and the outcome of check(), warning if the parallel code runs serially
+inline void report(policy const &p, std::ostream &out = std::cerr) {
+  const auto c = check(p);
+  out << "Execution backend: " << name(p.kind) << ", " << c.requested << " thread(s) requested, " << c.observed
+      << " used, effective parallelism " << c.parallelism << std::endl;
+  if (p.kind != backend::seq && c.requested > 1 && c.observed == 1)
+    out << "WARNING: the " << name(p.kind) << " backend runs serially"
+        << (p.kind == backend::std_par ? " (is a parallel backend such as TBB linked?)" : "") << std::endl;
+}
+
+} // namespace exec
+
+#endif
@@ -0,0 +1,80 @@
+// Jacobi iterations of the 3-point stencil of -u'' = 1 on (0, 1), u(0) = u(1) = 0,
+// written against the execution backends of execution_backend.hpp:
+//
+//   g++ -std=c++20 -Wall -O3 -march=native -DNDEBUG -fopenmp -DEXEC_TBB -o stencil stencil.cpp -ltbb
+//   EXEC_BACKEND=threads EXEC_NUM_THREADS=4 ./stencil 10000000
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "execution_backend.hpp"
+
+using real_t = double;
+
+/// One Jacobi sweep: unew_i = (u_{i-1} + u_{i+1} + h^2) / 2 on the interior nodes;
+/// returns the squared norm of the update
+real_t sweep(exec::policy const &p, real_t h, std::vector<real_t> const &u, std::vector<real_t> &unew) {
+  return exec::reduce_index(p, u.size() - 2, real_t(0),
+                            [h, u = u.data() + 1, unew = unew.data() + 1](std::size_t i) {
+                              const real_t v = .5 * (u[i - 1] + u[i + 1] + h * h);
+                              const real_t d = v - u[i];
+                              unew[i] = v;
+                              return d * d;
+                            });
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    std::cerr << "ERROR: Missing length argument!" << std::endl;
+    return 1;
+  }
+
+  const long long n = std::stoll(argv[1]);
+  if (n < 3) {
+    std::cerr << "ERROR: at least 3 nodes are needed!" << std::endl;
+    return 1;
+  }
+
+  // Backend from EXEC_BACKEND / EXEC_NUM_THREADS (see execution_backend.hpp)
+  const auto p = exec::default_policy();
+  exec::report(p);
+
+  const real_t h = 1. / (n - 1);
+  std::vector<real_t> u(n, 0.), unew(n, 0.);
+
+  // Correctness: on 33 nodes, the iterations converge to the exact solution x (1 - x) / 2
+  // (the stencil is exact on quadratics)
+  {
+    const std::size_t m = 33;
+    const real_t hm = 1. / (m - 1);
+    std::vector<real_t> v(m, 0.), vnew(m, 0.);
+    for (int it = 0; it < 10000 && sweep(p, hm, v, vnew) > 1e-28; ++it) std::swap(v, vnew);
+    real_t error = 0;
+    for (std::size_t i = 0; i < m; ++i) error = std::max(error, std::abs(v[i] - .5 * i * hm * (1. - i * hm)));
+    if (error > 1e-10) {
+      std::cerr << "ERROR! max error " << error << std::endl;
+      return 1;
+    }
+    std::cerr << "OK!" << std::endl;
+  }
+
+  // Measure bandwidth in [GB/s]: u is read, unew is written
+  using clk_t = std::chrono::steady_clock;
+  sweep(p, h, u, unew);
+  const int nit = 100;
+  real_t update = 0;
+  auto start = clk_t::now();
+  for (int it = 0; it < nit; ++it) {
+    update = sweep(p, h, u, unew);
+    std::swap(u, unew);
+  }
+  const double seconds = std::chrono::duration<double>(clk_t::now() - start).count();
+  const double gigabytes = 2. * n * sizeof(real_t) * nit / 1.e9;
+  std::cerr << "Last update: " << std::sqrt(update) << std::endl;
+  std::cerr << "Bandwidth [GB/s]: " << (gigabytes / seconds) << std::endl;
+
+  return 0;
+}
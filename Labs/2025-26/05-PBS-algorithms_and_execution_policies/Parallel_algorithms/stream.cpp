@@ -0,0 +1,282 @@
+// STREAM-style memory bandwidth suite, extending bandwidth.cpp.
+//
+// Kernels (a, b, c arrays of n doubles, s a scalar):
+//   copy     c = a                        2 n doubles moved
+//   scale    b = s c                      2 n
+//   add      c = a + b                    3 n
+//   triad    a = b + s c                  3 n
+//   copy_nt  c = a, non-temporal stores   2 n (plain stores without SSE2)
+//   strided  sum of a[i * stride]         n / stride, plus the unused rest of each cache line
+//   gather   sum of a[idx[i]], idx a random permutation: n doubles + n 32-bit indices
+// For strided and gather, only the bytes actually used are counted: the ratio to copy shows
+// how much of the bandwidth is wasted by the access pattern.
+//
+// Each kernel runs with the execution policies seq, par, par_unseq (standard algorithms over
+// an index range), omp (parallel for simd) and threads (a persistent team of std::threads,
+// static partition), on working sets from --min to --max bytes (doubling), so that the sweep
+// goes through L1, L2, L3 and DRAM. Every measurement is preceded by untimed warm-up runs and
+// repeated --samples times; each sample repeats the kernel enough times to last ~1 ms. The
+// results are written as CSV (median, 10th and 90th percentiles and best of the samples):
+//
+//   g++ -std=c++20 -O3 -march=native -fopenmp -DNDEBUG -o stream stream.cpp -ltbb
+//   ./stream --min 16K --max 256M --samples 10 --csv stream.csv
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <execution>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <ranges>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <omp.h>
+
+#include "execution_backend.hpp"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using real_t = double;
+
+enum class policy { seq, par, par_unseq, omp, threads };
+
+const char *name(policy p) {
+  switch (p) {
+  case policy::seq: return "seq";
+  case policy::par: return "par";
+  case policy::par_unseq: return "par_unseq";
+  case policy::omp: return "omp";
+  default: return "threads";
+  }
+}
+
+/// Apply f(i) for i in [0, n) with policy 'p'
+template <class F> void for_each_index(policy p, exec::thread_pool &workers, std::size_t n, F f) {
+  auto ints = std::views::iota(std::size_t(0), n);
+  switch (p) {
+  case policy::seq:
+    std::for_each(std::execution::seq, ints.begin(), ints.end(), f);
+    break;
+  case policy::par:
+    std::for_each(std::execution::par, ints.begin(), ints.end(), f);
+    break;
+  case policy::par_unseq:
+    std::for_each(std::execution::par_unseq, ints.begin(), ints.end(), f);
+    break;
+  case policy::omp:
+#pragma omp parallel for simd schedule(static)
+    for (std::size_t i = 0; i < n; ++i) f(i);
+    break;
+  case policy::threads:
+    workers.run([n, &f](int tid, int nthreads) {
+      const std::size_t begin = n * tid / nthreads, end = n * (tid + 1) / nthreads;
+      for (std::size_t i = begin; i < end; ++i) f(i);
+    });
+    break;
+  }
+}
+
+/// Sum of f(i) for i in [0, n) with policy 'p'
+template <class F> real_t sum_index(policy p, exec::thread_pool &workers, std::size_t n, F f) {
+  auto ints = std::views::iota(std::size_t(0), n);
+  switch (p) {
+  case policy::seq:
+    return std::transform_reduce(std::execution::seq, ints.begin(), ints.end(), real_t(0), std::plus<>(), f);
+  case policy::par:
+    return std::transform_reduce(std::execution::par, ints.begin(), ints.end(), real_t(0), std::plus<>(), f);
+  case policy::par_unseq:
+    return std::transform_reduce(std::execution::par_unseq, ints.begin(), ints.end(), real_t(0), std::plus<>(), f);
+  case policy::omp: {
+    real_t sum = 0;
+#pragma omp parallel for simd schedule(static) reduction(+ : sum)
+    for (std::size_t i = 0; i < n; ++i) sum += f(i);
+    return sum;
+  }
+  default: {
+    constexpr int pad = 8; // One cache line per partial sum
+    std::vector<real_t> partial(workers.size() * pad, 0);
+    workers.run([n, &f, &partial](int tid, int nthreads) {
+      const std::size_t begin = n * tid / nthreads, end = n * (tid + 1) / nthreads;
+      real_t sum = 0;
+      for (std::size_t i = begin; i < end; ++i) sum += f(i);
+      partial[tid * pad] = sum;
+    });
+    real_t sum = 0;
+    for (int tid = 0; tid < workers.size(); ++tid) sum += partial[tid * pad];
+    return sum;
+  }
+  }
+}
+
+/// Array of n elements aligned to a cache line (and first touched by the OpenMP threads,
+/// with the static partition also used by the kernels)
+template <class T> struct aligned_array {
+  explicit aligned_array(std::size_t n)
+    : ptr(static_cast<T *>(std::aligned_alloc(64, std::max<std::size_t>((n * sizeof(T) + 63) / 64 * 64, 64))), std::free) {
+    if (!ptr) throw std::bad_alloc();
+#pragma omp parallel for schedule(static)
+    for (std::size_t i = 0; i < n; ++i) ptr[i] = T(0);
+  }
+  T *data() { return ptr.get(); }
+  std::unique_ptr<T[], decltype(&std::free)> ptr;
+};
+
+struct statistics {
+  double median, p10, p90, best;
+};
+
+/// Statistics of the bandwidths [GB/s] of the samples
+statistics summarize(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  auto at = [&v](double q) { return v[static_cast<std::size_t>(std::lround(q * (v.size() - 1)))]; };
+  double median = v.size() % 2 ? v[v.size() / 2] : .5 * (v[v.size() / 2 - 1] + v[v.size() / 2]);
+  return {median, at(.1), at(.9), v.back()};
+}
+
+/// Parse a size with an optional K, M or G suffix (powers of 2)
+std::size_t parse_size(std::string const &s) {
+  std::size_t pos = 0;
+  double value = std::stod(s, &pos);
+  if (pos < s.size()) {
+    switch (s[pos]) {
+    case 'K': case 'k': value *= 1 << 10; break;
+    case 'M': case 'm': value *= 1 << 20; break;
+    case 'G': case 'g': value *= 1 << 30; break;
+    }
+  }
+  return static_cast<std::size_t>(value);
+}
+
+int main(int argc, char *argv[]) {
+  std::size_t min_bytes = 16 << 10, max_bytes = 256 << 20;
+  int samples = 10, stride = 8;
+  int nthreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  std::string csv;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--min" && i + 1 < argc) min_bytes = parse_size(argv[++i]);
+    else if (arg == "--max" && i + 1 < argc) max_bytes = parse_size(argv[++i]);
+    else if (arg == "--samples" && i + 1 < argc) samples = std::max(1, std::stoi(argv[++i]));
+    else if (arg == "--stride" && i + 1 < argc) stride = std::max(1, std::stoi(argv[++i]));
+    else if (arg == "--threads" && i + 1 < argc) nthreads = std::max(1, std::stoi(argv[++i]));
+    else if (arg == "--csv" && i + 1 < argc) csv = argv[++i];
+    else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--min <bytes>] [--max <bytes>] [--samples <n>] [--stride <n>] [--threads <n>] [--csv <file>]"
+                << std::endl;
+      return 1;
+    }
+  }
+
+  std::ofstream file;
+  if (!csv.empty()) file.open(csv);
+  std::ostream &out = csv.empty() ? std::cout : file;
+  out << "kernel,policy,working_set_bytes,n,samples,median_GBs,p10_GBs,p90_GBs,best_GBs" << std::endl;
+
+  omp_set_num_threads(nthreads);
+  exec::thread_pool workers(nthreads);
+  const policy policies[] = {policy::seq, policy::par, policy::par_unseq, policy::omp, policy::threads};
+  const real_t s = 3.;
+
+  // Working set of 3 arrays of n doubles (2 for the gather: a and the indices)
+  for (std::size_t bytes = min_bytes; bytes <= max_bytes; bytes *= 2) {
+    const std::size_t n = std::max<std::size_t>(bytes / (3 * sizeof(real_t)) / 8 * 8, 8);
+    aligned_array<real_t> a(n), b(n), c(n);
+    aligned_array<std::uint32_t> idx(n);
+
+    std::iota(idx.data(), idx.data() + n, 0u);
+    std::shuffle(idx.data(), idx.data() + n, std::mt19937_64(42));
+
+    real_t *pa = a.data(), *pb = b.data(), *pc = c.data();
+    const std::uint32_t *pidx = idx.data();
+    real_t sink = 0; // Keeps the results of the reductions alive
+
+    struct kernel {
+      const char *name;
+      double bytes;
+      std::function<void(policy)> run;
+    };
+    const std::size_t n_strided = n / stride;
+    const kernel kernels[] = {
+      {"copy", 2. * n * sizeof(real_t),
+       [&](policy p) { for_each_index(p, workers, n, [=](std::size_t i) { pc[i] = pa[i]; }); }},
+      {"scale", 2. * n * sizeof(real_t),
+       [&](policy p) { for_each_index(p, workers, n, [=](std::size_t i) { pb[i] = s * pc[i]; }); }},
+      {"add", 3. * n * sizeof(real_t),
+       [&](policy p) { for_each_index(p, workers, n, [=](std::size_t i) { pc[i] = pa[i] + pb[i]; }); }},
+      {"triad", 3. * n * sizeof(real_t),
+       [&](policy p) { for_each_index(p, workers, n, [=](std::size_t i) { pa[i] = pb[i] + s * pc[i]; }); }},
+      {"copy_nt", 2. * n * sizeof(real_t),
+       [&](policy p) {
+         // One cache line (8 doubles) per index; the stores bypass the caches
+         for_each_index(p, workers, n / 8, [=](std::size_t l) {
+#if defined(__SSE2__)
+           for (int k = 0; k < 8; k += 2)
+             _mm_stream_pd(pc + 8 * l + k, _mm_load_pd(pa + 8 * l + k));
+#else
+           for (int k = 0; k < 8; ++k) pc[8 * l + k] = pa[8 * l + k];
+#endif
+         });
+#if defined(__SSE2__)
+         _mm_sfence();
+#endif
+       }},
+      {"strided", 1. * n_strided * sizeof(real_t),
+       [&, stride](policy p) { sink += sum_index(p, workers, n_strided, [=](std::size_t i) { return pa[i * stride]; }); }},
+      {"gather", 1. * n * (sizeof(real_t) + sizeof(std::uint32_t)),
+       [&](policy p) { sink += sum_index(p, workers, n, [=](std::size_t i) { return pa[pidx[i]]; }); }},
+    };
+
+    for (auto const &k : kernels) {
+      for (auto p : policies) {
+        using clk_t = std::chrono::steady_clock;
+
+        // Warm-up, and number of repetitions for a sample to last at least 1 ms
+        k.run(p);
+        auto start = clk_t::now();
+        k.run(p);
+        const double t1 = std::chrono::duration<double>(clk_t::now() - start).count();
+        const int reps = static_cast<int>(std::clamp(1e-3 / std::max(t1, 1e-9), 1., 1e6));
+
+        std::vector<double> bandwidth(samples);
+        for (auto &bw : bandwidth) {
+          start = clk_t::now();
+          for (int r = 0; r < reps; ++r) k.run(p);
+          const double t = std::chrono::duration<double>(clk_t::now() - start).count() / reps;
+          bw = k.bytes / t * 1e-9;
+        }
+
+        const auto st = summarize(bandwidth);
+        out << k.name << "," << name(p) << "," << 3 * n * sizeof(real_t) << "," << n << "," << samples << ","
+            << st.median << "," << st.p10 << "," << st.p90 << "," << st.best << std::endl;
+      }
+    }
+
+    // Validation as in STREAM: from a = 1, b = 2, c = 0, one pass of copy, scale, add
+    // and triad gives c = 1, b = 3, c = 4, a = 3 + 3 * 4 = 15, with every policy
+    for (auto p : policies) {
+      std::fill_n(pa, n, 1.);
+      std::fill_n(pb, n, 2.);
+      std::fill_n(pc, n, 0.);
+      for (int k = 0; k < 4; ++k) kernels[k].run(p);
+      if (!std::all_of(pa, pa + n, [](real_t x) { return x == 15.; }) ||
+          !std::all_of(pb, pb + n, [](real_t x) { return x == 3.; }) ||
+          !std::all_of(pc, pc + n, [](real_t x) { return x == 4.; }))
+        std::cerr << "WARNING: validation failed with policy " << name(p) << std::endl;
+    }
+    std::cerr << "Working set " << 3 * n * sizeof(real_t) << " B done (checksum " << sink << ")" << std::endl;
+  }
+
+  return 0;
+}
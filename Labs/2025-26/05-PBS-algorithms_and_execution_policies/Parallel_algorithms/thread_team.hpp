@@ -0,0 +1,66 @@
+#ifndef HAVE_THREAD_TEAM_HPP
+#define HAVE_THREAD_TEAM_HPP
+
+// Persistent team of worker threads: the "threads" backend of
+// 05-PBS-algorithms_and_execution_policies/Parallel_algorithms/execution_backend.hpp and the
+// pinned team of 08-mpi-stl/numa.hpp. Each of the two labs has its own identical copy of this
+// file, so that it builds on its own.
+//
+// The threads are created once; 'run' hands them a job and waits for all of them with two
+// barrier phases, instead of creating and joining threads on every call.
+
+#include <barrier>    // For the start/end synchronisation of the team
+#include <functional> // For std::function
+#include <thread>     // For std::thread
+#include <vector>     // For std::vector
+
+namespace threads {
+
+class team {
+public:
+  // 'init(tid)', if given, runs once on every worker before its first job (e.g. to pin it
+  // to a CPU)
+  explicit team(int nthreads, std::function<void(int)> init = {})
+    : start(nthreads + 1), end(nthreads + 1) {
+    for (int tid = 0; tid < nthreads; ++tid) {
+      workers.emplace_back([this, tid, nthreads, init]() {
+        if (init) init(tid);
+        while (true) {
+          start.arrive_and_wait();
+          if (stop) break;
+          job(tid, nthreads);
+          end.arrive_and_wait();
+        }
+      });
+    }
+  }
+
+  ~team() {
+    stop = true;
+    start.arrive_and_wait();
+    for (auto& w : workers) w.join();
+  }
+
+  team(team const&) = delete;
+  team& operator=(team const&) = delete;
+
+  int size() const { return static_cast<int>(workers.size()); }
+
+  // Run 'f(tid, nthreads)' on every worker and return when all of them are done. Not
+  // reentrant: one 'run' at a time
+  void run(std::function<void(int, int)> f) {
+    job = std::move(f);
+    start.arrive_and_wait();
+    end.arrive_and_wait();
+  }
+
+private:
+  std::barrier<> start, end;
+  std::function<void(int, int)> job;
+  std::vector<std::thread> workers;
+  bool stop = false;
+};
+
+} // namespace threads
+
+#endif
@@ -1,61 +1,459 @@
 #include "adaptive_quadrature.hpp"
 
+#include <omp.h>
+
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <new>
+#include <vector>
+
+namespace
+{
+  // Intervals bisected per round (all their new nodes go to a single
+  // call of the evaluator), and initial partition of each input
+  // interval. Both are independent of the number of threads, so the
+  // result is too.
+  constexpr std::size_t batch_size        = 256;
+  constexpr int         initial_intervals = 8;
+
+  // Input intervals handled by one run of the engine in the batched
+  // interface.
+  constexpr std::size_t owner_chunk = 256;
+
+  // A sub-interval of input interval 'owner', with its estimate. For
+  // Simpson's rule, 'f' caches the integrand at a + k (b - a) / 4,
+  // k = 0, ..., 4.
+  struct interval
+  {
+    double                a, b;
+    double                value, error;
+    std::array<double, 5> f;
+    std::size_t           owner;
+
+    bool
+    operator<(const interval &other) const
+    {
+      return error < other.error;
+    }
+  };
+
+  // Gauss-Kronrod 7-15 nodes (positive half) and weights: the odd
+  // Kronrod nodes are the Gauss ones.
+  constexpr double xgk[8] = {0.991455371120812639206854697526329,
+                             0.949107912342758524526189684047851,
+                             0.864864423359769072789712788640926,
+                             0.741531185599394439863864773280788,
+                             0.586087235467691130294144845693013,
+                             0.405845151377397166906606412076961,
+                             0.207784955007898467600689403773245,
+                             0.000000000000000000000000000000000};
+
+  constexpr double wgk[8] = {0.022935322010529224963732008058970,
+                             0.063092092629978553290700663189204,
+                             0.104790010322250183839876322541518,
+                             0.140653259715525918745189590510238,
+                             0.169004726639267902826583426598550,
+                             0.190350578064785409913256402421014,
+                             0.204432940075298892414161999234649,
+                             0.209482141084727828012999174891714};
+
+  constexpr double wg[4] = {0.129484966168869693270611432679082,
+                            0.279705391489276667901467771423780,
+                            0.381830050505118944950369775488975,
+                            0.417959183673469387755102040816327};
+
+  // Append the 15 nodes of 'I' to 'x', ...
+  void
+  gauss_kronrod_nodes(const interval &I, std::vector<double> &x)
+  {
+    const double c = .5 * (I.a + I.b);
+    const double h = .5 * (I.b - I.a);
+
+    x.push_back(c);
+    for (int j = 0; j < 7; ++j)
+      {
+        x.push_back(c - h * xgk[j]);
+        x.push_back(c + h * xgk[j]);
+      }
+  }
+
+  // ... and compute the estimate from the values at those nodes.
+  void
+  gauss_kronrod(interval &I, const double *y)
+  {
+    const double h = .5 * (I.b - I.a);
+
+    double k = wgk[7] * y[0];
+    double g = wg[3] * y[0];
+    for (int j = 0; j < 7; ++j)
+      {
+        const double fsum = y[1 + 2 * j] + y[2 + 2 * j];
+        k += wgk[j] * fsum;
+        if (j % 2 == 1)
+          g += wg[j / 2] * fsum;
+      }
+
+    I.value = h * k;
+    I.error = std::abs(h * (k - g));
+  }
+
+  // Estimate from the cached values: Simpson on 1 and 2 panels.
+  void
+  simpson(interval &I)
+  {
+    const double h  = I.b - I.a;
+    const double s1 = h / 6. * (I.f[0] + 4. * I.f[2] + I.f[4]);
+    const double s2 =
+      h / 12. * (I.f[0] + 4. * I.f[1] + 2. * I.f[2] + 4. * I.f[3] + I.f[4]);
+
+    I.value = s2 + (s2 - s1) / 15.;
+    I.error = std::abs(s2 - s1) / 15.;
+  }
+
+  // Global adaptive integration of 'n' intervals at once: a single heap
+  // holds the sub-intervals of all of them, and an input interval stops
+  // being refined as soon as its own tolerance is met.
+  class engine
+  {
+  public:
+    engine(quadrature_evaluator f, void *ctx, const adaptive_options &o)
+      : f(f)
+      , ctx(ctx)
+      , o(o)
+    {}
+
+    void
+    run(const double *a, const double *b, double *result, std::size_t n, adaptive_stats *stats);
+
+  private:
+    // Evaluate the integrand at all the nodes in 'x', into 'y'.
+    void
+    evaluate()
+    {
+      y.resize(x.size());
+      if (!x.empty())
+        f(x.data(), y.data(), x.size(), ctx);
+      evals += x.size();
+    }
+
+    // Number of new nodes needed to evaluate an interval from scratch
+    // and to bisect it.
+    int
+    nodes_new() const
+    {
+      return o.rule == ADAPTIVE_SIMPSON ? 5 : 15;
+    }
+
+    int
+    nodes_bisect() const
+    {
+      return o.rule == ADAPTIVE_SIMPSON ? 4 : 30;
+    }
+
+    quadrature_evaluator   f;
+    void                  *ctx;
+    const adaptive_options o;
+
+    std::vector<double> x, y;
+    long                evals = 0;
+  };
+
+  void
+  engine::run(const double *a, const double *b, double *result, std::size_t n, adaptive_stats *stats)
+  {
+    std::vector<interval> heap, done, batch, deferred, children;
+    std::vector<double>   value(n, 0.), error(n, 0.), tol(n), remaining(n);
+    std::vector<long>     count(n, initial_intervals);
+
+    // New intervals go to the heap, unless their input interval has
+    // already converged: then they will not be refined any further, and
+    // keeping them out of the heap keeps it small.
+    const auto push_children = [&]() {
+      for (const auto &I : children)
+        {
+          const std::size_t i = I.owner;
+          if (error[i] <= std::max(o.abs_tol, o.rel_tol * std::abs(value[i])))
+            done.push_back(I);
+          else
+            {
+              heap.push_back(I);
+              std::push_heap(heap.begin(), heap.end());
+            }
+        }
+      children.clear();
+    };
+
+    // Initial partition of every input interval, evaluated in one call.
+    x.clear();
+    x.reserve(n * initial_intervals * nodes_new());
+    heap.reserve(n * initial_intervals);
+    done.reserve(n * initial_intervals);
+    for (std::size_t i = 0; i < n; ++i)
+      for (int k = 0; k < initial_intervals; ++k)
+        {
+          interval I{a[i] + (b[i] - a[i]) * k / initial_intervals,
+                     a[i] + (b[i] - a[i]) * (k + 1) / initial_intervals,
+                     0.,
+                     0.,
+                     {},
+                     i};
+          if (o.rule == ADAPTIVE_SIMPSON)
+            for (int q = 0; q < 5; ++q)
+              x.push_back(I.a + .25 * q * (I.b - I.a));
+          else
+            gauss_kronrod_nodes(I, x);
+          heap.push_back(I);
+        }
+    evaluate();
+
+    for (std::size_t j = 0; j < heap.size(); ++j)
+      {
+        interval &I = heap[j];
+        if (o.rule == ADAPTIVE_SIMPSON)
+          {
+            std::copy_n(y.begin() + 5 * j, 5, I.f.begin());
+            simpson(I);
+          }
+        else
+          gauss_kronrod(I, y.data() + 15 * j);
 
-#define tol 1e-12
-#define maxdepth 40
+        value[I.owner] += I.value;
+        error[I.owner] += I.error;
+      }
+    children.swap(heap);
+    heap.clear();
+    push_children();
 
-int depth         = 0;
-int depth_reached = 0;
+    while (o.max_evaluations <= 0 || evals < o.max_evaluations)
+      {
+        for (std::size_t i = 0; i < n; ++i)
+          {
+            tol[i]       = std::max(o.abs_tol, o.rel_tol * std::abs(value[i]));
+            remaining[i] = error[i];
+          }
+
+        // Take the worst intervals of the input intervals that have not
+        // converged, but only as many as are needed for the error left in
+        // the heap to meet the tolerance.
+        batch.clear();
+        deferred.clear();
+        while (!heap.empty() && batch.size() < batch_size)
+          {
+            std::pop_heap(heap.begin(), heap.end());
+            const interval I = heap.back();
+            heap.pop_back();
+
+            const std::size_t i = I.owner;
+            const double      c = .5 * (I.a + I.b);
+            if (error[i] <= tol[i] || count[i] >= o.max_intervals || c <= I.a || c >= I.b)
+              done.push_back(I);
+            else if (remaining[i] <= .5 * tol[i])
+              deferred.push_back(I);
+            else
+              {
+                batch.push_back(I);
+                remaining[i] -= I.error;
+                ++count[i];
+              }
+          }
+
+        for (const auto &I : deferred)
+          {
+            heap.push_back(I);
+            std::push_heap(heap.begin(), heap.end());
+          }
+
+        if (batch.empty())
+          break;
+        children.reserve(2 * batch.size());
+
+        // New nodes of all the children, evaluated in one call. Simpson's
+        // rule reuses the endpoint, midpoint and quarter-point values.
+        x.clear();
+        for (const auto &I : batch)
+          {
+            const double c = .5 * (I.a + I.b);
+            if (o.rule == ADAPTIVE_SIMPSON)
+              {
+                const double q = .125 * (I.b - I.a);
+                x.insert(x.end(), {I.a + q, I.a + 3. * q, c + q, c + 3. * q});
+              }
+            else
+              {
+                gauss_kronrod_nodes(interval{I.a, c, 0., 0., {}, I.owner}, x);
+                gauss_kronrod_nodes(interval{c, I.b, 0., 0., {}, I.owner}, x);
+              }
+          }
+        evaluate();
+
+        for (std::size_t j = 0; j < batch.size(); ++j)
+          {
+            const interval &I  = batch[j];
+            const double    c  = .5 * (I.a + I.b);
+            const double   *yj = y.data() + nodes_bisect() * j;
+
+            interval left{I.a, c, 0., 0., {}, I.owner};
+            interval right{c, I.b, 0., 0., {}, I.owner};
+            if (o.rule == ADAPTIVE_SIMPSON)
+              {
+                left.f  = {I.f[0], yj[0], I.f[1], yj[1], I.f[2]};
+                right.f = {I.f[2], yj[2], I.f[3], yj[3], I.f[4]};
+                simpson(left);
+                simpson(right);
+              }
+            else
+              {
+                gauss_kronrod(left, yj);
+                gauss_kronrod(right, yj + nodes_new());
+              }
+
+            value[I.owner] += left.value + right.value - I.value;
+            error[I.owner] += left.error + right.error - I.error;
+
+            children.push_back(left);
+            children.push_back(right);
+          }
+        push_children();
+      }
+
+    // Final sums, free of the round-off accumulated by the updates above.
+    std::fill(value.begin(), value.end(), 0.);
+    std::fill(error.begin(), error.end(), 0.);
+    for (const auto *list : {&heap, &done})
+      for (const auto &I : *list)
+        {
+          value[I.owner] += I.value;
+          error[I.owner] += I.error;
+        }
+
+    bool   converged   = true;
+    double total_error = 0.;
+    for (std::size_t i = 0; i < n; ++i)
+      {
+        result[i] = value[i];
+        total_error += error[i];
+        converged = converged &&
+                    error[i] <= std::max(o.abs_tol, o.rel_tol * std::abs(value[i]));
+      }
+
+    if (stats)
+      {
+        stats->evaluations = evals;
+        stats->intervals   = heap.size() + done.size();
+        stats->error       = total_error;
+        stats->converged   = converged;
+      }
+  }
+
+  // Adapter from a scalar std::function to a batch evaluator: the nodes
+  // of a batch are evaluated in parallel with OpenMP.
+  struct scalar_integrand
+  {
+    const std::function<double(double)> *f;
+    int                                  n_threads;
+  };
+
+  void
+  evaluate_scalar(const double *x, double *y, size_t n, void *ctx)
+  {
+    const auto &s = *static_cast<const scalar_integrand *>(ctx);
+
+#pragma omp parallel for num_threads(s.n_threads) schedule(static) if (n > 1)
+    for (size_t i = 0; i < n; ++i)
+      y[i] = (*s.f)(x[i]);
+  }
+} // namespace
 
 double
-trapz(std::function<double(double)> f, double a, double b)
+integrate_adaptive(const std::function<double(double)> &f,
+                   double                               a,
+                   double                               b,
+                   const adaptive_options              *opts,
+                   adaptive_stats                      *stats)
 {
-  double retval = 0.0;
-  double h      = b - a;
-  retval        = .5 * h * (f(a) + f(b));
-  return retval;
+  const adaptive_options o = opts ? *opts : adaptive_options{};
+  scalar_integrand       s{&f, o.n_threads > 0 ? o.n_threads : omp_get_max_threads()};
+
+  double result;
+  engine(evaluate_scalar, &s, o).run(&a, &b, &result, 1, stats);
+
+  return result;
 }
 
 double
-refine(std::function<double(double)> f,
-       double                        a,
-       double                        b,
-       double                        oldval)
+integrate(std::function<double(double)> f, double a, double b)
 {
-  ++depth;
-  if (depth > depth_reached)
-    depth_reached = depth;
+  return integrate_adaptive(f, a, b, nullptr, nullptr);
+}
 
-  double c = .5 * a + .5 * b;
+int
+quadrature_abi_version(void)
+{
+  return QUADRATURE_ABI_VERSION;
+}
 
-  double oldval_l = trapz(f, a, c);
-  double oldval_r = trapz(f, c, b);
-  double newval   = oldval_l + oldval_r;
+const quadrature_rule_info *
+quadrature_info(void)
+{
+  // Gauss-Kronrod 7-15 by default; the heap costs a little on top of
+  // the evaluations.
+  static const quadrature_rule_info info = {"adaptive", 0, 15. * initial_intervals, 1.2};
 
-  double retval = 0.0;
+  return &info;
+}
 
-  if (depth >= maxdepth || fabs(newval - oldval) <= tol)
-    retval = newval;
-  else
+int
+integrate_batch_adaptive(quadrature_evaluator    f,
+                         void                   *ctx,
+                         const double           *a,
+                         const double           *b,
+                         double                 *result,
+                         size_t                  n_intervals,
+                         const adaptive_options *opts,
+                         adaptive_stats         *stats)
+{
+  try
     {
-      retval += refine(f, a, c, oldval_l);
-      retval += refine(f, c, b, oldval_r);
-    }
+      // The input intervals are independent: integrating them in chunks
+      // keeps the working set of the engine in cache.
+      adaptive_options o = opts ? *opts : adaptive_options{};
+      const long       max_evaluations = o.max_evaluations;
+      adaptive_stats   total, chunk;
+      total.converged = 1;
+      for (size_t i = 0; i < n_intervals; i += owner_chunk)
+        {
+          // The evaluation budget is shared by all the chunks.
+          if (max_evaluations > 0)
+            o.max_evaluations = std::max(1L, max_evaluations - total.evaluations);
 
-  --depth;
+          const size_t n = std::min(owner_chunk, n_intervals - i);
+          engine(f, ctx, o).run(a + i, b + i, result + i, n, &chunk);
 
-  return retval;
-}
+          total.evaluations += chunk.evaluations;
+          total.intervals += chunk.intervals;
+          total.error += chunk.error;
+          total.converged = total.converged && chunk.converged;
+        }
 
+      if (stats)
+        *stats = total;
+    }
+  catch (const std::bad_alloc &)
+    {
+      return 1;
+    }
 
-double
-integrate(std::function<double(double)> f, double a, double b)
-{
-  double res    = 0;
-  depth         = 0;
-  depth_reached = 0;
-  res           = refine(f, a, b, 0.0);
+  return 0;
+}
 
-  return res;
+int
+integrate_batch(quadrature_evaluator f,
+                void                *ctx,
+                const double        *a,
+                const double        *b,
+                double              *result,
+                size_t               n_intervals)
+{
+  return integrate_batch_adaptive(f, ctx, a, b, result, n_intervals, nullptr, nullptr);
 }
@@ -3,10 +3,70 @@
 
 #include <functional>
 
+#include "quadrature_abi.hpp"
+
+/// Error estimator used on each interval.
+enum adaptive_rule
+{
+  /// 7-point Gauss / 15-point Kronrod pair (15 evaluations per interval).
+  ADAPTIVE_GAUSS_KRONROD = 0,
+  /// Simpson's rule on 1 and 2 panels, with Richardson extrapolation.
+  /// Endpoint and midpoint values are reused by the children of an
+  /// interval, so each bisection costs 4 new evaluations.
+  ADAPTIVE_SIMPSON = 1
+};
+
+struct adaptive_options
+{
+  double abs_tol         = 1e-12; ///< Target absolute error...
+  double rel_tol         = 0.0;   ///< ...or relative error, whichever is larger.
+  int    rule            = ADAPTIVE_GAUSS_KRONROD;
+  long   max_intervals   = 100000; ///< Per input interval, stop refining beyond this.
+  int    n_threads       = 0;      ///< 0: OpenMP default.
+  long   max_evaluations = 0;      ///< Stop refining beyond this; 0: no limit.
+};
+
+struct adaptive_stats
+{
+  long   evaluations = 0; ///< Number of calls to the integrand.
+  long   intervals   = 0; ///< Number of intervals of the final partition.
+  double error       = 0; ///< Estimated absolute error.
+  int    converged   = 0; ///< Whether the tolerance was met.
+};
+
 extern "C"
 {
   double
   integrate(std::function<double(double)>, double, double);
+
+  /// Globally adaptive integration of f over [a, b]: the interval with
+  /// the largest error estimate is bisected until the sum of the
+  /// estimates meets the tolerance. The intervals are kept in a heap
+  /// and bisected in batches, whose nodes are evaluated in parallel with
+  /// OpenMP, so 'f' must be safe to call concurrently. The function
+  /// keeps no global state and may be called from several threads at
+  /// once. 'opts' and 'stats' may be null.
+  double
+  integrate_adaptive(const std::function<double(double)> &f,
+                     double                               a,
+                     double                               b,
+                     const adaptive_options              *opts,
+                     adaptive_stats                      *stats);
+
+  /// Batched version (see quadrature_abi.hpp): the sub-intervals of all
+  /// the input intervals share one heap, and the new nodes of each round
+  /// of bisections are passed to 'f' in a single call. Each input
+  /// interval is refined until its own tolerance is met; 'stats' sums
+  /// over all of them. Returns 0 on success.
+  int
+  integrate_batch_adaptive(quadrature_evaluator    f,
+                           void                   *ctx,
+                           const double           *a,
+                           const double           *b,
+                           double                 *result,
+                           size_t                  n_intervals,
+                           const adaptive_options *opts,
+                           adaptive_stats         *stats);
 }
 
 #endif
@@ -0,0 +1,480 @@
+#include "cubature.hpp"
+
+#include <omp.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <new>
+#include <vector>
+
+namespace
+{
+  constexpr int         gauss_points_1d = 8;
+  constexpr int         sobol_shifts    = 8;
+  constexpr std::size_t sobol_max_dim   = 16;
+
+  // Gauss-Legendre nodes and weights on [-1, 1] (Newton's method on the
+  // Legendre polynomial of degree n).
+  void
+  gauss_legendre(int n, std::vector<double> &x, std::vector<double> &w)
+  {
+    // P_n(t) and its derivative.
+    const auto legendre = [n](double t, double &p, double &dp) {
+      double p0 = 1., p1 = t;
+      for (int k = 2; k <= n; ++k)
+        {
+          const double p2 = ((2 * k - 1) * t * p1 - (k - 1) * p0) / k;
+          p0              = p1;
+          p1              = p2;
+        }
+      p  = p1;
+      dp = n * (t * p1 - p0) / (t * t - 1.);
+    };
+
+    x.resize(n);
+    w.resize(n);
+    for (int i = 0; i < n; ++i)
+      {
+        double t = std::cos(M_PI * (i + .75) / (n + .5)), p, dp;
+        for (int it = 0; it < 100; ++it)
+          {
+            legendre(t, p, dp);
+            const double dt = p / dp;
+            t -= dt;
+            if (std::abs(dt) < 1e-15)
+              break;
+          }
+        legendre(t, p, dp);
+
+        x[i] = t;
+        w[i] = 2. / ((1. - t * t) * dp * dp);
+      }
+  }
+
+  // Clenshaw-Curtis rule of level l on [-1, 1]: 1 point for l = 1,
+  // 2^(l - 1) + 1 otherwise. The rules are nested: node j of level l is
+  // node j * 2^(L - l) of level L > l.
+  void
+  clenshaw_curtis(int level, std::vector<double> &x, std::vector<double> &w)
+  {
+    if (level == 1)
+      {
+        x = {0.};
+        w = {2.};
+        return;
+      }
+
+    const int n = 1 << (level - 1);
+    x.resize(n + 1);
+    w.resize(n + 1);
+    for (int j = 0; j <= n; ++j)
+      {
+        x[j] = -std::cos(M_PI * j / n);
+
+        double s = 0.;
+        for (int k = 1; k <= n / 2; ++k)
+          s += (k == n / 2 ? 1. : 2.) / (4. * k * k - 1.) * std::cos(2. * M_PI * k * j / n);
+        w[j] = (j == 0 || j == n ? 1. : 2.) / n * (1. - s);
+      }
+  }
+
+  // Index of node j of the level l rule among the nodes of level L.
+  int
+  nested_index(int j, int l, int L)
+  {
+    if (l == 1)
+      return L >= 2 ? 1 << (L - 2) : 0;
+    return j << (L - l);
+  }
+
+  double
+  binomial(int n, int k)
+  {
+    double c = 1.;
+    for (int i = 1; i <= k; ++i)
+      c = c * (n - k + i) / i;
+    return c;
+  }
+
+  // Points (on [-1, 1]^dim) and weights of the Smolyak grids of levels
+  // 'level' (weights[0]) and 'level - 1' (weights[1]), by the
+  // combination technique: the tensor rules U^i with
+  // q - dim + 1 <= |i| <= q, q = dim + level - 1, weighted by
+  // (-1)^(q - |i|) binomial(dim - 1, q - |i|). Points shared by several
+  // tensor rules are merged, so each is evaluated once.
+  void
+  smolyak(std::size_t                         dim,
+          int                                 level,
+          std::vector<double>                &points,
+          std::vector<std::array<double, 2>> &weights)
+  {
+    const int d = dim;
+    std::map<std::vector<int>, std::array<double, 2>> grid;
+
+    std::vector<std::vector<double>> x(level + 1), w(level + 1);
+    for (int l = 1; l <= level; ++l)
+      clenshaw_curtis(l, x[l], w[l]);
+
+    for (int s = 0; s < 2 && level - s >= 1; ++s)
+      {
+        const int q = d + level - s - 1;
+
+        std::vector<int> i(d), j(d), key(d);
+
+        // Tensor rule U^i, with coefficient 'c'.
+        const auto add_tensor = [&](double c) {
+          std::fill(j.begin(), j.end(), 0);
+          while (true)
+            {
+              double weight = c;
+              for (int k = 0; k < d; ++k)
+                {
+                  weight *= w[i[k]][j[k]];
+                  key[k] = nested_index(j[k], i[k], level);
+                }
+              grid[key][s] += weight;
+
+              int k = 0;
+              while (k < d && ++j[k] == static_cast<int>(x[i[k]].size()))
+                j[k++] = 0;
+              if (k == d)
+                break;
+            }
+        };
+
+        // Multi-indices i >= 1 with |i| in [max(d, q - d + 1), q].
+        const auto enumerate = [&](auto &self, int k, int sum) -> void {
+          if (k == d)
+            {
+              if (sum >= q - d + 1)
+                add_tensor((((q - sum) % 2) ? -1. : 1.) * binomial(d - 1, q - sum));
+              return;
+            }
+          for (i[k] = 1; sum + i[k] + (d - k - 1) <= q; ++i[k])
+            self(self, k + 1, sum + i[k]);
+        };
+        enumerate(enumerate, 0, 0);
+      }
+
+    const int n = level >= 2 ? 1 << (level - 1) : 1;
+    points.clear();
+    weights.clear();
+    for (const auto &[key, wk] : grid)
+      {
+        for (int k = 0; k < d; ++k)
+          points.push_back(level >= 2 ? -std::cos(M_PI * key[k] / n) : 0.);
+        weights.push_back(wk);
+      }
+  }
+
+  // Primitive polynomials (degree s, coefficients a) and initial
+  // direction numbers m of dimensions 2 to 16 of the Sobol sequence
+  // (Joe and Kuo).
+  struct sobol_polynomial
+  {
+    int s, a;
+    int m[6];
+  };
+
+  constexpr sobol_polynomial sobol_table[sobol_max_dim - 1] = {
+    {1, 0, {1}},
+    {2, 1, {1, 3}},
+    {3, 1, {1, 3, 1}},
+    {3, 2, {1, 1, 1}},
+    {4, 1, {1, 1, 3, 3}},
+    {4, 4, {1, 3, 5, 13}},
+    {5, 2, {1, 1, 5, 5, 17}},
+    {5, 4, {1, 1, 5, 5, 5}},
+    {5, 7, {1, 1, 7, 11, 19}},
+    {5, 11, {1, 1, 5, 1, 1}},
+    {5, 13, {1, 1, 1, 3, 11}},
+    {5, 14, {1, 3, 5, 5, 31}},
+    {6, 1, {1, 3, 3, 9, 7, 49}},
+    {6, 13, {1, 1, 1, 15, 21, 21}},
+    {6, 16, {1, 3, 1, 13, 27, 49}}};
+
+  // Direction numbers v[d][k], 32 bits, of the first 'dim' dimensions.
+  std::vector<std::array<std::uint32_t, 32>>
+  sobol_directions(std::size_t dim)
+  {
+    std::vector<std::array<std::uint32_t, 32>> v(dim);
+    for (int k = 0; k < 32; ++k)
+      v[0][k] = std::uint32_t(1) << (31 - k);
+
+    for (std::size_t d = 1; d < dim; ++d)
+      {
+        const auto &p = sobol_table[d - 1];
+        for (int k = 0; k < 32; ++k)
+          {
+            if (k < p.s)
+              v[d][k] = std::uint32_t(p.m[k]) << (31 - k);
+            else
+              {
+                v[d][k] = v[d][k - p.s] ^ (v[d][k - p.s] >> p.s);
+                for (int j = 1; j < p.s; ++j)
+                  if ((p.a >> (p.s - 1 - j)) & 1)
+                    v[d][k] ^= v[d][k - j];
+              }
+          }
+      }
+
+    return v;
+  }
+
+  std::uint64_t
+  splitmix64(std::uint64_t &state)
+  {
+    std::uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z               = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z               = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  // Parallel evaluation scheduler: sums[s] = sum_k w_s(k) f(x_k) for the
+  // 'n_points' points generated by point(k, x, w) ('dim' coordinates
+  // and 'n_sums' weights). The points are generated and evaluated in
+  // batches, dynamically distributed among the threads; the partial sums
+  // of the batches are added in order, independently of the threads.
+  template <class Generator>
+  void
+  schedule(cubature_evaluator      f,
+           void                   *ctx,
+           std::size_t             dim,
+           std::size_t             n_points,
+           int                     n_sums,
+           const Generator        &point,
+           const cubature_options &o,
+           std::vector<double>    &sums)
+  {
+    const std::size_t batch     = o.batch > 0 ? o.batch : 1024;
+    const std::size_t n_batches = (n_points + batch - 1) / batch;
+    const int         n_threads = o.n_threads > 0 ? o.n_threads : omp_get_max_threads();
+
+    std::vector<double> partial(n_batches * n_sums, 0.);
+
+#pragma omp parallel num_threads(n_threads)
+    {
+      std::vector<double> x(batch * dim), y(batch), w(batch * n_sums);
+
+#pragma omp for schedule(dynamic)
+      for (std::size_t b = 0; b < n_batches; ++b)
+        {
+          const std::size_t k0 = b * batch;
+          const std::size_t n  = std::min(batch, n_points - k0);
+
+          for (std::size_t k = 0; k < n; ++k)
+            point(k0 + k, &x[k * dim], &w[k * n_sums]);
+
+          f(x.data(), y.data(), n, dim, ctx);
+
+          for (std::size_t k = 0; k < n; ++k)
+            for (int s = 0; s < n_sums; ++s)
+              partial[b * n_sums + s] += w[k * n_sums + s] * y[k];
+        }
+    }
+
+    sums.assign(n_sums, 0.);
+    for (std::size_t b = 0; b < n_batches; ++b)
+      for (int s = 0; s < n_sums; ++s)
+        sums[s] += partial[b * n_sums + s];
+  }
+} // namespace
+
+int
+quadrature_abi_version(void)
+{
+  return QUADRATURE_ABI_VERSION;
+}
+
+const quadrature_rule_info *
+quadrature_info(void)
+{
+  static const quadrature_rule_info info = {"gauss-legendre", 2 * gauss_points_1d, gauss_points_1d, 1.};
+
+  return &info;
+}
+
+int
+integrate_batch(quadrature_evaluator f,
+                void                *ctx,
+                const double        *a,
+                const double        *b,
+                double              *result,
+                size_t               n_intervals)
+{
+  try
+    {
+      std::vector<double> t, w;
+      gauss_legendre(gauss_points_1d, t, w);
+
+      std::vector<double> x(gauss_points_1d * n_intervals), y(x.size());
+      for (size_t i = 0; i < n_intervals; ++i)
+        for (int j = 0; j < gauss_points_1d; ++j)
+          x[i * gauss_points_1d + j] = .5 * (a[i] + b[i]) + .5 * (b[i] - a[i]) * t[j];
+
+      f(x.data(), y.data(), x.size(), ctx);
+
+      for (size_t i = 0; i < n_intervals; ++i)
+        {
+          double sum = 0.;
+          for (int j = 0; j < gauss_points_1d; ++j)
+            sum += w[j] * y[i * gauss_points_1d + j];
+          result[i] = .5 * (b[i] - a[i]) * sum;
+        }
+    }
+  catch (const std::bad_alloc &)
+    {
+      return 1;
+    }
+
+  return 0;
+}
+
+int
+integrate_cubature(cubature_evaluator      f,
+                   void                   *ctx,
+                   size_t                  dim,
+                   const double           *lower,
+                   const double           *upper,
+                   const cubature_options *opts,
+                   double                 *result,
+                   double                 *error,
+                   size_t                 *evaluations)
+{
+  const cubature_options o = opts ? *opts : cubature_options{CUBATURE_SMOLYAK, 4, 0, 1024};
+  if (dim == 0 || !f || !result || o.level < 1)
+    return 1;
+
+  // Reference cell [-1, 1]^dim: center, half widths and their product.
+  std::vector<double> center(dim), half(dim);
+  double              jacobian = 1.;
+  for (size_t k = 0; k < dim; ++k)
+    {
+      center[k] = .5 * (lower[k] + upper[k]);
+      half[k]   = .5 * (upper[k] - lower[k]);
+      jacobian *= half[k];
+    }
+
+  double              value = 0., estimate = 0.;
+  std::size_t         n_points = 0;
+  std::vector<double> sums;
+
+  try
+    {
+      if (o.method == CUBATURE_GAUSS)
+        {
+          // Tensor rules of n and n - 1 points per dimension, one after
+          // the other in the same index space.
+          const int n = o.level;
+          if (dim * std::log2(n) > 40)
+            return 1;
+
+          std::vector<double> x[2], w[2];
+          gauss_legendre(n, x[0], w[0]);
+          if (n > 1)
+            gauss_legendre(n - 1, x[1], w[1]);
+
+          std::size_t size[2] = {1, n > 1 ? std::size_t(1) : 0};
+          for (size_t k = 0; k < dim; ++k)
+            {
+              size[0] *= n;
+              size[1] *= n - 1;
+            }
+          n_points = size[0] + size[1];
+
+          const auto point = [&](std::size_t k, double *xk, double *wk) {
+            const int   r = k < size[0] ? 0 : 1;
+            std::size_t m = r == 0 ? k : k - size[0];
+            const int   p = n - r;
+
+            double weight = jacobian;
+            for (size_t d = 0; d < dim; ++d, m /= p)
+              {
+                xk[d] = center[d] + half[d] * x[r][m % p];
+                weight *= w[r][m % p];
+              }
+            wk[r]     = weight;
+            wk[1 - r] = 0.;
+          };
+
+          schedule(f, ctx, dim, n_points, 2, point, o, sums);
+          value    = sums[0];
+          estimate = n > 1 ? std::abs(sums[0] - sums[1]) : HUGE_VAL;
+        }
+      else if (o.method == CUBATURE_SMOLYAK)
+        {
+          std::vector<double>                points;
+          std::vector<std::array<double, 2>> weights;
+          smolyak(dim, o.level, points, weights);
+          n_points = weights.size();
+
+          const auto point = [&](std::size_t k, double *xk, double *wk) {
+            for (size_t d = 0; d < dim; ++d)
+              xk[d] = center[d] + half[d] * points[k * dim + d];
+            wk[0] = jacobian * weights[k][0];
+            wk[1] = jacobian * weights[k][1];
+          };
+
+          schedule(f, ctx, dim, n_points, 2, point, o, sums);
+          value    = sums[0];
+          estimate = o.level > 1 ? std::abs(sums[0] - sums[1]) : HUGE_VAL;
+        }
+      else if (o.method == CUBATURE_SOBOL)
+        {
+          if (dim > sobol_max_dim || o.level > 31)
+            return 1;
+
+          // 2^level points for each of the random digital shifts (fixed
+          // seeds, for reproducibility).
+          const auto        v      = sobol_directions(dim);
+          const std::size_t N      = std::size_t(1) << o.level;
+          const double      volume = std::ldexp(jacobian, dim);
+          n_points                 = sobol_shifts * N;
+
+          std::vector<std::uint32_t> shift(sobol_shifts * dim);
+          std::uint64_t              state = 0;
+          for (auto &s : shift)
+            s = splitmix64(state) >> 32;
+
+          const auto point = [&](std::size_t k, double *xk, double *wk) {
+            const std::size_t r = k / N, i = k % N;
+            for (size_t d = 0; d < dim; ++d)
+              {
+                std::uint32_t bits = shift[r * dim + d];
+                for (int b = 0; (i >> b) != 0; ++b)
+                  if ((i >> b) & 1)
+                    bits ^= v[d][b];
+                xk[d] = lower[d] + (upper[d] - lower[d]) * (bits * 0x1.0p-32);
+              }
+            for (int s = 0; s < sobol_shifts; ++s)
+              wk[s] = s == int(r) ? volume / N : 0.;
+          };
+
+          schedule(f, ctx, dim, n_points, sobol_shifts, point, o, sums);
+
+          // Mean over the shifts and its standard error.
+          for (const auto &s : sums)
+            value += s / sobol_shifts;
+          for (const auto &s : sums)
+            estimate += (s - value) * (s - value);
+          estimate = std::sqrt(estimate / (sobol_shifts - 1) / sobol_shifts);
+        }
+      else
+        return 1;
+    }
+  catch (const std::bad_alloc &)
+    {
+      return 1;
+    }
+
+  *result = value;
+  if (error)
+    *error = estimate;
+  if (evaluations)
+    *evaluations = n_points;
+
+  return 0;
+}
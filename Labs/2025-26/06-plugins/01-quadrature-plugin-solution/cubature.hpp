@@ -0,0 +1,25 @@
+#ifndef HAVE_CUBATURE_HPP
+#define HAVE_CUBATURE_HPP
+
+#include "quadrature_abi.hpp"
+
+/*
+ * Cubature plugin: integrate_cubature (see quadrature_abi.hpp) on
+ * hyperrectangles, with the error estimated as follows:
+ *  - Gauss: difference with the tensor rule of one point less per
+ *    dimension, whose (n - 1)^d points are few compared to the n^d
+ *    ones for large d;
+ *  - Smolyak: difference with the grid of the previous level, which is
+ *    nested in it, so the estimate costs no evaluations;
+ *  - Sobol: standard error of the mean over independent random digital
+ *    shifts of the sequence (up to 16 dimensions).
+ *
+ * The points are generated and evaluated in batches, distributed among
+ * the OpenMP threads; the partial sums of the batches are added in a
+ * fixed order, so the result does not depend on the number of threads.
+ *
+ * As a 1D rule, the plugin integrates each interval with 8-point
+ * Gauss-Legendre.
+ */
+
+#endif
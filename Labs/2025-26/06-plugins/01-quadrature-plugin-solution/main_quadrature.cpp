@@ -1,42 +1,204 @@
-#include <dlfcn.h>
-
+#include <chrono>
 #include <cmath>
 #include <functional>
 #include <iostream>
+#include <string>
+#include <vector>
+
+#include "adaptive_quadrature.hpp"
+#include "plugin_registry.hpp"
 
 double
 integrand(double x)
 {
-  return (std::pow(std::sin(std::pow(x, 2)), 2));
+  const double s = std::sin(x * x);
+  return s * s;
+}
+
+// Same integrand, batched: one call for many nodes, a loop the
+// compiler can vectorize.
+void
+integrand_batch(const double *x, double *y, size_t n, void *)
+{
+  for (size_t i = 0; i < n; ++i)
+    y[i] = integrand(x[i]);
+}
+
+// Oscillatory integrand: the exact integral over [0, 1] is
+// (1 - cos(100)) / 100 + 1 / 3.
+void
+oscillatory(const double *x, double *y, size_t n, void *)
+{
+  for (size_t i = 0; i < n; ++i)
+    y[i] = std::sin(100. * x[i]) + x[i] * x[i];
+}
+
+// Gaussian in 'dim' dimensions: the exact integral over [0, 1]^dim is
+// (sqrt(pi) / 2 erf(1))^dim.
+void
+gaussian(const double *x, double *y, size_t n, size_t dim, void *)
+{
+  for (size_t i = 0; i < n; ++i)
+    {
+      double r2 = 0.;
+      for (size_t d = 0; d < dim; ++d)
+        r2 += x[i * dim + d] * x[i * dim + d];
+      y[i] = std::exp(-r2);
+    }
+}
+
+// Integrate 'integrand' over a partition of [0, pi] into 'n_intervals'
+// intervals with 'rule', through the scalar ABI (one call of 'integrate'
+// per interval, one std::function call per node) and through the
+// batched ABI (one call of 'integrate_batch').
+void
+benchmark(const quadrature::rule &rule, std::size_t n_intervals)
+{
+  std::vector<double> a(n_intervals), b(n_intervals), result(n_intervals);
+  for (std::size_t i = 0; i < n_intervals; ++i)
+    {
+      a[i] = M_PI * i / n_intervals;
+      b[i] = M_PI * (i + 1) / n_intervals;
+    }
+
+  using clock = std::chrono::steady_clock;
+  std::cout << rule.name << ", " << n_intervals << " intervals:" << std::endl;
+
+  if (rule.integrate)
+    {
+      const auto start = clock::now();
+      double     sum   = 0.;
+      for (std::size_t i = 0; i < n_intervals; ++i)
+        sum += rule.integrate(integrand, a[i], b[i]);
+      const std::chrono::duration<double> elapsed = clock::now() - start;
+
+      std::cout << "  scalar ABI:  res = " << sum << ", " << elapsed.count()
+                << " [s], " << n_intervals / elapsed.count() * 1e-6
+                << " M intervals/s" << std::endl;
+    }
+
+  const auto start = clock::now();
+  const int  ierr  = rule.integrate_batch(
+    integrand_batch, nullptr, a.data(), b.data(), result.data(), n_intervals);
+  double sum = 0.;
+  for (const auto &r : result)
+    sum += r;
+  const std::chrono::duration<double> elapsed = clock::now() - start;
+
+  std::cout << "  batched ABI: res = " << sum << ", " << elapsed.count()
+            << " [s], " << n_intervals / elapsed.count() * 1e-6
+            << " M intervals/s" << (ierr ? " (failed)" : "") << std::endl;
 }
 
 int
 main(int argc, char **argv)
 {
-  void *handle = dlopen("adaptive_quadrature.so", RTLD_LAZY);
-  if (!handle)
+  // All the plugins of the given directory, loaded once.
+  quadrature::registry     registry(argc > 1 ? argv[1] : ".");
+  std::vector<std::string> errors;
+  registry.refresh(&errors);
+  for (const auto &e : errors)
+    std::cerr << "Skipped " << e << std::endl;
+
+  for (const auto &r : registry.rules())
+    std::cout << "Rule " << r->name << " (" << r->path.filename().string()
+              << "): order " << r->info.order << ", "
+              << r->info.nodes_per_interval << " nodes per interval, cost "
+              << r->info.cost_per_node << " per node" << std::endl;
+
+  const auto adaptive = registry.find("adaptive");
+  if (!adaptive)
     {
-      std::cerr << "Cannot load object!" << std::endl;
-      std::cerr << dlerror() << std::endl;
+      std::cerr << "Cannot find the adaptive rule!" << std::endl;
 
       return 1;
     }
 
-  void *sym = dlsym(handle, "integrate");
-  if (!sym)
+  if (adaptive->integrate)
+    std::cout << "res = " << adaptive->integrate(integrand, 0, M_PI) << std::endl;
+
+  // Extended interface of the adaptive plugin, if available.
+  const double exact = (1. - std::cos(100.)) / 100. + 1. / 3.;
+  if (adaptive->integrate_batch_adaptive)
     {
-      std::cerr << "Cannot load symbol!" << std::endl;
-      std::cerr << dlerror() << std::endl;
+      for (int rule : {ADAPTIVE_GAUSS_KRONROD, ADAPTIVE_SIMPSON})
+        {
+          adaptive_options opts;
+          opts.rule = rule;
+          adaptive_stats stats;
 
-      return 1;
+          const double a = 0., b = 1.;
+          double       value;
+
+          const auto start = std::chrono::steady_clock::now();
+          adaptive->integrate_batch_adaptive(oscillatory, nullptr, &a, &b, &value, 1, &opts, &stats);
+          const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+          std::cout << (rule == ADAPTIVE_SIMPSON ? "Simpson:        " : "Gauss-Kronrod:  ")
+                    << "error " << std::abs(value - exact) << " (estimate "
+                    << stats.error << "), " << stats.evaluations
+                    << " evaluations, " << stats.intervals << " intervals, "
+                    << elapsed.count() << " [s]" << std::endl;
+        }
     }
 
-  double (*integrate)(std::function<double(double)>, double, double);
-  integrate = reinterpret_cast<decltype(integrate)>(sym);
+  // Cheapest rule for each tolerance.
+  for (double tol : {1e-3, 1e-6, 1e-9, 1e-12})
+    {
+      const auto choice = registry.select(oscillatory, nullptr, 0., 1., tol);
+
+      double value;
+      if (quadrature::integrate(choice, oscillatory, nullptr, 0., 1., tol, value) != 0)
+        {
+          std::cerr << "Integration failed for tol = " << tol << std::endl;
+          continue;
+        }
+
+      std::cout << "tol = " << tol << ": " << choice.r->name << " on "
+                << choice.n_intervals << " intervals (predicted cost "
+                << choice.cost << "), error " << std::abs(value - exact)
+                << std::endl;
+    }
+
+  // Multi-dimensional integrals, with every cubature plugin and method.
+  for (const auto &r : registry.rules())
+    {
+      if (!r->integrate_cubature)
+        continue;
+
+      for (size_t dim : {4, 6, 8, 10})
+        {
+          const std::vector<double> lower(dim, 0.), upper(dim, 1.);
+          const double exact = std::pow(std::sqrt(M_PI) / 2. * std::erf(1.), dim);
+
+          const cubature_options methods[] = {{CUBATURE_GAUSS, 4, 0, 1024},
+                                              {CUBATURE_SMOLYAK, 5, 0, 1024},
+                                              {CUBATURE_SOBOL, 14, 0, 1024}};
+          for (const auto &opts : methods)
+            {
+              double value, estimate;
+              size_t evaluations;
 
-  double res = integrate(integrand, 0, M_PI);
+              const auto start = std::chrono::steady_clock::now();
+              if (r->integrate_cubature(gaussian, nullptr, dim, lower.data(), upper.data(),
+                                        &opts, &value, &estimate, &evaluations) != 0)
+                continue;
+              const std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+
+              static const char *names[] = {"Gauss  ", "Smolyak", "Sobol  "};
+              std::cout << r->name << ", dim " << dim << ", " << names[opts.method]
+                        << ": error " << std::abs(value - exact) << " (estimate "
+                        << estimate << "), " << evaluations << " evaluations, "
+                        << elapsed.count() << " [s]" << std::endl;
+            }
+        }
+    }
 
-  std::cout << "res = " << res << std::endl;
+  // Throughput of the two plugin interfaces.
+  for (const auto &r : registry.rules())
+    benchmark(*r, r->info.order > 0 ? 1 << 22 : 1 << 12);
 
   return 0;
 }
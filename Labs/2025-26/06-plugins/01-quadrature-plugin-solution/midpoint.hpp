@@ -3,6 +3,8 @@
 
 #include <functional>
 
+#include "quadrature_abi.hpp"
+
 extern "C"
 {
   double
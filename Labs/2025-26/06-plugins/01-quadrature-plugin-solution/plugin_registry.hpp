@@ -0,0 +1,408 @@
+#ifndef HAVE_PLUGIN_REGISTRY_HPP
+#define HAVE_PLUGIN_REGISTRY_HPP
+
+#include <dlfcn.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "adaptive_quadrature.hpp"
+#include "quadrature_abi.hpp"
+
+/**
+ * Registry of the quadrature plugins found in a directory.
+ *
+ * Every plugin is loaded once (RTLD_NOW, so that missing symbols show
+ * up at load time rather than in the middle of a job) and its entry
+ * points are resolved once and cached in a 'rule': lookups and calls
+ * never go through dlsym.
+ *
+ * The loaded rules form an immutable table, published through an
+ * atomic shared_ptr. refresh() builds a new table, reloading only the
+ * files that changed, and swaps it in: a caller that obtained a rule
+ * from the previous table keeps it alive (and its library mapped) for
+ * as long as it holds the shared_ptr, so a reload is safe against
+ * calls in flight. Each library is loaded from a private copy, so that
+ * rewriting the original file cannot affect a mapped one, and a new
+ * version gets a new handle even while the old one is still in use.
+ */
+namespace quadrature
+{
+  // A loaded plugin, with its cached entry points.
+  class rule
+  {
+  public:
+    using scalar_integrate_t = double (*)(std::function<double(double)>, double, double);
+    using batch_integrate_t  = decltype(&::integrate_batch);
+    using adaptive_batch_t   = decltype(&::integrate_batch_adaptive);
+    using cubature_t         = decltype(&::integrate_cubature);
+
+    rule(const rule &) = delete;
+    rule &
+    operator=(const rule &) = delete;
+
+    ~rule()
+    {
+      dlclose(handle);
+    }
+
+    // Load the plugin in 'path'; null if it is not a valid plugin of
+    // this version of the ABI, with the reason in 'error'.
+    static std::shared_ptr<const rule>
+    load(const std::filesystem::path &path, std::string &error);
+
+    std::string                     name;
+    std::filesystem::path           path;
+    std::filesystem::file_time_type mtime;
+    quadrature_rule_info            info;
+
+    scalar_integrate_t integrate       = nullptr; // Scalar ABI, optional.
+    batch_integrate_t  integrate_batch = nullptr;
+
+    // Extension of the adaptive rules, optional.
+    adaptive_batch_t integrate_batch_adaptive = nullptr;
+
+    // Multi-dimensional integration, optional.
+    cubature_t integrate_cubature = nullptr;
+
+  private:
+    rule() = default;
+
+    void *handle = nullptr;
+  };
+
+  // Rule chosen by registry::select: integrate with 'r' on a partition
+  // into 'n_intervals' intervals (a single one for adaptive rules).
+  struct choice
+  {
+    std::shared_ptr<const rule> r;
+    std::size_t                 n_intervals = 0;
+    double                      cost        = 0.; // Predicted, in integrand evaluations.
+  };
+
+  class registry
+  {
+  public:
+    explicit registry(std::filesystem::path dir)
+      : dir(std::move(dir))
+      , table(std::make_shared<const table_t>())
+    {}
+
+    // Scan the directory: load new plugins, reload the ones whose file
+    // changed, drop the ones whose file was removed. Returns the number
+    // of rules loaded or reloaded; reasons for skipping files go to
+    // 'errors', including files whose rule name is already taken by a
+    // file earlier in path order. Concurrent calls are serialized.
+    int
+    refresh(std::vector<std::string> *errors = nullptr);
+
+    // Rule called 'name', or null.
+    std::shared_ptr<const rule>
+    find(const std::string &name) const
+    {
+      const auto t  = std::atomic_load(&table);
+      const auto it = t->find(name);
+      return it == t->end() ? nullptr : it->second;
+    }
+
+    std::vector<std::shared_ptr<const rule>>
+    rules() const
+    {
+      const auto                               t = std::atomic_load(&table);
+      std::vector<std::shared_ptr<const rule>> result;
+      for (const auto &[name, r] : *t)
+        result.push_back(r);
+      return result;
+    }
+
+    // Cheapest rule expected to integrate f over [a, b] within 'tol'.
+    // Each fixed-order rule is probed on 'probe' and 2 'probe'
+    // intervals: Richardson extrapolation gives the error constant, and
+    // so the number of intervals needed. Rules that would need more than
+    // 'max_nodes' evaluations are discarded. The cost of an adaptive rule
+    // cannot be predicted without running it: it is run with the cost of
+    // the best fixed rule as a budget, and chosen if it converges within
+    // it (so at most twice the cost of the choice is spent here).
+    choice
+    select(quadrature_evaluator f,
+           void                *ctx,
+           double               a,
+           double               b,
+           double               tol,
+           double               max_nodes = 1 << 24,
+           std::size_t          probe     = 16) const;
+
+  private:
+    using table_t = std::map<std::string, std::shared_ptr<const rule>>;
+
+    std::filesystem::path          dir;
+    std::shared_ptr<const table_t> table;
+    std::mutex                     refresh_mutex;
+  };
+
+  // Integrate with the rule of 'c' on a uniform partition of [a, b];
+  // adaptive rules are asked for 'tol' if they support it. Returns 0 on
+  // success.
+  int
+  integrate(const choice        &c,
+            quadrature_evaluator f,
+            void                *ctx,
+            double               a,
+            double               b,
+            double               tol,
+            double              &result);
+
+  // Implementation.
+
+  inline std::shared_ptr<const rule>
+  rule::load(const std::filesystem::path &path, std::string &error)
+  {
+    namespace fs = std::filesystem;
+
+    // Private copy, removed as soon as it is mapped.
+    static std::atomic<int> counter{0};
+    const fs::path          copy = fs::temp_directory_path() /
+                          ("quadrature-" + std::to_string(getpid()) + "-" +
+                           std::to_string(counter++) + ".so");
+
+    std::error_code mtime_ec;
+    const auto      mtime = fs::last_write_time(path, mtime_ec);
+    if (mtime_ec)
+      {
+        error = path.string() + ": " + mtime_ec.message();
+        return nullptr;
+      }
+
+    std::error_code copy_ec;
+    if (!fs::copy_file(path, copy, fs::copy_options::overwrite_existing, copy_ec))
+      {
+        error = path.string() + ": " + copy_ec.message();
+        return nullptr;
+      }
+
+    void           *handle = dlopen(copy.c_str(), RTLD_NOW | RTLD_LOCAL);
+    std::error_code remove_ec; // A leftover copy in /tmp is harmless.
+    fs::remove(copy, remove_ec);
+    if (!handle)
+      {
+        error = dlerror();
+        return nullptr;
+      }
+
+    std::shared_ptr<rule> r(new rule());
+    r->handle = handle; // From now on, dlclose'd by the destructor.
+
+    auto version = reinterpret_cast<decltype(&::quadrature_abi_version)>(
+      dlsym(handle, "quadrature_abi_version"));
+    auto info =
+      reinterpret_cast<decltype(&::quadrature_info)>(dlsym(handle, "quadrature_info"));
+    r->integrate_batch =
+      reinterpret_cast<rule::batch_integrate_t>(dlsym(handle, "integrate_batch"));
+
+    if (!version || version() != QUADRATURE_ABI_VERSION || !info || !r->integrate_batch)
+      {
+        error = path.string() + ": not a quadrature plugin of ABI version " +
+                std::to_string(QUADRATURE_ABI_VERSION);
+        return nullptr;
+      }
+
+    r->integrate =
+      reinterpret_cast<rule::scalar_integrate_t>(dlsym(handle, "integrate"));
+    r->integrate_batch_adaptive = reinterpret_cast<rule::adaptive_batch_t>(
+      dlsym(handle, "integrate_batch_adaptive"));
+    r->integrate_cubature =
+      reinterpret_cast<rule::cubature_t>(dlsym(handle, "integrate_cubature"));
+
+    r->info  = *info();
+    r->name  = r->info.name;
+    r->path  = path;
+    r->mtime = mtime;
+
+    return r;
+  }
+
+  inline int
+  registry::refresh(std::vector<std::string> *errors)
+  {
+    namespace fs = std::filesystem;
+
+    std::lock_guard<std::mutex> lock(refresh_mutex);
+
+    const auto old_table = std::atomic_load(&table);
+
+    // Rules of the current table, by file.
+    std::map<fs::path, std::shared_ptr<const rule>> by_path;
+    for (const auto &[name, r] : *old_table)
+      by_path[r->path] = r;
+
+    auto new_table = std::make_shared<table_t>();
+    int  n_loaded  = 0;
+
+    // Two files providing the same name: the first one (in the order of
+    // the paths) is kept, the other one is reported.
+    const auto insert = [&new_table, errors](std::shared_ptr<const rule> r) {
+      const auto [it, inserted] = new_table->emplace(r->name, r);
+      if (!inserted && errors)
+        errors->push_back(r->path.string() + ": rule '" + r->name +
+                          "' already provided by " + it->second->path.string());
+      return inserted;
+    };
+
+    // The plugins, sorted so that duplicates are resolved the same way
+    // on every refresh.
+    std::vector<fs::path> paths;
+    std::error_code       dir_ec;
+    for (const auto &entry : fs::directory_iterator(dir, dir_ec))
+      {
+        std::error_code type_ec;
+        if (entry.is_regular_file(type_ec) && entry.path().extension() == ".so")
+          paths.push_back(entry.path());
+      }
+    std::sort(paths.begin(), paths.end());
+
+    if (dir_ec && errors)
+      errors->push_back(dir.string() + ": " + dir_ec.message());
+
+    for (const auto &path : paths)
+      {
+        const auto      old = by_path.find(path);
+        std::error_code mtime_ec;
+        const auto      mtime = fs::last_write_time(path, mtime_ec);
+        if (old != by_path.end() && !mtime_ec && old->second->mtime == mtime)
+          {
+            insert(old->second);
+            continue;
+          }
+
+        std::string error;
+        if (auto r = rule::load(path, error))
+          {
+            if (insert(r))
+              ++n_loaded;
+          }
+        else
+          {
+            // E.g. a file being rewritten: keep the previous version.
+            if (old != by_path.end())
+              insert(old->second);
+            if (errors)
+              errors->push_back(error);
+          }
+      }
+
+    std::atomic_store(&table, std::shared_ptr<const table_t>(std::move(new_table)));
+
+    return n_loaded;
+  }
+
+  inline choice
+  registry::select(quadrature_evaluator f,
+                   void                *ctx,
+                   double               a,
+                   double               b,
+                   double               tol,
+                   double               max_nodes,
+                   std::size_t          probe) const
+  {
+    choice best;
+    std::vector<std::shared_ptr<const rule>> adaptive;
+
+    for (const auto &r : rules())
+      {
+        const auto &info = r->info;
+
+        if (info.order <= 0)
+          {
+            adaptive.push_back(r);
+            continue;
+          }
+
+        double coarse, fine;
+        if (integrate({r, probe, 0.}, f, ctx, a, b, tol, coarse) != 0 ||
+            integrate({r, 2 * probe, 0.}, f, ctx, a, b, tol, fine) != 0)
+          continue;
+
+        // Error of the fine result, and intervals needed for 'tol'.
+        const double error = std::abs(fine - coarse) / (std::pow(2., info.order) - 1.);
+        const double n     = std::max(1., std::ceil(2. * probe * std::pow(error / tol, 1. / info.order)));
+        const double cost  = n * info.nodes_per_interval * info.cost_per_node;
+
+        if (n * info.nodes_per_interval <= max_nodes && (!best.r || cost < best.cost))
+          best = {r, static_cast<std::size_t>(n), cost};
+      }
+
+    for (const auto &r : adaptive)
+      {
+        const double budget = best.r ? best.cost / r->info.cost_per_node : max_nodes;
+        if (!r->integrate_batch_adaptive)
+          {
+            if (!best.r)
+              best = {r, 1, budget * r->info.cost_per_node};
+            continue;
+          }
+
+        adaptive_options opts;
+        opts.abs_tol         = tol;
+        opts.max_evaluations = std::max(1., budget);
+
+        adaptive_stats stats;
+        double         value;
+        if (r->integrate_batch_adaptive(f, ctx, &a, &b, &value, 1, &opts, &stats) != 0 ||
+            !stats.converged)
+          continue;
+
+        const double cost = stats.evaluations * r->info.cost_per_node;
+        if (!best.r || cost < best.cost)
+          best = {r, 1, cost};
+      }
+
+    return best;
+  }
+
+  inline int
+  integrate(const choice        &c,
+            quadrature_evaluator f,
+            void                *ctx,
+            double               a,
+            double               b,
+            double               tol,
+            double              &result)
+  {
+    if (!c.r)
+      return 1;
+
+    if (c.r->info.order <= 0 && c.r->integrate_batch_adaptive)
+      {
+        adaptive_options opts;
+        opts.abs_tol = tol;
+        return c.r->integrate_batch_adaptive(f, ctx, &a, &b, &result, 1, &opts, nullptr);
+      }
+
+    const std::size_t   n = std::max<std::size_t>(c.n_intervals, 1);
+    std::vector<double> x0(n), x1(n), values(n);
+    for (std::size_t i = 0; i < n; ++i)
+      {
+        x0[i] = a + (b - a) * i / n;
+        x1[i] = a + (b - a) * (i + 1) / n;
+      }
+
+    const int ierr = c.r->integrate_batch(f, ctx, x0.data(), x1.data(), values.data(), n);
+
+    result = 0.;
+    for (const auto &v : values)
+      result += v;
+
+    return ierr;
+  }
+} // namespace quadrature
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef HAVE_QUADRATURE_ABI_HPP
+#define HAVE_QUADRATURE_ABI_HPP
+
+#include <stddef.h>
+
+/*
+ * Batched plugin interface, usable from C.
+ *
+ * A plugin exports 'quadrature_abi_version', returning the version of
+ * this interface it implements: the host must check it before looking
+ * up the other symbols. Any incompatible change bumps the version;
+ * optional entry points, which the host looks up with dlsym and may
+ * find missing, are added without bumping it.
+ *
+ * The integrand is a batch evaluator: instead of one type-erased call
+ * per node, the plugin collects the nodes of many intervals and calls
+ * it once, so that the integrand can be a vectorized loop.
+ *
+ * Version history:
+ *  1. quadrature_abi_version, integrate_batch.
+ *  2. quadrature_info (rule metadata).
+ *
+ * Optional entry points: integrate (scalar interface),
+ * integrate_batch_adaptive (adaptive_quadrature.hpp) and
+ * integrate_cubature (multi-dimensional integrals).
+ */
+#define QUADRATURE_ABI_VERSION 2
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+  /* y[i] = f(x[i]) for i < n; 'ctx' is passed through unchanged. */
+  typedef void (*quadrature_evaluator)(const double *x,
+                                       double       *y,
+                                       size_t        n,
+                                       void         *ctx);
+
+  /* Metadata of a rule, used by the host to choose among plugins. */
+  typedef struct
+  {
+    /* Short name, unique among the plugins. */
+    const char *name;
+    /* Order of convergence: the error is O(h^order) on intervals of
+       width h. 0 for adaptive rules, which meet a tolerance by
+       themselves. */
+    int order;
+    /* Evaluations of the integrand per interval of a partition (for
+       adaptive rules, per interval of the initial partition). */
+    double nodes_per_interval;
+    /* Cost of a node relative to one evaluation of the integrand,
+       including the work of the rule itself (e.g. 1 for a fixed rule,
+       more for an adaptive one that manages a heap). */
+    double cost_per_node;
+  } quadrature_rule_info;
+
+  int
+  quadrature_abi_version(void);
+
+  const quadrature_rule_info *
+  quadrature_info(void);
+
+  /* result[i] = integral of f over [a[i], b[i]], for i < n_intervals.
+     Returns 0 on success. */
+  int
+  integrate_batch(quadrature_evaluator f,
+                  void                *ctx,
+                  const double        *a,
+                  const double        *b,
+                  double              *result,
+                  size_t               n_intervals);
+
+  /* Multi-dimensional integrand: y[i] = f(x + i * dim) for i < n, the
+     coordinates of each point being contiguous. It may be called
+     concurrently from several threads, on different batches. */
+  typedef void (*cubature_evaluator)(const double *x,
+                                     double       *y,
+                                     size_t        n,
+                                     size_t        dim,
+                                     void         *ctx);
+
+  enum cubature_method
+  {
+    CUBATURE_GAUSS   = 0, /* Tensor product of Gauss-Legendre rules */
+    CUBATURE_SMOLYAK = 1, /* Smolyak sparse grid of Clenshaw-Curtis rules */
+    CUBATURE_SOBOL   = 2  /* Randomly shifted Sobol sequence */
+  };
+
+  typedef struct
+  {
+    int method;
+    /* Gauss: points per dimension. Smolyak: level (1 is a single point).
+       Sobol: log2 of the number of points of each shift. */
+    int level;
+    /* Threads evaluating the batches (0: OpenMP default), and points per
+       batch. */
+    int    n_threads;
+    size_t batch;
+  } cubature_options;
+
+  /* Integral of f over the hyperrectangle [lower, upper] of dimension
+     'dim', with an error estimate and the number of evaluations of f.
+     'error' and 'evaluations' may be null. Returns 0 on success. */
+  int
+  integrate_cubature(cubature_evaluator      f,
+                     void                   *ctx,
+                     size_t                  dim,
+                     const double           *lower,
+                     const double           *upper,
+                     const cubature_options *opts,
+                     double                 *result,
+                     double                 *error,
+                     size_t                 *evaluations);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
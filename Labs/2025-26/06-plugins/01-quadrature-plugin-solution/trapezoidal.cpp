@@ -1,9 +1,64 @@
 #include "trapezoidal.hpp"
 
 #include <cmath>
+#include <new>
+#include <vector>
 
 double
 integrate(std::function<double(double)> f, double a, double b)
 {
   return ((b - a) * (.5 * f(b) + .5 * f(a)));
 }
+
+int
+quadrature_abi_version(void)
+{
+  return QUADRATURE_ABI_VERSION;
+}
+
+const quadrature_rule_info *
+quadrature_info(void)
+{
+  // On a partition, consecutive intervals share an endpoint.
+  static const quadrature_rule_info info = {"trapezoidal", 2, 1., 1.};
+
+  return &info;
+}
+
+int
+integrate_batch(quadrature_evaluator f,
+                void                *ctx,
+                const double        *a,
+                const double        *b,
+                double              *result,
+                size_t               n_intervals)
+{
+  try
+    {
+      // Nodes of all the intervals. When an interval starts where the
+      // previous one ends (e.g. a partition), the shared endpoint is
+      // evaluated once: first[i] is the index of a[i] in 'x'.
+      std::vector<double> x;
+      std::vector<size_t> first(n_intervals);
+      x.reserve(2 * n_intervals);
+      for (size_t i = 0; i < n_intervals; ++i)
+        {
+          if (i == 0 || a[i] != b[i - 1])
+            x.push_back(a[i]);
+          first[i] = x.size() - 1;
+          x.push_back(b[i]);
+        }
+
+      std::vector<double> y(x.size());
+      f(x.data(), y.data(), x.size(), ctx);
+
+      for (size_t i = 0; i < n_intervals; ++i)
+        result[i] = (b[i] - a[i]) * (.5 * y[first[i] + 1] + .5 * y[first[i]]);
+    }
+  catch (const std::bad_alloc &)
+    {
+      return 1;
+    }
+
+  return 0;
+}
@@ -1,30 +1,93 @@
 #include <mpi.h>
 #include <omp.h>
 
+#include <algorithm>
 #include <cmath>
-#include <ctime>
 #include <iomanip>
 #include <iostream>
+#include <string>
+#include <vector>
 
-static clock_t c_start, c_diff;
-static double  c_sec;
-#define tic() c_start = clock();
-#define toc(x)                                      \
-  c_diff = clock() - c_start;                       \
-  c_sec  = (double)c_diff / (double)CLOCKS_PER_SEC; \
-  std::cout << x << c_sec << " [s]" << std::endl;
+// Number of independent partial sums in the inner loop (compile-time,
+// e.g. -DPI_UNROLL=16).
+#ifndef PI_UNROLL
+#  define PI_UNROLL 8
+#endif
 
 /**
  * This exercise presents a simple program to determine the value of
  * pi. The algorithm suggested here is chosen for its simplicity. The
  * method evaluates the integral of 4 / (1 + x^2) between 0 and 1
- * using the composite midpoint rule. Each process adds up every
- * n-th interval. Finally, the sums computed by each process are
+ * using the composite midpoint rule. The intervals are split among the
+ * processes and the threads, and the sums computed by each process are
  * added together using a reduction.
  *
  * This example makes use of hybrid shared/distributed parallelization
- * through OpenMP and MPI.
+ * through OpenMP and MPI. The last bits of the result change with the
+ * number of processes and threads, since the partial sums are grouped
+ * differently: see 10-reproducible_sum.cpp for a reproducible sum.
+ *
+ * Two distributions of the n intervals are available:
+ *  - block (default): each process takes a contiguous block of
+ *    intervals, and splits it into contiguous blocks, one per thread.
+ *    Each thread runs midpoint_sum on its block: the inner loop
+ *    evaluates PI_UNROLL consecutive midpoints at a time into as many
+ *    independent partial sums, so that it is vectorized ("omp simd")
+ *    and the additions do not wait for each other;
+ *  - cyclic: process r takes the intervals r, r + size, r + 2 size, ...
+ *    and an "omp parallel for" splits them among the threads. The
+ *    strided indices prevent vectorization.
+ * Counts are 64-bit, so n can reach 10^12 and beyond.
+ *
+ * Usage: mpirun -n <ranks> ./06-pi [n (default: 1e8)] [block|cyclic]
+ *
+ * The times are wall-clock times (MPI_Wtime: clock() would sum the CPU
+ * time of all the OpenMP threads) of the local sums. Rank 0 prints
+ * those of all the ranks, their imbalance (max / mean - 1), and ends
+ * with a timing record (the time of the slowest rank) for the scaling
+ * driver in 05-PBS-algorithms_and_execution_policies/PBS.
  */
+
+// First index of block 'part' of [0, n) split into 'n_parts' blocks
+// whose sizes differ at most by one.
+unsigned long
+block_begin(unsigned long n, unsigned long n_parts, unsigned long part)
+{
+  return n / n_parts * part + std::min(part, n % n_parts);
+}
+
+// Sum of 4 / (1 + x_i^2) for the midpoints x_i = h (i + 0.5) of the
+// intervals i in [first, last).
+template <int unroll>
+double
+midpoint_sum(unsigned long first, unsigned long last, double h)
+{
+  double        sums[unroll] = {};
+  unsigned long i            = first;
+
+  for (; i + unroll <= last; i += unroll)
+    {
+      // Exact up to 2^53 intervals.
+      const double base = i + 0.5;
+#pragma omp simd
+      for (int u = 0; u < unroll; ++u)
+        {
+          const double x = h * (base + u);
+          sums[u] += 4.0 / (1.0 + x * x);
+        }
+    }
+  for (; i < last; ++i)
+    {
+      const double x = h * (i + 0.5);
+      sums[0] += 4.0 / (1.0 + x * x);
+    }
+
+  double sum = 0.0;
+  for (int u = 0; u < unroll; ++u)
+    sum += sums[u];
+  return sum;
+}
+
 int
 main(int argc, char **argv)
 {
@@ -38,49 +101,81 @@ main(int argc, char **argv)
   int mpi_size;
   MPI_Comm_size(mpi_comm, &mpi_size);
 
+  const unsigned long n      = argc > 1 ? std::stod(argv[1]) : 1e8;
+  const bool          cyclic = argc > 2 && std::string(argv[2]) == "cyclic";
+  const double        h      = 1.0 / n;
+
 #pragma omp parallel master
   if (mpi_rank == 0)
     std::cout << "Number of processes: " << mpi_size
               << ", number of threads: " << omp_get_num_threads()
-              << std::endl;
-
-  tic();
+              << ", distribution: " << (cyclic ? "cyclic" : "block")
+              << ", unroll: " << PI_UNROLL << std::endl;
 
-  const unsigned int n = 1e8;
-  const double       h = 1.0 / n;
+  const double t_start = MPI_Wtime();
 
   double sum = 0.0;
 
+  if (cyclic)
+    {
 #pragma omp parallel for reduction(+ : sum)
-  for (unsigned int i = mpi_rank + 1; i <= n; i += mpi_size)
+      for (unsigned long i = mpi_rank; i < n; i += mpi_size)
+        {
+          const double x = h * (i + 0.5);
+          sum += 4.0 / (1.0 + x * x);
+        }
+    }
+  else
     {
-      double x = h * (i - 0.5);
-      sum += 4.0 / (1.0 + x * x);
+      const unsigned long first = block_begin(n, mpi_size, mpi_rank);
+      const unsigned long last  = block_begin(n, mpi_size, mpi_rank + 1);
+
+#pragma omp parallel reduction(+ : sum)
+      {
+        const unsigned long n_threads = omp_get_num_threads();
+        const unsigned long thread    = omp_get_thread_num();
+        sum += midpoint_sum<PI_UNROLL>(
+          first + block_begin(last - first, n_threads, thread),
+          first + block_begin(last - first, n_threads, thread + 1),
+          h);
+      }
     }
 
+  const double t_local = MPI_Wtime() - t_start;
+
   double pi_local = h * sum;
 
   double pi;
   MPI_Reduce(&pi_local, &pi, 1, MPI_DOUBLE, MPI_SUM, 0, mpi_comm);
 
+  // The time of every rank, on rank 0.
+  std::vector<double> times(mpi_rank == 0 ? mpi_size : 0);
+  MPI_Gather(&t_local, 1, MPI_DOUBLE, times.data(), 1, MPI_DOUBLE, 0, mpi_comm);
+
   if (mpi_rank == 0)
     {
       std::cout << std::setprecision(16) << "pi = " << pi
                 << ", error = "
                 << std::fabs(pi - 3.141592653589793238462643)
-                << std::endl;
-    }
-
-  // Trick to get output sorted by rank id.
-  MPI_Barrier(mpi_comm);
-  for (int rank = 0; rank < mpi_size; ++rank)
-    {
-      if (mpi_rank == rank)
-        {
-          toc("Time elapsed on rank " + std::to_string(rank) + ": ");
-        }
-
-      MPI_Barrier(mpi_comm);
+                << std::endl
+                << std::setprecision(6);
+
+      for (int rank = 0; rank < mpi_size; ++rank)
+        std::cout << "Time elapsed on rank " << rank << ": " << times[rank]
+                  << " [s]" << std::endl;
+
+      const double t_max  = *std::max_element(times.begin(), times.end());
+      double       t_mean = 0.0;
+      for (double t : times)
+        t_mean += t / mpi_size;
+      std::cout << "Load imbalance (max / mean - 1): "
+                << (t_mean > 0.0 ? t_max / t_mean - 1.0 : 0.0)
+                << ", throughput: " << n / t_max / 1e9
+                << " G intervals/s" << std::endl;
+
+      std::cout << "TIMING app=pi ranks=" << mpi_size
+                << " threads=" << omp_get_max_threads() << " size=" << n
+                << " seconds=" << t_max << std::endl;
     }
 
   MPI_Finalize();
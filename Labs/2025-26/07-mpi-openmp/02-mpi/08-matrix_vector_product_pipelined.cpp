@@ -0,0 +1,238 @@
+#include <mpi.h>
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gemv.hpp"
+
+/**
+ * Distributed, pipelined matrix-vector product.
+ *
+ * Unlike 07-matrix_vector_product.cpp, no rank ever holds the whole
+ * matrix or the whole vector: each rank generates its own block of
+ * rows of the matrix and its own block of entries of the vector.
+ * Entries are a function of their global indices only, so the
+ * result does not depend on the number of ranks.
+ *
+ * The vector blocks travel around a ring of ranks: at every step
+ * each rank posts a non-blocking receive of the next block from its
+ * right neighbour (and a non-blocking send of the current one to its
+ * left neighbour) and, meanwhile, multiplies the matching columns of
+ * its rows by the block it already has. After mpi_size steps every
+ * rank has seen the whole vector. The result is then collected on
+ * rank 0 with a blocking MPI_Gatherv: once the last block is
+ * multiplied there is no computation left to overlap it with.
+ *
+ * Timings are wall-clock (MPI_Wtime): clock() would sum the CPU time
+ * of all the OpenMP threads.
+ *
+ * Usage: mpirun -n <ranks> ./08-matrix_vector_product_pipelined <n_rows> <n_cols>
+ */
+
+// Pseudo-random number in [0, 1) depending only on 'index' (splitmix64).
+double
+random_entry(std::uint64_t index)
+{
+  std::uint64_t z = index + 0x9e3779b97f4a7c15ULL;
+  z               = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z               = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z               = z ^ (z >> 31);
+  return (z >> 11) * 0x1.0p-53;
+}
+
+double
+matrix_entry(std::uint64_t i, std::uint64_t j, std::uint64_t n_cols)
+{
+  return random_entry(2 * (i * n_cols + j));
+}
+
+double
+vector_entry(std::uint64_t j)
+{
+  return random_entry(2 * j + 1);
+}
+
+// Number of items and first item of block 'rank' when splitting 'n'
+// items among 'size' ranks (the first 'n % size' blocks get one more).
+void
+block_range(unsigned long  n,
+            int            size,
+            int            rank,
+            unsigned long &count,
+            unsigned long &start)
+{
+  const unsigned long base      = n / size;
+  const unsigned long remainder = n % size;
+
+  count = base + (static_cast<unsigned long>(rank) < remainder ? 1 : 0);
+  start = rank * base + std::min<unsigned long>(rank, remainder);
+}
+
+int
+main(int argc, char **argv)
+{
+  MPI_Init(&argc, &argv);
+
+  MPI_Comm mpi_comm = MPI_COMM_WORLD;
+
+  int mpi_rank;
+  MPI_Comm_rank(mpi_comm, &mpi_rank);
+
+  int mpi_size;
+  MPI_Comm_size(mpi_comm, &mpi_size);
+
+  if (argc < 3)
+    {
+      if (mpi_rank == 0)
+        std::cerr << "Usage: " << argv[0] << " <n_rows> <n_cols>"
+                  << std::endl;
+
+      MPI_Finalize();
+      return 1;
+    }
+
+  const unsigned long n_rows = std::stoul(argv[1]);
+  const unsigned long n_cols = std::stoul(argv[2]);
+
+#pragma omp parallel master
+  if (mpi_rank == 0)
+    std::cout << "Number of processes: " << mpi_size
+              << ", number of threads: " << omp_get_num_threads()
+              << std::endl;
+
+  // Local block of rows.
+  unsigned long n_rows_local, row_start;
+  block_range(n_rows, mpi_size, mpi_rank, n_rows_local, row_start);
+
+  // Local block of the vector: block 'r' of the columns belongs to rank 'r'.
+  unsigned long n_cols_local, col_start;
+  block_range(n_cols, mpi_size, mpi_rank, n_cols_local, col_start);
+
+  const int max_block = (n_cols + mpi_size - 1) / mpi_size;
+
+  // Each rank generates its own data (in parallel, first-touching it
+  // with the same threads that will use it).
+  std::vector<double> matrix_local(n_rows_local * n_cols);
+  std::vector<double> current(max_block), next(max_block);
+
+#pragma omp parallel for
+  for (unsigned long i = 0; i < n_rows_local; ++i)
+    for (unsigned long j = 0; j < n_cols; ++j)
+      matrix_local[i * n_cols + j] = matrix_entry(row_start + i, j, n_cols);
+
+  for (unsigned long j = 0; j < n_cols_local; ++j)
+    current[j] = vector_entry(col_start + j);
+
+  std::vector<double> result_local(n_rows_local, 0.0);
+
+  MPI_Barrier(mpi_comm);
+  const double t_start = MPI_Wtime();
+
+  const int left  = (mpi_rank + mpi_size - 1) % mpi_size;
+  const int right = (mpi_rank + 1) % mpi_size;
+
+  double t_wait = 0.0;
+
+  // At step s this rank holds the vector block of rank (mpi_rank + s) % mpi_size.
+  for (int s = 0; s < mpi_size; ++s)
+    {
+      const int owner = (mpi_rank + s) % mpi_size;
+
+      MPI_Request requests[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+      if (s < mpi_size - 1)
+        {
+          MPI_Irecv(next.data(), max_block, MPI_DOUBLE, right, s, mpi_comm, &requests[0]);
+          MPI_Isend(current.data(), max_block, MPI_DOUBLE, left, s, mpi_comm, &requests[1]);
+        }
+
+      unsigned long block_cols, block_start;
+      block_range(n_cols, mpi_size, owner, block_cols, block_start);
+
+      // Partial product with the columns of the current block.
+      gemv(n_rows_local,
+           block_cols,
+           matrix_local.data() + block_start,
+           n_cols,
+           current.data(),
+           result_local.data());
+
+      const double t_wait_start = MPI_Wtime();
+      MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+      t_wait += MPI_Wtime() - t_wait_start;
+
+      std::swap(current, next);
+    }
+
+  // Collect the result on rank 0.
+  std::vector<int> recv_counts, recv_start_idx;
+  std::vector<double> result;
+  if (mpi_rank == 0)
+    {
+      result.resize(n_rows);
+      recv_counts.resize(mpi_size);
+      recv_start_idx.resize(mpi_size);
+      for (int r = 0; r < mpi_size; ++r)
+        {
+          unsigned long count, start;
+          block_range(n_rows, mpi_size, r, count, start);
+          recv_counts[r]    = count;
+          recv_start_idx[r] = start;
+        }
+    }
+
+  MPI_Gatherv(result_local.data(),
+              n_rows_local,
+              MPI_DOUBLE,
+              result.data(),
+              recv_counts.data(),
+              recv_start_idx.data(),
+              MPI_DOUBLE,
+              0,
+              mpi_comm);
+
+  const double t_local = MPI_Wtime() - t_start;
+
+  double t_max;
+  MPI_Reduce(&t_local, &t_max, 1, MPI_DOUBLE, MPI_MAX, 0, mpi_comm);
+
+  if (mpi_rank == 0)
+    {
+      // Spot check: recompute a few rows from the generating functions.
+      double max_error = 0.0;
+      for (unsigned long i : {0UL, n_rows / 2, n_rows - 1})
+        {
+          double sum = 0.0;
+          for (unsigned long j = 0; j < n_cols; ++j)
+            sum += matrix_entry(i, j, n_cols) * vector_entry(j);
+
+          max_error = std::max(max_error, std::abs(sum - result[i]) / std::abs(sum));
+        }
+
+      std::cout << "Relative error on check rows: " << max_error << std::endl;
+      std::cout << "Time elapsed (max over ranks): " << t_max << " [s], "
+                << 2.0 * n_rows * n_cols / t_max * 1e-9 << " GFLOP/s"
+                << std::endl;
+    }
+
+  // Trick to get output sorted by rank id.
+  for (int rank = 0; rank < mpi_size; ++rank)
+    {
+      if (mpi_rank == rank)
+        std::cout << "Rank " << rank << ": " << n_rows_local
+                  << " rows, time elapsed " << t_local
+                  << " [s], waiting for vector blocks " << t_wait << " [s]"
+                  << std::endl;
+
+      MPI_Barrier(mpi_comm);
+    }
+
+  MPI_Finalize();
+
+  return 0;
+}
@@ -0,0 +1,295 @@
+#include <mpi.h>
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gemv.hpp"
+
+/**
+ * Matrix-vector products y = A x and z = A^T y with a 2D block-cyclic
+ * distribution of the matrix.
+ *
+ * The ranks are arranged in a pr x pc grid (MPI_Dims_create) and
+ * split into row and column sub-communicators (MPI_Comm_split).
+ * Blocks of nb x nb entries are dealt cyclically: global row i lives
+ * on process row (i / nb) % pr, global column j on process column
+ * (j / nb) % pc.
+ *
+ * The vectors are distributed over all the ranks, O(n / p) entries
+ * each. To compute y = A x:
+ *  1. the ranks of a process column gather the entries of x matching
+ *     their local columns (MPI_Allgatherv on the column communicator,
+ *     O(n / pc) data per rank);
+ *  2. each rank multiplies its local block (OpenMP, gemv.hpp);
+ *  3. the partial results of a process row are summed and scattered
+ *     back to its ranks (MPI_Reduce_scatter on the row communicator,
+ *     O(n / pr) data per rank).
+ * The output of A x is distributed like the input of A^T y, which
+ * runs the same steps with the roles of rows and columns swapped.
+ *
+ * Matrix and vector entries depend on their global indices only, so
+ * results can be checked independently of the number of ranks.
+ *
+ * Usage: mpirun -n <ranks> ./09-matrix_vector_product_2d <n_rows> <n_cols> [nb] [n_iter]
+ *
+ * The matrix may have fewer blocks than the grid has process rows or
+ * columns: the ranks left without a block only take part in the
+ * collectives, e.g.
+ *   mpirun -n 4 ./09-matrix_vector_product_2d 100 64
+ *   mpirun -n 4 ./09-matrix_vector_product_2d 3 5 64 1
+ */
+
+// Pseudo-random number in [0, 1) depending only on 'index' (splitmix64).
+double
+random_entry(std::uint64_t index)
+{
+  std::uint64_t z = index + 0x9e3779b97f4a7c15ULL;
+  z               = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z               = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z               = z ^ (z >> 31);
+  return (z >> 11) * 0x1.0p-53;
+}
+
+double
+matrix_entry(std::uint64_t i, std::uint64_t j, std::uint64_t n_cols)
+{
+  return random_entry(2 * (i * n_cols + j));
+}
+
+double
+vector_entry(std::uint64_t j)
+{
+  return random_entry(2 * j + 1);
+}
+
+// Number of rows (or columns) of a block-cyclic distribution of 'n'
+// items in blocks of 'nb' owned by process 'iproc' out of 'nprocs'.
+long
+numroc(long n, long nb, int iproc, int nprocs)
+{
+  const long n_blocks = n / nb;
+  const long extra    = n_blocks % nprocs;
+
+  long count = (n_blocks / nprocs) * nb;
+  if (iproc < extra)
+    count += nb;
+  else if (iproc == extra)
+    count += n % nb;
+
+  return count;
+}
+
+// Global index of local index 'l' of process 'iproc' out of 'nprocs'.
+long
+local_to_global(long l, long nb, int iproc, int nprocs)
+{
+  return ((l / nb) * nprocs + iproc) * nb + l % nb;
+}
+
+// Contiguous split of 'n' local items among the 'size' ranks of a
+// sub-communicator: counts and displacements for the v-collectives.
+void
+split_counts(long n, int size, std::vector<int> &counts, std::vector<int> &displs)
+{
+  counts.resize(size);
+  displs.resize(size);
+  for (int r = 0, start = 0; r < size; ++r)
+    {
+      counts[r] = n / size + (r < n % size ? 1 : 0);
+      displs[r] = start;
+      start += counts[r];
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+  MPI_Init(&argc, &argv);
+
+  MPI_Comm mpi_comm = MPI_COMM_WORLD;
+
+  int mpi_rank;
+  MPI_Comm_rank(mpi_comm, &mpi_rank);
+
+  int mpi_size;
+  MPI_Comm_size(mpi_comm, &mpi_size);
+
+  if (argc < 3)
+    {
+      if (mpi_rank == 0)
+        std::cerr << "Usage: " << argv[0] << " <n_rows> <n_cols> [nb] [n_iter]"
+                  << std::endl;
+
+      MPI_Finalize();
+      return 1;
+    }
+
+  const long n_rows = std::stol(argv[1]);
+  const long n_cols = std::stol(argv[2]);
+  const long nb     = argc > 3 ? std::stol(argv[3]) : 64;
+  const int  n_iter = argc > 4 ? std::stoi(argv[4]) : 10;
+
+  // Process grid and sub-communicators.
+  int dims[2] = {0, 0};
+  MPI_Dims_create(mpi_size, 2, dims);
+  const int pr = dims[0], pc = dims[1];
+  const int my_row = mpi_rank / pc, my_col = mpi_rank % pc;
+
+  MPI_Comm row_comm, col_comm;
+  MPI_Comm_split(mpi_comm, my_row, my_col, &row_comm); // Ranks sharing rows.
+  MPI_Comm_split(mpi_comm, my_col, my_row, &col_comm); // Ranks sharing columns.
+
+#pragma omp parallel master
+  if (mpi_rank == 0)
+    std::cout << "Number of processes: " << mpi_size << " (" << pr << " x "
+              << pc << " grid, blocks " << nb << " x " << nb
+              << "), number of threads: " << omp_get_num_threads()
+              << std::endl;
+
+  // Local block of the matrix.
+  const long n_rows_local = numroc(n_rows, nb, my_row, pr);
+  const long n_cols_local = numroc(n_cols, nb, my_col, pc);
+
+  std::vector<double> matrix_local(n_rows_local * n_cols_local);
+
+#pragma omp parallel for
+  for (long i = 0; i < n_rows_local; ++i)
+    {
+      const long gi = local_to_global(i, nb, my_row, pr);
+      for (long j = 0; j < n_cols_local; ++j)
+        matrix_local[i * n_cols_local + j] =
+          matrix_entry(gi, local_to_global(j, nb, my_col, pc), n_cols);
+    }
+
+  // The local columns of a process column are split among its pr
+  // ranks (input of A x, output of A^T y); the local rows of a process
+  // row among its pc ranks (output of A x, input of A^T y).
+  std::vector<int> col_counts, col_displs, row_counts, row_displs;
+  split_counts(n_cols_local, pr, col_counts, col_displs);
+  split_counts(n_rows_local, pc, row_counts, row_displs);
+
+  std::vector<double> x_piece(col_counts[my_row]);
+  for (int j = 0; j < col_counts[my_row]; ++j)
+    x_piece[j] = vector_entry(local_to_global(col_displs[my_row] + j, nb, my_col, pc));
+
+  std::vector<double> x_local(n_cols_local), y_partial(n_rows_local);
+  std::vector<double> y_piece(row_counts[my_col]);
+  std::vector<double> y_local(n_rows_local), z_partial(n_cols_local);
+  std::vector<double> z_piece(col_counts[my_row]);
+
+  double t_ax = 0.0, t_atx = 0.0;
+  for (int it = 0; it < n_iter; ++it)
+    {
+      // y = A x.
+      MPI_Barrier(mpi_comm);
+      double t_start = MPI_Wtime();
+
+      MPI_Allgatherv(x_piece.data(), col_counts[my_row], MPI_DOUBLE,
+                     x_local.data(), col_counts.data(), col_displs.data(),
+                     MPI_DOUBLE, col_comm);
+
+      // A rank whose process row or column owns no block (e.g. more
+      // process columns than column blocks) has nothing to multiply.
+      std::fill(y_partial.begin(), y_partial.end(), 0.0);
+      if (n_rows_local > 0 && n_cols_local > 0)
+        gemv(n_rows_local,
+             n_cols_local,
+             matrix_local.data(),
+             n_cols_local,
+             x_local.data(),
+             y_partial.data());
+
+      MPI_Reduce_scatter(y_partial.data(), y_piece.data(), row_counts.data(),
+                         MPI_DOUBLE, MPI_SUM, row_comm);
+
+      t_ax += MPI_Wtime() - t_start;
+
+      // z = A^T y.
+      MPI_Barrier(mpi_comm);
+      t_start = MPI_Wtime();
+
+      MPI_Allgatherv(y_piece.data(), row_counts[my_col], MPI_DOUBLE,
+                     y_local.data(), row_counts.data(), row_displs.data(),
+                     MPI_DOUBLE, row_comm);
+
+      // The array section reduction needs a non-empty buffer.
+      std::fill(z_partial.begin(), z_partial.end(), 0.0);
+      if (n_rows_local > 0 && n_cols_local > 0)
+        {
+          double *z = z_partial.data();
+#pragma omp parallel for reduction(+ : z[:n_cols_local])
+          for (long i = 0; i < n_rows_local; ++i)
+            {
+              const double *row = matrix_local.data() + i * n_cols_local;
+              for (long j = 0; j < n_cols_local; ++j)
+                z[j] += row[j] * y_local[i];
+            }
+        }
+
+      MPI_Reduce_scatter(z_partial.data(), z_piece.data(), col_counts.data(),
+                         MPI_DOUBLE, MPI_SUM, col_comm);
+
+      t_atx += MPI_Wtime() - t_start;
+    }
+
+  // Spot check of the first entry of y owned by each rank.
+  double error = 0.0;
+  if (!y_piece.empty())
+    {
+      const long gi = local_to_global(row_displs[my_col], nb, my_row, pr);
+
+      double sum = 0.0;
+      for (long j = 0; j < n_cols; ++j)
+        sum += matrix_entry(gi, j, n_cols) * vector_entry(j);
+
+      error = std::abs(sum - y_piece[0]) / std::abs(sum);
+    }
+
+  double max_error;
+  MPI_Reduce(&error, &max_error, 1, MPI_DOUBLE, MPI_MAX, 0, mpi_comm);
+
+  // Check of A^T through the identity z . x = (A^T y) . x = y . (A x) = y . y.
+  double dots[2] = {0.0, 0.0};
+  for (size_t j = 0; j < x_piece.size(); ++j)
+    dots[0] += z_piece[j] * x_piece[j];
+  for (const auto &v : y_piece)
+    dots[1] += v * v;
+  MPI_Allreduce(MPI_IN_PLACE, dots, 2, MPI_DOUBLE, MPI_SUM, mpi_comm);
+
+  // Times of the slowest rank.
+  MPI_Allreduce(MPI_IN_PLACE, &t_ax, 1, MPI_DOUBLE, MPI_MAX, mpi_comm);
+  MPI_Allreduce(MPI_IN_PLACE, &t_atx, 1, MPI_DOUBLE, MPI_MAX, mpi_comm);
+
+  if (mpi_rank == 0)
+    {
+      const double flops = 2.0 * n_rows * n_cols;
+
+      std::cout << "Relative error on check entries: " << max_error << std::endl;
+      std::cout << "Relative error of z . x against y . y: "
+                << std::abs(dots[0] - dots[1]) / dots[1] << std::endl;
+      std::cout << "Time elapsed for A x (max over ranks; gather of x, "
+                   "local product, reduce-scatter of y): "
+                << t_ax / n_iter << " [s], "
+                << flops * n_iter / t_ax * 1e-9 << " GFLOP/s" << std::endl;
+      std::cout << "Time elapsed for A^T y (max over ranks): "
+                << t_atx / n_iter << " [s], "
+                << flops * n_iter / t_atx * 1e-9 << " GFLOP/s" << std::endl;
+      // Timing record of A x, for the scaling driver (see 07).
+      std::cout << "TIMING app=matvec_2d ranks=" << mpi_size
+                << " threads=" << omp_get_max_threads()
+                << " size=" << long(n_rows) * n_cols
+                << " seconds=" << t_ax / n_iter << std::endl;
+    }
+
+  MPI_Comm_free(&row_comm);
+  MPI_Comm_free(&col_comm);
+
+  MPI_Finalize();
+
+  return 0;
+}
@@ -0,0 +1,171 @@
+#include <mpi.h>
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "reproducible_sum.hpp"
+
+/**
+ * Reproducible reductions (reproducible_sum.hpp) against plain ones, on
+ * two kernels:
+ *  - pi: the midpoint rule of 06-pi.cpp (sum of 4 / (1 + x^2));
+ *  - dot: the inner product of two distributed vectors, whose entries
+ *    have random signs and magnitudes between 2^-20 and 2^20, so that
+ *    the sum is ill-conditioned.
+ *
+ * The plain versions use reduction(+ : sum) and MPI_SUM: their last
+ * bits (printed in hexadecimal) change with the number of ranks and
+ * threads. The reproducible ones accumulate into a
+ * reproducible::accumulator, with reduction(+ : acc) and a custom
+ * MPI_Op, and print the same bits for any decomposition: run with
+ * different values of -n and OMP_NUM_THREADS and compare.
+ *
+ * The times are those of the slowest rank; their ratio is the overhead
+ * of the reproducible sum.
+ *
+ * Usage: mpirun -n <ranks> ./10-reproducible_sum [n_pi] [n_dot]
+ */
+
+// Pseudo-random number in [0, 1) depending only on 'index' (splitmix64).
+double
+random_entry(std::uint64_t index)
+{
+  std::uint64_t z = index + 0x9e3779b97f4a7c15ULL;
+  z               = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z               = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  z               = z ^ (z >> 31);
+  return (z >> 11) * 0x1.0p-53;
+}
+
+// Entry j of the vector 'v' (0 or 1) of the dot kernel.
+double
+vector_entry(int v, std::uint64_t j)
+{
+  const double mantissa = 2.0 * random_entry(4 * j + 2 * v) - 1.0;
+  const int    exponent = int(40.0 * random_entry(4 * j + 2 * v + 1)) - 20;
+  return std::ldexp(mantissa, exponent);
+}
+
+int
+main(int argc, char **argv)
+{
+  MPI_Init(&argc, &argv);
+
+  MPI_Comm mpi_comm = MPI_COMM_WORLD;
+
+  int mpi_rank;
+  MPI_Comm_rank(mpi_comm, &mpi_rank);
+
+  int mpi_size;
+  MPI_Comm_size(mpi_comm, &mpi_size);
+
+  const unsigned long n_pi  = argc > 1 ? std::stod(argv[1]) : 1e8;
+  const unsigned long n_dot = argc > 2 ? std::stod(argv[2]) : 1e7;
+
+  if (mpi_rank == 0)
+    std::cout << "Number of processes: " << mpi_size
+              << ", number of threads: " << omp_get_max_threads()
+              << std::endl;
+
+  // Time of the slowest rank.
+  const auto max_time = [mpi_comm](double t) {
+    double t_max;
+    MPI_Allreduce(&t, &t_max, 1, MPI_DOUBLE, MPI_MAX, mpi_comm);
+    return t_max;
+  };
+
+  const auto report = [mpi_rank](const std::string &kernel,
+                                 double              plain,
+                                 double              t_plain,
+                                 double              reproducible,
+                                 double              t_reproducible) {
+    if (mpi_rank != 0)
+      return;
+    std::cout << kernel << ":" << std::endl
+              << "  plain:        " << std::hexfloat << plain
+              << std::defaultfloat << " (" << std::setprecision(16) << plain
+              << "), " << std::setprecision(3) << t_plain << " [s]"
+              << std::endl
+              << "  reproducible: " << std::hexfloat << reproducible
+              << std::defaultfloat << " (" << std::setprecision(16)
+              << reproducible << "), " << std::setprecision(3)
+              << t_reproducible << " [s], overhead x"
+              << t_reproducible / t_plain << std::endl;
+  };
+
+  // pi, as in 06-pi.cpp.
+  {
+    const double h = 1.0 / n_pi;
+
+    double t = MPI_Wtime();
+    double sum = 0.0;
+#pragma omp parallel for reduction(+ : sum)
+    for (unsigned long i = mpi_rank + 1; i <= n_pi; i += mpi_size)
+      {
+        const double x = h * (i - 0.5);
+        sum += 4.0 / (1.0 + x * x);
+      }
+    double plain;
+    MPI_Allreduce(&sum, &plain, 1, MPI_DOUBLE, MPI_SUM, mpi_comm);
+    plain *= h;
+    const double t_plain = max_time(MPI_Wtime() - t);
+
+    t = MPI_Wtime();
+    reproducible::accumulator acc;
+#pragma omp parallel for reduction(+ : acc)
+    for (unsigned long i = mpi_rank + 1; i <= n_pi; i += mpi_size)
+      {
+        const double x = h * (i - 0.5);
+        acc += 4.0 / (1.0 + x * x);
+      }
+    const double exact          = h * reproducible::allreduce(acc, mpi_comm);
+    const double t_reproducible = max_time(MPI_Wtime() - t);
+
+    report("pi", plain, t_plain, exact, t_reproducible);
+  }
+
+  // Inner product of two vectors distributed in contiguous blocks.
+  {
+    const unsigned long first = n_dot * mpi_rank / mpi_size;
+    const unsigned long last  = n_dot * (mpi_rank + 1) / mpi_size;
+
+    std::vector<double> x(last - first), y(last - first);
+#pragma omp parallel for
+    for (unsigned long j = first; j < last; ++j)
+      {
+        x[j - first] = vector_entry(0, j);
+        y[j - first] = vector_entry(1, j);
+      }
+
+    double t = MPI_Wtime();
+    double sum = 0.0;
+#pragma omp parallel for reduction(+ : sum)
+    for (unsigned long j = 0; j < x.size(); ++j)
+      sum += x[j] * y[j];
+    double plain;
+    MPI_Allreduce(&sum, &plain, 1, MPI_DOUBLE, MPI_SUM, mpi_comm);
+    const double t_plain = max_time(MPI_Wtime() - t);
+
+    // The products are added exactly (unless they underflow): the
+    // result is the exact inner product, correctly rounded by value().
+    t = MPI_Wtime();
+    reproducible::accumulator acc;
+#pragma omp parallel for reduction(+ : acc)
+    for (unsigned long j = 0; j < x.size(); ++j)
+      acc.add_product(x[j], y[j]);
+    const double exact          = reproducible::allreduce(acc, mpi_comm);
+    const double t_reproducible = max_time(MPI_Wtime() - t);
+
+    report("dot", plain, t_plain, exact, t_reproducible);
+  }
+
+  MPI_Finalize();
+
+  return 0;
+}
@@ -0,0 +1,243 @@
+#ifndef HAVE_REPRODUCIBLE_SUM_HPP
+#define HAVE_REPRODUCIBLE_SUM_HPP
+
+#include <mpi.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * Bitwise reproducible sums of doubles, across threads and ranks.
+ *
+ * Floating point addition is not associative: with reduction(+ : sum)
+ * and MPI_SUM the partial sums are grouped differently for every
+ * number of threads and ranks, and the last bits of the result change.
+ *
+ * Here every double is added exactly to a fixed-point "superaccumulator"
+ * covering the whole double range: 2^-1074 (the smallest subnormal) up
+ * to 2^2176, in 68 signed 64-bit limbs of 32 bits each, so that each
+ * limb can absorb many additions before its carry has to be propagated.
+ * Integer addition is associative, so the exact sum, and the double it
+ * is correctly rounded to at the end, do not depend on the order of the
+ * additions.
+ *
+ * - accumulator::add(x) adds a double, add_product(x, y) the exact
+ *   product x * y (with an FMA: build with -march=native or -mfma);
+ * - "omp declare reduction" below lets an accumulator appear in a
+ *   reduction(+ : ...) clause;
+ * - mpi_datatype() and mpi_op() reduce accumulators across ranks with
+ *   MPI_Reduce or MPI_Allreduce, and allreduce() wraps the latter.
+ *
+ * The price is a few integer operations per addition instead of one
+ * floating point addition (see 10-reproducible_sum.cpp). Infinities and
+ * NaNs are summed apart (their sum does not depend on the order
+ * either), and take over the result.
+ */
+namespace reproducible
+{
+  class accumulator
+  {
+  public:
+    // Limbs of 32 bits; limb k has weight 2^(32 k - 1074).
+    static constexpr int n_limbs = 68;
+
+    void
+    add(double x)
+    {
+      std::uint64_t bits;
+      std::memcpy(&bits, &x, sizeof(x));
+      const int     e = (bits >> 52) & 0x7ff;
+      std::uint64_t m = bits & ((std::uint64_t(1) << 52) - 1);
+      if (e == 0x7ff)
+        {
+          nonfinite += x;
+          return;
+        }
+
+      // |x| = m 2^(p - 1074), with a 53-bit m (fewer for subnormals).
+      if (e != 0)
+        m |= std::uint64_t(1) << 52;
+      const int p = e != 0 ? e - 1 : 0;
+      const int k = p / 32, s = p % 32;
+
+      // m 2^s, split into the 32-bit digits d0, d1, d2 (d1 may exceed
+      // 32 bits: it is the sum of two pieces).
+      const std::uint64_t lo = (m & mask) << s, hi = (m >> 32) << s;
+      std::int64_t        d0 = lo & mask, d1 = (lo >> 32) + (hi & mask);
+      std::int64_t        d2   = hi >> 32;
+      const std::int64_t  sign = -std::int64_t(bits >> 63);
+      limbs[k] += (d0 ^ sign) - sign;
+      limbs[k + 1] += (d1 ^ sign) - sign;
+      limbs[k + 2] += (d2 ^ sign) - sign;
+
+      if (++count == max_count)
+        normalize();
+    }
+
+    // Adds x * y exactly (unless it underflows).
+    void
+    add_product(double x, double y)
+    {
+      const double p = x * y;
+      add(p);
+      if (std::isfinite(p))
+        add(std::fma(x, y, -p));
+    }
+
+    accumulator &
+    operator+=(double x)
+    {
+      add(x);
+      return *this;
+    }
+
+    accumulator &
+    operator+=(const accumulator &other)
+    {
+      for (int k = 0; k < n_limbs; ++k)
+        limbs[k] += other.limbs[k];
+      nonfinite += other.nonfinite;
+      count += other.count;
+      if (count >= max_count)
+        normalize();
+      return *this;
+    }
+
+    // Propagates the carries: every limb but the last in [0, 2^32).
+    void
+    normalize()
+    {
+      for (int k = 0; k < n_limbs - 1; ++k)
+        {
+          const std::int64_t carry = limbs[k] >> 32;
+          limbs[k] &= mask;
+          limbs[k + 1] += carry;
+        }
+      count = 1;
+    }
+
+    // The sum, rounded to the nearest double (ties to even): correctly
+    // rounded, so always the same double for the same exact sum.
+    double
+    value() const
+    {
+      if (nonfinite != 0.0)
+        return nonfinite;
+
+      accumulator a = *this;
+      a.normalize();
+      const bool negative = a.limbs[n_limbs - 1] < 0;
+      if (negative)
+        {
+          for (auto &l : a.limbs)
+            l = -l;
+          a.normalize();
+        }
+
+      int k = n_limbs - 1;
+      while (k >= 0 && a.limbs[k] == 0)
+        --k;
+      if (k < 0)
+        return 0.0;
+
+      // Bit i of |sum|, of weight 2^(i - 1074) (the last limb may hold
+      // more than 32 bits).
+      const auto bit = [&a](int i) {
+        const int j = std::min(i / 32, n_limbs - 1);
+        return (std::uint64_t(a.limbs[j]) >> (i - 32 * j)) & 1;
+      };
+      int msb = 32 * k;
+      while (std::uint64_t(a.limbs[k]) >> (msb - 32 * k + 1))
+        ++msb;
+
+      // The 53 bits from the leading one down to 'low', the last bit of
+      // the result (bit 0 for subnormals), rounded to nearest even with
+      // the next bit and a sticky bit for all the ones below. Only the
+      // integer m is rounded: m 2^(low - 1074) is exact (or overflows).
+      const int     low = std::max(msb - 52, 0);
+      std::uint64_t m   = 0;
+      for (int i = msb; i >= low; --i)
+        m = (m << 1) | bit(i);
+      const bool half   = low > 0 && bit(low - 1);
+      bool       sticky = false;
+      for (int i = 0; i < low - 1 && !sticky; ++i)
+        sticky = bit(i);
+      if (half && (sticky || (m & 1)))
+        ++m;
+
+      const double result = std::ldexp(double(m), low - 1074);
+      return negative ? -result : result;
+    }
+
+  private:
+    static constexpr std::int64_t mask = 0xffffffff;
+
+    // Additions between normalizations: each one adds less than 2^33
+    // to a limb, and two accumulators with fewer than max_count
+    // additions each can be merged without overflowing 2^63.
+    static constexpr int max_count = 1 << 28;
+
+    std::array<std::int64_t, n_limbs> limbs{};
+    double                            nonfinite = 0.0;
+    int                               count     = 0;
+  };
+
+  static_assert(std::is_trivially_copyable_v<accumulator>);
+
+  namespace detail
+  {
+    inline void
+    sum_op(void *in, void *inout, int *len, MPI_Datatype *)
+    {
+      const auto *a = static_cast<const accumulator *>(in);
+      auto       *b = static_cast<accumulator *>(inout);
+      for (int i = 0; i < *len; ++i)
+        b[i] += a[i];
+    }
+  } // namespace detail
+
+  // An accumulator as an MPI datatype (its bytes: it is trivially
+  // copyable), created on the first call.
+  inline MPI_Datatype
+  mpi_datatype()
+  {
+    static MPI_Datatype type = [] {
+      MPI_Datatype t;
+      MPI_Type_contiguous(sizeof(accumulator), MPI_BYTE, &t);
+      MPI_Type_commit(&t);
+      return t;
+    }();
+    return type;
+  }
+
+  // The sum of accumulators (commutative), for mpi_datatype().
+  inline MPI_Op
+  mpi_op()
+  {
+    static MPI_Op op = [] {
+      MPI_Op o;
+      MPI_Op_create(&detail::sum_op, 1, &o);
+      return o;
+    }();
+    return op;
+  }
+
+  // The sum of the accumulators of all the ranks of comm, on every rank.
+  inline double
+  allreduce(const accumulator &local, MPI_Comm comm)
+  {
+    accumulator global;
+    MPI_Allreduce(&local, &global, 1, mpi_datatype(), mpi_op(), comm);
+    return global.value();
+  }
+} // namespace reproducible
+
+// Allows reduction(+ : acc) for an accumulator acc.
+#pragma omp declare reduction(+ : reproducible::accumulator : omp_out += omp_in) \
+  initializer(omp_priv = reproducible::accumulator())
+
+#endif
@@ -0,0 +1,125 @@
+// Standalone driver of the geometric multigrid solver in "multigrid.hpp".
+//
+// Solves -Laplace(u) = 1 on the heat equation grid (homogeneous Dirichlet boundaries),
+// with a fixed local domain of <nx> x <ny> points per rank: running it with an increasing
+// number of ranks gives a weak scaling study, reported in the same format as the heat solver.
+//
+//   mpirun -np 4 ./multigrid 256 258 [--w] [--tol <tol>] [--pre <n>] [--post <n>]
+//
+// nx and ny - 2 must be even, so that the grid can be coarsened at least once. The exit status
+// is non-zero if the residual target is not reached within the cycle limit.
+
+#include <mpi.h>        // For MPI (Message Passing Interface) functionalities
+
+#include <chrono>       // For time measurement and manipulation
+#include <cmath>        // For std::sqrt
+#include <iostream>     // For standard input and output streams
+#include <string>       // For parsing the command line
+#include <vector>       // For using the std::vector container
+
+#include "multigrid.hpp"
+
+int main(int argc, char *argv[]) {
+  MPI_Init(&argc, &argv);
+
+  int rank, nranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  // Print the usage (and 'message', if any) and leave with a non-zero status
+  auto usage = [rank, argv](std::string const& message) {
+    if (rank == 0) {
+      std::cerr << "ERROR: " << (message.empty() ? "incorrect arguments" : message) << std::endl;
+      std::cerr << "  " << argv[0] << " <nx> <ny> [--w] [--tol <tol>] [--pre <n>] [--post <n>]" << std::endl;
+    }
+    MPI_Finalize();
+    return 1;
+  };
+
+  // Parse CLI parameters
+  if (argc < 3) {
+    return usage("");
+  }
+  long nx = std::stol(argv[1]); // Local interior columns per rank
+  long ny = std::stol(argv[2]); // Points per column, boundaries included
+  double tol = 1e-8;
+  mg::options opts;
+  for (int i = 3; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--w") {
+      opts.gamma = 2;
+    } else if (arg == "--tol" && i + 1 < argc) {
+      tol = std::stod(argv[++i]);
+    } else if (arg == "--pre" && i + 1 < argc) {
+      opts.pre = std::stoi(argv[++i]);
+    } else if (arg == "--post" && i + 1 < argc) {
+      opts.post = std::stoi(argv[++i]);
+    } else {
+      return usage("unknown or incomplete option '" + arg + "'");
+    }
+  }
+  if (tol <= 0. || opts.pre < 0 || opts.post < 0) {
+    return usage("");
+  }
+
+  // Without a coarse level the solver would only smooth, and miss the tolerance: require the
+  // conditions under which the hierarchy coarsens the fine level (see the multigrid constructor)
+  if (nx < 1 || ny < 3 || nx % 2 != 0 || (ny - 2) % 2 != 0 || nx * nranks / 2 < opts.min_global ||
+      (ny - 2) / 2 < opts.min_global) {
+    return usage("the grid cannot be coarsened: nx and ny - 2 must be even, with at least " +
+                 std::to_string(2 * opts.min_global) + " interior points in each direction");
+  }
+
+  // Undivided operator (kappa = 1, sigma = 0): the right-hand side is scaled by dx^2
+  long nx_global = nx * nranks;
+  double dx = 1.0 / nx_global;
+  std::vector<double> u((nx + 2) * ny, 0.), f((nx + 2) * ny, 0.);
+  for (long x = 1; x <= nx; ++x) {
+    for (long y = 1; y < ny - 1; ++y) {
+      f[x * ny + y] = dx * dx;
+    }
+  }
+
+  // The solver owns sub-communicators: it must be destroyed before MPI_Finalize
+  constexpr long max_cycles = 100;
+  bool converged = true;
+  {
+    using clk_t = std::chrono::steady_clock;
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto start = clk_t::now();
+    mg::multigrid solver(nx, ny, 0., 1., MPI_COMM_WORLD, opts);
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto setup = std::chrono::duration<double>(clk_t::now() - start).count();
+
+    start = clk_t::now();
+    long cycles = solver.solve(u.data(), f.data(), tol, max_cycles);
+    MPI_Barrier(MPI_COMM_WORLD);
+    auto time = std::chrono::duration<double>(clk_t::now() - start).count();
+
+    // Same metrics as the heat solver: the fine level (u and f) is streamed once per cycle
+    auto grid_size = static_cast<double>(nx * ny * sizeof(double) * 2) * 1e-9; // GB
+    auto memory_bw = grid_size * static_cast<double>(cycles) / time; // GB/s
+
+    if (rank == 0) {
+      std::cerr << (opts.gamma == 1 ? "V" : "W") << "-cycle, " << solver.n_levels() << " levels on rank 0: "
+                << cycles << " cycles, residual " << solver.residual_norm()
+                << ", setup " << setup << " s, solve " << time << " s" << std::endl;
+      std::cerr << "Rank " << rank << ": local domain " << nx << "x" << ny << " (" << grid_size << " GB): "
+                << memory_bw << " GB/s" << std::endl;
+      std::cerr << "All ranks: global domain " << nx_global << "x" << ny << " ("
+                << (grid_size * nranks) << " GB): " << memory_bw * nranks << " GB/s, "
+                << static_cast<double>(nx_global * ny) * cycles / time * 1e-6 << " Mpoints/s" << std::endl;
+    }
+
+    // The solver stops early only on convergence; ||f|| is known since f is constant
+    double f_norm = dx * dx * std::sqrt(static_cast<double>(nx_global * (ny - 2)));
+    converged = cycles < max_cycles || solver.residual_norm() <= tol * f_norm;
+    if (!converged && rank == 0) {
+      std::cerr << "ERROR: residual target not reached after " << cycles << " cycles: relative residual "
+                << solver.residual_norm() / f_norm << " (tolerance " << tol << ")" << std::endl;
+    }
+  }
+
+  MPI_Finalize();
+  return converged ? 0 : 1;
+}
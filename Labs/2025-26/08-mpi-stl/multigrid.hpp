@@ -0,0 +1,347 @@
+#ifndef HAVE_MULTIGRID_HPP
+#define HAVE_MULTIGRID_HPP
+
+// Distributed geometric multigrid for the 5-point operator
+//
+//   A u = sigma * u + kappa * (4 u - u(x+1,y) - u(x-1,y) - u(x,y+1) - u(x,y-1))
+//
+// with homogeneous Dirichlet boundary conditions, on the grid layout of the heat solver:
+// each rank owns 'nx' interior columns (x = 1..nx) of 'ny' points (y = 0 and y = ny-1 are
+// the Dirichlet boundary), plus two halo columns (x = 0 and x = nx+1), stored as u[x*ny + y].
+// Ranks are stacked along x in rank order.
+//
+// Coarse levels halve the interior points in each direction (bilinear prolongation P and
+// restriction R = P^T / 4, so that the V-cycle is symmetric and can precondition CG).
+// Pairing points moves the first coarse point away from the boundary: on the fine level it is
+// one spacing away, on level l it is 'delta' coarse spacings away, with delta -> 1/2. The coarse
+// operators and P account for it by linear extrapolation of the (zero) boundary value.
+// When the local number of columns gets small, groups of ranks are agglomerated onto their
+// first rank, so the coarsest levels run on fewer ranks and the other ones wait idle.
+
+#include <mpi.h>        // For MPI communicators, halo exchange and agglomeration
+
+#include <algorithm>    // For std::fill, std::for_each
+#include <array>        // For the prolongation weights
+#include <cmath>        // For std::sqrt
+#include <execution>    // For parallel execution policies
+#include <numeric>      // For std::transform_reduce
+#include <ranges>       // For std::views::iota
+#include <vector>       // For the level storage
+
+namespace mg {
+
+// Exchange the halo columns of 'u' with the neighbouring ranks of 'comm' and
+// set the ghost columns on the physical boundary to zero
+inline void exchange(double* u, long nx, long ny, MPI_Comm comm) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+  int prev = rank > 0 ? rank - 1 : MPI_PROC_NULL;
+  int next = rank < size - 1 ? rank + 1 : MPI_PROC_NULL;
+
+  // Shift to the left, then to the right: MPI_Sendrecv cannot deadlock
+  MPI_Sendrecv(u + ny, ny, MPI_DOUBLE, prev, 0, u + (nx + 1) * ny, ny, MPI_DOUBLE, next, 0, comm,
+               MPI_STATUS_IGNORE);
+  MPI_Sendrecv(u + nx * ny, ny, MPI_DOUBLE, next, 1, u, ny, MPI_DOUBLE, prev, 1, comm,
+               MPI_STATUS_IGNORE);
+
+  if (prev == MPI_PROC_NULL) {
+    std::fill_n(u, ny, 0.);
+  }
+  if (next == MPI_PROC_NULL) {
+    std::fill_n(u + (nx + 1) * ny, ny, 0.);
+  }
+}
+
+// Multigrid cycle options
+struct options {
+  int pre = 2;         // Pre-smoothing red-black Gauss-Seidel sweeps
+  int post = 2;        // Post-smoothing sweeps (in reverse colour order)
+  int coarse = 20;     // Symmetric sweeps on the coarsest level
+  int gamma = 1;       // Cycle index: 1 = V-cycle, 2 = W-cycle
+  long min_local = 4;  // Agglomerate when a rank would own fewer coarse columns than this
+  long min_global = 4; // Stop coarsening below this many interior points per direction
+};
+
+// Multigrid hierarchy and cycles
+class multigrid {
+public:
+  // Build the hierarchy for the local grid 'nx' x 'ny' on 'comm' (collective)
+  multigrid(long nx, long ny, double sigma, double kappa, MPI_Comm comm, options opts = {});
+  ~multigrid();
+
+  multigrid(multigrid const&) = delete;
+  multigrid& operator=(multigrid const&) = delete;
+
+  // Preconditioner: z = M^{-1} r with one cycle from a zero initial guess
+  void precondition(double* z, double const* r);
+
+  // Standalone solver: cycle until ||f - A u|| <= tol * ||f||, return the number of cycles
+  long solve(double* u, double const* f, double tol, long max_cycles);
+
+  // Global 2-norm of the fine level residual of the last solve
+  double residual_norm() const { return res_norm; }
+
+  // Number of levels this rank takes part in
+  std::size_t n_levels() const { return levels.size(); }
+
+private:
+  struct level {
+    long nx = 0, ny = 0;               // Local interior columns and points per column (with boundaries)
+    double sigma = 0., kappa = 0.;     // Operator coefficients on this level
+    double ghost = 0.;                 // Ghost value, as a multiple of the adjacent point, giving zero on the boundary
+    MPI_Comm comm = MPI_COMM_NULL;     // Ranks active on this level (MPI_COMM_NULL if this rank is idle)
+    int rank = 0, nranks = 1;          // Position in 'comm'
+    int group = 1;                     // Number of ranks of the finer level agglomerated onto one rank
+    MPI_Comm gather = MPI_COMM_NULL;   // Communicator of the agglomeration group (MPI_COMM_NULL if group == 1)
+    std::vector<double> u{}, f{}, r{}; // Solution, right-hand side and residual (active ranks only)
+    std::vector<double> tmp{};         // Coarse data owned by a finer-level rank before agglomeration
+  };
+
+  double diagonal(level const& L, long x, long y) const;
+  void smooth(level& L, int sweeps, bool reverse);
+  void residual(level& L);
+  void cycle(std::size_t l);
+  double norm(double const* v, level const& L) const;
+
+  std::vector<level> levels;
+  options opts;
+  double res_norm = 0.;
+};
+
+inline multigrid::multigrid(long nx, long ny, double sigma, double kappa, MPI_Comm comm, options o)
+  : opts(o) {
+  double delta = 1.; // Distance of the first point from the boundary, in grid spacings
+  level fine{.nx = nx, .ny = ny, .sigma = sigma, .kappa = kappa, .ghost = 0., .comm = MPI_COMM_NULL,
+             .gather = MPI_COMM_NULL};
+  MPI_Comm_dup(comm, &fine.comm);
+  levels.push_back(std::move(fine));
+
+  while (true) {
+    level& L = levels.back();
+    if (L.comm == MPI_COMM_NULL) {
+      break; // This rank was agglomerated away
+    }
+    MPI_Comm_rank(L.comm, &L.rank);
+    MPI_Comm_size(L.comm, &L.nranks);
+    L.u.assign((L.nx + 2) * L.ny, 0.);
+    L.f.assign((L.nx + 2) * L.ny, 0.);
+    L.r.assign((L.nx + 2) * L.ny, 0.);
+
+    // Coarsen only while both directions have an even number of interior points
+    long mx = L.nx * L.nranks, my = L.ny - 2;
+    if (L.nx % 2 != 0 || my % 2 != 0 || mx / 2 < opts.min_global || my / 2 < opts.min_global) {
+      break;
+    }
+
+    delta = (delta + 0.5) / 2.;
+    level C{.nx = L.nx / 2, .ny = my / 2 + 2, .sigma = L.sigma, .kappa = L.kappa / 4.,
+            .ghost = -(1. - delta) / delta, .comm = MPI_COMM_NULL, .gather = MPI_COMM_NULL};
+
+    // Agglomerate pairs of ranks (or everything, if the number of ranks is odd)
+    if (L.nranks > 1 && C.nx < opts.min_local) {
+      C.group = L.nranks % 2 == 0 ? 2 : L.nranks;
+      MPI_Comm_split(L.comm, L.rank / C.group, L.rank, &C.gather);
+      MPI_Comm_split(L.comm, L.rank % C.group == 0 ? 0 : MPI_UNDEFINED, L.rank, &C.comm);
+    } else {
+      MPI_Comm_dup(L.comm, &C.comm);
+    }
+    C.tmp.assign((C.nx + 2) * C.ny, 0.);
+    C.nx *= C.group;
+    levels.push_back(std::move(C));
+  }
+}
+
+inline multigrid::~multigrid() {
+  for (auto& L : levels) {
+    if (L.comm != MPI_COMM_NULL) {
+      MPI_Comm_free(&L.comm);
+    }
+    if (L.gather != MPI_COMM_NULL) {
+      MPI_Comm_free(&L.gather);
+    }
+  }
+}
+
+// Diagonal of the operator: the ghost extrapolation of the points next to the boundary
+// is folded into it, so the off-diagonal part only sees zero ghost values
+inline double multigrid::diagonal(level const& L, long x, long y) const {
+  int n_boundary = (y == 1) + (y == L.ny - 2) + (L.rank == 0 && x == 1) +
+                   (L.rank == L.nranks - 1 && x == L.nx);
+  return L.sigma + L.kappa * (4. - L.ghost * n_boundary);
+}
+
+// Red-black Gauss-Seidel: the colour of a point is the parity of its global (x + y)
+inline void multigrid::smooth(level& L, int sweeps, bool reverse) {
+  auto xs = std::views::iota(1L, L.nx + 1);
+  for (int s = 0; s < sweeps; ++s) {
+    for (int c = 0; c < 2; ++c) {
+      int colour = reverse ? 1 - c : c;
+      exchange(L.u.data(), L.nx, L.ny, L.comm);
+      std::for_each(std::execution::par, xs.begin(), xs.end(), [this, &L, colour](long x) {
+        double* u = L.u.data();
+        long gx = L.rank * L.nx + x;
+        for (long y = 1 + (gx + 1 + colour) % 2; y < L.ny - 1; y += 2) {
+          long i = x * L.ny + y;
+          u[i] = (L.f[i] + L.kappa * (u[i + L.ny] + u[i - L.ny] + u[i + 1] + u[i - 1])) /
+                 diagonal(L, x, y);
+        }
+      });
+    }
+  }
+}
+
+// r = f - A u on the interior points
+inline void multigrid::residual(level& L) {
+  exchange(L.u.data(), L.nx, L.ny, L.comm);
+  auto xs = std::views::iota(1L, L.nx + 1);
+  std::for_each(std::execution::par, xs.begin(), xs.end(), [this, &L](long x) {
+    double const* u = L.u.data();
+    for (long y = 1; y < L.ny - 1; ++y) {
+      long i = x * L.ny + y;
+      L.r[i] = L.f[i] - diagonal(L, x, y) * u[i] +
+               L.kappa * (u[i + L.ny] + u[i - L.ny] + u[i + 1] + u[i - 1]);
+    }
+  });
+}
+
+inline double multigrid::norm(double const* v, level const& L) const {
+  double local = std::transform_reduce(std::execution::par, v + L.ny, v + (L.nx + 1) * L.ny,
+                                       v + L.ny, 0.);
+  MPI_Allreduce(MPI_IN_PLACE, &local, 1, MPI_DOUBLE, MPI_SUM, L.comm);
+  return std::sqrt(local);
+}
+
+inline void multigrid::cycle(std::size_t l) {
+  level& L = levels[l];
+  if (l + 1 == levels.size()) {
+    // Coarsest level: symmetric sweeps
+    smooth(L, opts.coarse, false);
+    smooth(L, opts.coarse, true);
+    return;
+  }
+
+  smooth(L, opts.pre, false);
+  residual(L);
+
+  level& C = levels[l + 1];
+  long cnx = C.nx / C.group, cny = C.ny; // Coarse columns owned by this rank before agglomeration
+  long fny = L.ny;
+
+  // 1D weights of P: fine points 2X-2..2X+1 from coarse X. Next to the boundary the
+  // extrapolated ghost adds 1/4 * ghost to the weight of the first (or last) coarse point
+  bool first = L.rank == 0, last = L.rank == L.nranks - 1;
+  double wb = 0.75 + 0.25 * C.ghost;
+  auto weights = [wb](long X, long n, bool lo, bool hi) {
+    std::array<double, 4> w = {0.25, 0.75, 0.75, 0.25};
+    if (lo && X == 1) {
+      w[0] = 0., w[1] = wb;
+    }
+    if (hi && X == n) {
+      w[2] = wb, w[3] = 0.;
+    }
+    return w;
+  };
+
+  // Restriction R = P^T / 4 of the residual, halo included
+  exchange(L.r.data(), L.nx, L.ny, L.comm);
+  auto cxs = std::views::iota(1L, cnx + 1);
+  std::for_each(std::execution::par, cxs.begin(), cxs.end(), [&, fny, cny](long X) {
+    auto wx = weights(X, cnx, first, last);
+    double const* r = L.r.data();
+    for (long Y = 1; Y < cny - 1; ++Y) {
+      auto wy = weights(Y, cny - 2, true, true);
+      double sum = 0.;
+      for (int a = 0; a < 4; ++a) {
+        for (int b = 0; b < 4; ++b) {
+          sum += wx[a] * wy[b] * r[(2 * X - 2 + a) * fny + 2 * Y - 2 + b];
+        }
+      }
+      C.tmp[X * cny + Y] = 0.25 * sum;
+    }
+  });
+
+  // Move the coarse right-hand side to the ranks active on the coarse level
+  if (C.group > 1) {
+    MPI_Gather(C.tmp.data() + cny, cnx * cny, MPI_DOUBLE, C.comm != MPI_COMM_NULL ? C.f.data() + cny : nullptr,
+               cnx * cny, MPI_DOUBLE, 0, C.gather);
+  } else {
+    std::copy(C.tmp.begin(), C.tmp.end(), C.f.begin());
+  }
+
+  if (C.comm != MPI_COMM_NULL) {
+    std::fill(C.u.begin(), C.u.end(), 0.);
+    for (int k = 0; k < opts.gamma; ++k) {
+      cycle(l + 1);
+    }
+  }
+
+  // Bring the coarse correction back and fill its halo on the finer level ranks
+  if (C.group > 1) {
+    MPI_Scatter(C.comm != MPI_COMM_NULL ? C.u.data() + cny : nullptr, cnx * cny, MPI_DOUBLE,
+                C.tmp.data() + cny, cnx * cny, MPI_DOUBLE, 0, C.gather);
+  } else {
+    std::copy(C.u.begin(), C.u.end(), C.tmp.begin());
+  }
+  exchange(C.tmp.data(), cnx, cny, L.comm);
+  for (long X = 0; X < cnx + 2; ++X) {
+    C.tmp[X * cny] = C.ghost * C.tmp[X * cny + 1];
+    C.tmp[X * cny + cny - 1] = C.ghost * C.tmp[X * cny + cny - 2];
+  }
+  for (long Y = 0; Y < cny; ++Y) {
+    if (first) {
+      C.tmp[Y] = C.ghost * C.tmp[cny + Y];
+    }
+    if (last) {
+      C.tmp[(cnx + 1) * cny + Y] = C.ghost * C.tmp[cnx * cny + Y];
+    }
+  }
+
+  // Bilinear prolongation: fine point 2X-1 (resp. 2X) takes 3/4 of coarse X and 1/4 of X-1 (resp. X+1)
+  auto xs = std::views::iota(1L, L.nx + 1);
+  std::for_each(std::execution::par, xs.begin(), xs.end(), [&, fny, cny](long x) {
+    long X = (x + 1) / 2, Xn = x % 2 ? X - 1 : X + 1;
+    for (long y = 1; y < fny - 1; ++y) {
+      long Y = (y + 1) / 2, Yn = y % 2 ? Y - 1 : Y + 1;
+      L.u[x * fny + y] += 0.5625 * C.tmp[X * cny + Y] + 0.1875 * C.tmp[Xn * cny + Y] +
+                          0.1875 * C.tmp[X * cny + Yn] + 0.0625 * C.tmp[Xn * cny + Yn];
+    }
+  });
+
+  smooth(L, opts.post, true);
+}
+
+inline void multigrid::precondition(double* z, double const* r) {
+  level& L = levels.front();
+  std::copy(r + L.ny, r + (L.nx + 1) * L.ny, L.f.begin() + L.ny);
+  std::fill(L.u.begin(), L.u.end(), 0.);
+  cycle(0);
+  std::copy(L.u.begin() + L.ny, L.u.begin() + (L.nx + 1) * L.ny, z + L.ny);
+}
+
+inline long multigrid::solve(double* u, double const* f, double tol, long max_cycles) {
+  level& L = levels.front();
+  std::copy(f + L.ny, f + (L.nx + 1) * L.ny, L.f.begin() + L.ny);
+  std::copy(u + L.ny, u + (L.nx + 1) * L.ny, L.u.begin() + L.ny);
+
+  double f_norm = norm(L.f.data(), L);
+  if (f_norm == 0.) {
+    f_norm = 1.;
+  }
+
+  long k = 0;
+  residual(L);
+  res_norm = norm(L.r.data(), L);
+  for (; k < max_cycles && res_norm > tol * f_norm; ++k) {
+    cycle(0);
+    residual(L);
+    res_norm = norm(L.r.data(), L);
+  }
+
+  std::copy(L.u.begin() + L.ny, L.u.begin() + (L.nx + 1) * L.ny, u + L.ny);
+  return k;
+}
+
+} // namespace mg
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef HAVE_NUMA_HPP
+#define HAVE_NUMA_HPP
+
+// NUMA-aware memory placement for the heat solver.
+//
+// Linux places a page on the NUMA node of the thread that first writes it ("first touch").
+// If the fields are initialised by one set of threads and updated by another, half of the
+// accesses of a dual-socket node go through the inter-socket link. This header provides:
+//  - numa::team: the persistent worker team of thread_team.hpp, pinned to CPUs
+//    with a chosen policy;
+//  - numa::buffer: a page-aligned array (optionally backed by transparent huge pages) whose
+//    rows are first touched by the team with numa::partition, the static partition that the
+//    compute loop must use as well.
+
+#include <sched.h>      // For sched_getaffinity, CPU_* macros
+#include <pthread.h>    // For pthread_setaffinity_np
+#include <sys/mman.h>   // For mmap, madvise
+
+#include <algorithm>    // For std::min, std::max
+#include <cstddef>      // For std::size_t
+#include <cstdint>      // For std::uintptr_t
+#include <execution>    // For the fallback parallel first touch
+#include <fstream>      // For reading the CPU topology from sysfs
+#include <functional>   // For std::function
+#include <map>          // For grouping CPUs by socket
+#include <new>          // For std::bad_alloc
+#include <stdexcept>    // For std::invalid_argument
+#include <string>       // For std::string, std::to_string
+#include <vector>       // For std::vector
+
+#include "thread_team.hpp" // For threads::team
+
+namespace numa {
+
+// Thread pinning policy
+enum class pinning {
+  none,    // Let the OS scheduler place the threads
+  compact, // Fill the CPUs of the process mask in order (socket by socket)
+  scatter  // Round-robin over the sockets, so that each socket gets a share of the threads
+};
+
+// Throws std::invalid_argument for names other than "none", "compact" and "scatter"
+inline pinning parse_pinning(std::string const& name) {
+  if (name == "none") return pinning::none;
+  if (name == "compact") return pinning::compact;
+  if (name == "scatter") return pinning::scatter;
+  throw std::invalid_argument("unknown pinning policy '" + name + "'");
+}
+
+// CPUs the process may run on (e.g. as restricted by mpirun --bind-to), in the order
+// they should be handed out to threads by 'policy'
+inline std::vector<int> cpu_order(pinning policy) {
+  cpu_set_t mask;
+  CPU_ZERO(&mask);
+  sched_getaffinity(0, sizeof(mask), &mask);
+
+  // Group the CPUs by physical package (socket)
+  std::map<int, std::vector<int>> sockets;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &mask)) {
+      int socket = 0;
+      std::ifstream in("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/physical_package_id");
+      in >> socket;
+      sockets[socket].push_back(cpu);
+    }
+  }
+
+  std::vector<int> order;
+  if (policy == pinning::scatter) {
+    for (std::size_t i = 0; order.size() < static_cast<std::size_t>(CPU_COUNT(&mask)); ++i) {
+      for (auto const& [socket, cpus] : sockets) {
+        if (i < cpus.size()) order.push_back(cpus[i]);
+      }
+    }
+  } else {
+    for (auto const& [socket, cpus] : sockets) {
+      order.insert(order.end(), cpus.begin(), cpus.end());
+    }
+  }
+  return order;
+}
+
+// Static partition of 'n' rows into 'nthreads' contiguous blocks: block 'tid' is [begin, end)
+struct block {
+  long begin, end;
+};
+
+inline block partition(long n, int tid, int nthreads) {
+  return {n * tid / nthreads, n * (tid + 1) / nthreads};
+}
+
+// Team of worker threads (the shared threads::team), pinned to CPUs with 'policy'. 'run'
+// executes a function on every worker and returns when all of them are done; it must be
+// called by one thread at a time.
+class team {
+public:
+  team(int nthreads, pinning policy)
+    : results(nthreads * pad), workers(nthreads, pin(policy)) {}
+
+  int size() const { return workers.size(); }
+
+  // Run 'f(tid)' on every worker and return the sum of the results
+  double run(std::function<double(int)> f) {
+    workers.run([this, &f](int tid, int) { results[tid * pad] = f(tid); });
+    double sum = 0.;
+    for (int tid = 0; tid < size(); ++tid) sum += results[tid * pad];
+    return sum;
+  }
+
+private:
+  // Pins worker 'tid' to the CPU of rank 'tid' in cpu_order(policy)
+  static std::function<void(int)> pin(pinning policy) {
+    if (policy == pinning::none) return {};
+    return [cpus = cpu_order(policy)](int tid) {
+      if (cpus.empty()) return;
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpus[tid % cpus.size()], &set);
+      pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    };
+  }
+
+  static constexpr int pad = 8; // One cache line per result, to avoid false sharing
+  std::vector<double> results;
+  threads::team workers;
+};
+
+// Page-aligned array of 'rows' x 'row_size' elements. The memory is mapped but not touched:
+// 'first_touch' must be called before use. With 'huge', the kernel is asked to back the buffer
+// with transparent huge pages: the buffer is then aligned to 2 MiB, since only the aligned 2 MiB
+// blocks of a mapping can be huge pages (mmap itself only guarantees 4 KiB alignment).
+template <class T>
+class buffer {
+public:
+  buffer(long rows, long row_size, bool huge = false)
+    : nrows(rows), ncols(row_size) {
+    long n = rows * row_size;
+    constexpr std::size_t huge_page = 2 << 20;
+    bytes = std::max<std::size_t>(n * sizeof(T), 1);
+    if (huge) bytes = (bytes + huge_page - 1) / huge_page * huge_page;
+
+    // mmap does not touch the pages, unlike a value-initialising std::vector. For huge pages,
+    // map one huge page more than needed and unmap the unaligned head and tail.
+    std::size_t mapped = huge ? bytes + huge_page : bytes;
+    void* mem = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) throw std::bad_alloc();
+    if (huge) {
+      auto base = reinterpret_cast<std::uintptr_t>(mem);
+      auto aligned = (base + huge_page - 1) / huge_page * huge_page;
+      if (aligned > base) munmap(mem, aligned - base);
+      if (aligned + bytes < base + mapped) {
+        munmap(reinterpret_cast<void*>(aligned + bytes), base + mapped - aligned - bytes);
+      }
+      mem = reinterpret_cast<void*>(aligned);
+      madvise(mem, bytes, MADV_HUGEPAGE);
+    }
+    ptr = static_cast<T*>(mem);
+  }
+
+  ~buffer() { munmap(ptr, bytes); }
+
+  buffer(buffer const&) = delete;
+  buffer& operator=(buffer const&) = delete;
+
+  // Fill the buffer with 'value'. With a team, worker 'tid' writes the rows of
+  // numa::partition(rows, tid, size), so the pages end up on the NUMA node of the thread that
+  // will update them; without a team, the parallel backend of the standard library is used.
+  void first_touch(team* workers, T value) {
+    if (workers) {
+      workers->run([this, workers, value](int tid) {
+        auto b = partition(nrows, tid, workers->size());
+        std::fill(ptr + b.begin * ncols, ptr + b.end * ncols, value);
+        return 0.;
+      });
+    } else {
+      std::fill_n(std::execution::par, ptr, size(), value);
+    }
+  }
+
+  T* data() { return ptr; }
+  T const* data() const { return ptr; }
+  long size() const { return nrows * ncols; }
+
+private:
+  T* ptr;
+  long nrows, ncols;
+  std::size_t bytes;
+};
+
+} // namespace numa
+
+#endif
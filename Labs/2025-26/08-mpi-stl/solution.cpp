@@ -38,12 +38,32 @@
 #include <thread>       // For multi-threading support
 #include <atomic>       // For atomic operations and types
 #include <barrier>      // For synchronization barriers in multi-threading
+#include <string>       // For building snapshot file names
+#include <cmath>        // For std::sqrt in the conjugate gradient solver
+#include <functional>   // For std::function (preconditioner hook of the conjugate gradient solver)
+#include <memory>       // For std::unique_ptr
+#if __has_include(<tbb/task_arena.h>)
+#include <tbb/task_arena.h> // For the number of threads of std::execution::par (TBB backend)
+#endif
+
+#include "multigrid.hpp" // Geometric multigrid, used to precondition the implicit solver
+#include "numa.hpp"      // NUMA-aware buffers and pinned worker threads
 
 // Structure to hold problem parameters for the heat equation simulation
 struct parameters {
   double dx, dt;      // Spatial and temporal step sizes
   long nx, ny, ni;    // Grid dimensions (nx: number of grid points in x, ny: number of grid points in y, ni: number of iterations)
   int rank = 0, nranks = 1; // MPI rank (unique identifier for each process) and total number of ranks (processes)
+  long ns = 0;        // In-situ snapshot cadence in iterations (0 disables snapshots)
+  long stride = 1;    // Coarsening factor of the snapshots in both x and y
+  bool average = true; // Snapshots average stride x stride blocks (true) or sample one point per block (false)
+  bool implicit = false; // Use Crank-Nicolson time stepping instead of the explicit scheme
+  double tol = 1e-10; // Relative residual tolerance of the implicit linear solver
+  bool mg = false;    // Precondition the implicit linear solver with a multigrid V-cycle
+  int nthreads = 0;   // Size of the pinned worker team for the interior update (0: use std::execution::par)
+  numa::pinning pin = numa::pinning::none; // Pinning policy of the worker team
+  bool huge = false;  // Back the fields with transparent huge pages
+  numa::team* team = nullptr; // Pinned worker team, owned by main (nullptr if nthreads == 0)
 
   // Static method to return the thermal diffusivity constant
   static constexpr double alpha() { return 1.0; } // Thermal diffusivity
@@ -54,6 +74,7 @@ struct parameters {
   // Accessor methods for various parameters
   long nit() { return ni; } // Returns the number of iterations
   long nout() { return 1000; } // Returns the output frequency (how often to output results)
+  long nsnap() { return ns; } // Returns the in-situ snapshot frequency (0 means no snapshots)
   long nx_global() { return nx * nranks; } // Returns the global number of grid points in x across all ranks
   long ny_global() { return ny; } // Returns the global number of grid points in y (same for all ranks)
   double gamma() { return alpha() * dt / (dx * dx); } // Calculates the gamma value used in the stencil computation
@@ -68,13 +89,34 @@ struct grid {
 
 // Function declarations for applying the stencil and initializing conditions
 double apply_stencil(double* u_new, double* u_old, grid g, parameters p);
-void initial_condition(double* u_new, double* u_old, long n);
+double apply_stencil_team(double* u_new, double* u_old, grid g, parameters p);
+void initial_condition(numa::buffer<double>& u_new, numa::buffer<double>& u_old, parameters p);
+int par_threads(); // Number of threads std::execution::par runs on
+
+// Function declarations for the in-situ output pipeline
+void write_snapshot(double* u, long it, parameters p); // Write the coarse field and the per-row statistics
+void write_field(std::string const& name, double const* values, long rows, long cols, double time,
+                 parameters p); // Collectively write a (rows*nranks) x cols field with the usual header
 
 // Function declarations for evolving the solution of different parts of the local domain
 double inner(double* u_new, double* u_old, parameters p); // Evolve the interior part of the domain
 double prev (double* u_new, double* u_old, parameters p); // Evolve the part of the domain that depends on the previous rank
 double next (double* u_new, double* u_old, parameters p); // Evolve the part of the domain that depends on the next rank
 
+// Function declarations for the halo exchange with the neighbouring ranks
+void exchange_prev(double* u, parameters p); // Exchange the first interior column with rank - 1
+void exchange_next(double* u, parameters p); // Exchange the last interior column with rank + 1
+void exchange_halos(double* u, parameters p); // Exchange both halo columns with MPI_Sendrecv
+
+// Function declarations for the implicit (Crank-Nicolson) time integration
+using preconditioner = std::function<void(double* z, double const* r)>; // z = M^{-1} r on the interior points
+void set_boundary(double* u, double left, parameters p); // Impose the Dirichlet values on the ghost cells
+void apply_operator(double* out, double* in, double sigma, double kappa, parameters p); // out = sigma*in - kappa*D(in)
+double dot(double const* a, double const* b, parameters p); // Global dot product over the interior columns
+long cg_solve(double* x, double const* b, double sigma, double kappa, parameters p,
+              preconditioner const& precond = {}); // Solve (sigma - kappa*D) x = b, return the iterations
+void implicit_time_loop(double* u_new, double* u_old, parameters p);
+
 int main(int argc, char *argv[]) {
   // Parse CLI parameters
   parameters p(argc, argv);
@@ -104,14 +146,22 @@ int main(int argc, char *argv[]) {
   // This value is stored in 'p.rank', which will be used to identify the specific process in the parallel computation.
   MPI_Comm_rank(MPI_COMM_WORLD, &p.rank);
 
+  // Optionally start a team of pinned worker threads for the interior update.
+  // The same team first touches the fields, so each page lives on the NUMA node of the thread updating it.
+  std::unique_ptr<numa::team> team;
+  if (p.nthreads > 0) {
+    team = std::make_unique<numa::team>(p.nthreads, p.pin);
+    p.team = team.get();
+  }
+
   // Allocate memory for the new and old temperature fields.
   // 'u_new' will hold the updated temperature values, while 'u_old' will hold the previous values.
-  // The size of the vectors is determined by the total number of grid points, which is obtained from the parameters.
-  std::vector<double> u_new(p.n()), u_old(p.n());
+  // Each field has nx + 2 rows (2 halo layers) of ny points; the pages are not touched yet.
+  numa::buffer<double> u_new(p.nx + 2, p.ny, p.huge), u_old(p.nx + 2, p.ny, p.huge);
 
   // Set the initial conditions for the temperature fields.
   // The 'initial_condition' function initializes 'u_new' and 'u_old' with the starting temperature values.
-  initial_condition(u_new.data(), u_old.data(), p.n());
+  initial_condition(u_new, u_old, p);
 
   // Prepare the time loop for the simulation.
   // Using 'clk_t' as an alias for 'std::chrono::steady_clock' to measure elapsed time.
@@ -119,113 +169,126 @@ int main(int argc, char *argv[]) {
   // Record the start time of the simulation.
   auto start = clk_t::now();
       
-  // Create an atomic variable to store the energy, which can be safely modified by multiple threads.
-  // The atomic type ensures that updates to the energy variable are thread-safe, preventing data races.
-  std::atomic<double> energy = 0.;
-
-  // Create a barrier for synchronizing three threads.
-  // The barrier will ensure that all threads reach a certain point in the code before any of them can proceed.
-  std::barrier bar(3);
+  // The implicit scheme runs its own time loop: each Crank-Nicolson step is a global
+  // linear solve, so there is no overlap between the interior and the halo updates to exploit.
+  if (p.implicit) {
+    implicit_time_loop(u_new.data(), u_old.data(), p);
+  } else {
+    // Create an atomic variable to store the energy, which can be safely modified by multiple threads.
+    // The atomic type ensures that updates to the energy variable are thread-safe, preventing data races.
+    std::atomic<double> energy = 0.;
+
+    // Create a barrier for synchronizing three threads.
+    // The barrier will ensure that all threads reach a certain point in the code before any of them can proceed.
+    std::barrier bar(3);
   
 
 
-  // Create a new thread named 'thread_prev' to perform the "prev" computation.
-  // The thread captures the parameters 'p', pointers to the new and old temperature arrays ('u_new' and 'u_old'),
-  // a reference to the atomic 'energy' variable, and the barrier 'bar' for synchronization.
-  std::thread thread_prev([p, u_new = u_new.data(), u_old = u_old.data(), 
-                             &energy, &bar]() mutable { // NOTE: the lambda mutates its captures
-        // Loop over the number of time-steps specified in the parameters.
-        for (long it = 0; it < p.nit(); ++it) {
-            // Call the 'prev' function to compute the next state of the temperature field,
-            // and accumulate the energy contribution into the atomic 'energy' variable.
-            energy += prev(u_new, u_old, p);
+    // Create a new thread named 'thread_prev' to perform the "prev" computation.
+    // The thread captures the parameters 'p', pointers to the new and old temperature arrays ('u_new' and 'u_old'),
+    // a reference to the atomic 'energy' variable, and the barrier 'bar' for synchronization.
+    std::thread thread_prev([p, u_new = u_new.data(), u_old = u_old.data(), 
+                               &energy, &bar]() mutable { // NOTE: the lambda mutates its captures
+          // Loop over the number of time-steps specified in the parameters.
+          for (long it = 0; it < p.nit(); ++it) {
+              // Call the 'prev' function to compute the next state of the temperature field,
+              // and accumulate the energy contribution into the atomic 'energy' variable.
+              energy += prev(u_new, u_old, p);
             
-            // Synchronize this thread with other threads using the barrier.
-            // The first call ensures that all threads have completed their computations for this iteration.
-            bar.arrive_and_wait();
+              // Synchronize this thread with other threads using the barrier.
+              // The first call ensures that all threads have completed their computations for this iteration.
+              bar.arrive_and_wait();
             
-            // The second call is necessary to synchronize with the "inner" thread,
-            // ensuring that all threads reach this point before proceeding.
-            bar.arrive_and_wait();
+              // The second call is necessary to synchronize with the "inner" thread,
+              // ensuring that all threads reach this point before proceeding.
+              bar.arrive_and_wait();
             
-            // Swap the pointers of 'u_new' and 'u_old' to prepare for the next iteration.
-            // This allows the next computation to use the updated temperature values.
-            std::swap(u_new, u_old);
-        }
-    });
+              // Swap the pointers of 'u_new' and 'u_old' to prepare for the next iteration.
+              // This allows the next computation to use the updated temperature values.
+              std::swap(u_new, u_old);
+          }
+      });
     
  
-  // Create a new thread named 'thread_next' to perform the "next" computation.
-  // The thread captures the parameters 'p', pointers to the new and old temperature arrays ('u_new' and 'u_old'),
-  // a reference to the atomic 'energy' variable, and the barrier 'bar' for synchronization.
-  std::thread thread_next([p, u_new = u_new.data(), u_old = u_old.data(), 
-                             &energy, &bar]() mutable {
+    // Create a new thread named 'thread_next' to perform the "next" computation.
+    // The thread captures the parameters 'p', pointers to the new and old temperature arrays ('u_new' and 'u_old'),
+    // a reference to the atomic 'energy' variable, and the barrier 'bar' for synchronization.
+    std::thread thread_next([p, u_new = u_new.data(), u_old = u_old.data(), 
+                               &energy, &bar]() mutable {
+          // Loop over the number of iterations specified in the parameters.
+          for (long it = 0; it < p.nit(); ++it) {
+              // Call the 'next' function to compute the next state of the temperature field,
+              // and accumulate the energy contribution into the atomic 'energy' variable.
+              energy += next(u_new, u_old, p);
+
+              // Synchronize this thread with other threads using the barrier.
+              // The first call ensures that all threads have completed their computations for this iteration.
+              bar.arrive_and_wait();
+
+              // The second call is necessary to synchronize with the "inner" thread,
+              // ensuring that all threads reach this point before proceeding.
+              bar.arrive_and_wait();
+
+              // Swap the pointers of 'u_new' and 'u_old' to prepare for the next iteration.
+              // This allows the next computation to use the updated temperature values.
+              std::swap(u_new, u_old);
+          }
+      });
+    
+
+    // Create a new thread named 'thread_inner' to perform the "inner" computation,
+    // which includes the MPI reduction and I/O operations.
+    // The thread captures the parameters 'p', pointers to the new and old temperature arrays ('u_new' and 'u_old'),
+    // a reference to the atomic 'energy' variable, and the barrier 'bar' for synchronization.
+    std::thread thread_inner([p, u_new = u_new.data(), u_old = u_old.data(), 
+                                &energy, &bar]() mutable {
         // Loop over the number of iterations specified in the parameters.
         for (long it = 0; it < p.nit(); ++it) {
-            // Call the 'next' function to compute the next state of the temperature field,
+            // Call the 'inner' function to compute the next state of the temperature field,
             // and accumulate the energy contribution into the atomic 'energy' variable.
-            energy += next(u_new, u_old, p);
+            energy += inner(u_new, u_old, p);
 
             // Synchronize this thread with other threads using the barrier.
-            // The first call ensures that all threads have completed their computations for this iteration.
-            bar.arrive_and_wait();
-
-            // The second call is necessary to synchronize with the "inner" thread,
-            // ensuring that all threads reach this point before proceeding.
+            // This ensures that all threads have completed their computations for this iteration.
             bar.arrive_and_wait();
+      
+            // Only the "inner" thread performs the MPI reduction and I/O operations.
+            // The MPI_Reduce function combines the energy values from all ranks into the rank 0 process.
+            // If the current rank is 0, it uses MPI_IN_PLACE to update the energy directly.
+            // Otherwise, it sends the energy value to rank 0.
+            MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0,
+                       MPI_COMM_WORLD);
+
+            // If the current rank is 0 and the current iteration is a multiple of the output frequency,
+            // print the current energy value to standard error.
+            if (p.rank == 0 && it % p.nout() == 0) {
+                std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
+            }
+
+            // In-situ I/O step: the "prev" and "next" threads are parked on the second barrier,
+            // so 'u_new' is complete and nobody else is issuing MPI calls on MPI_COMM_WORLD.
+            // Every rank takes this branch at the same iteration, as required by collective I/O.
+            if (p.nsnap() > 0 && it % p.nsnap() == 0) {
+                write_snapshot(u_new, it, p);
+            }
 
             // Swap the pointers of 'u_new' and 'u_old' to prepare for the next iteration.
-            // This allows the next computation to use the updated temperature values.
             std::swap(u_new, u_old);
-        }
-    });
-    
-
-  // Create a new thread named 'thread_inner' to perform the "inner" computation,
-  // which includes the MPI reduction and I/O operations.
-  // The thread captures the parameters 'p', pointers to the new and old temperature arrays ('u_new' and 'u_old'),
-  // a reference to the atomic 'energy' variable, and the barrier 'bar' for synchronization.
-  std::thread thread_inner([p, u_new = u_new.data(), u_old = u_old.data(), 
-                              &energy, &bar]() mutable {
-      // Loop over the number of iterations specified in the parameters.
-      for (long it = 0; it < p.nit(); ++it) {
-          // Call the 'inner' function to compute the next state of the temperature field,
-          // and accumulate the energy contribution into the atomic 'energy' variable.
-          energy += inner(u_new, u_old, p);
-
-          // Synchronize this thread with other threads using the barrier.
-          // This ensures that all threads have completed their computations for this iteration.
-          bar.arrive_and_wait();
-      
-          // Only the "inner" thread performs the MPI reduction and I/O operations.
-          // The MPI_Reduce function combines the energy values from all ranks into the rank 0 process.
-          // If the current rank is 0, it uses MPI_IN_PLACE to update the energy directly.
-          // Otherwise, it sends the energy value to rank 0.
-          MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0,
-                     MPI_COMM_WORLD);
-
-          // If the current rank is 0 and the current iteration is a multiple of the output frequency,
-          // print the current energy value to standard error.
-          if (p.rank == 0 && it % p.nout() == 0) {
-              std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
-          }
-
-          // Swap the pointers of 'u_new' and 'u_old' to prepare for the next iteration.
-          std::swap(u_new, u_old);
           
-          // Reset the energy variable to 0 for the next iteration.
-          energy = 0;
+            // Reset the energy variable to 0 for the next iteration.
+            energy = 0;
       
-          // Synchronize all threads again to ensure they are ready for the next iteration.
-          bar.arrive_and_wait();
-      }
-  });
+            // Synchronize all threads again to ensure they are ready for the next iteration.
+            bar.arrive_and_wait();
+        }
+    });
   
-  // Join all threads to ensure synchronization
+    // Join all threads to ensure synchronization
 
-  thread_prev.join();  // Wait for the 'thread_prev' to finish its execution.
-  thread_next.join();  // Wait for the 'thread_next' to finish its execution.
-  thread_inner.join();  // Wait for the 'thread_inner' to finish its execution.
+    thread_prev.join();  // Wait for the 'thread_prev' to finish its execution.
+    thread_next.join();  // Wait for the 'thread_next' to finish its execution.
+    thread_inner.join();  // Wait for the 'thread_inner' to finish its execution.
+  }
   
 
   // Calculate the elapsed time since the start of the simulation.
@@ -245,7 +308,12 @@ int main(int argc, char *argv[]) {
   auto memory_bw = grid_size * static_cast<double>(p.nit()) / time; // GB/s
 
   // Only the rank 0 process will output the performance metrics to standard error.
-  if (p.rank == 0) {
+  // The bandwidth assumes one sweep over both arrays per time step, which holds for the explicit
+  // scheme only: each Crank-Nicolson step runs a variable number of CG iterations.
+  if (p.rank == 0 && p.implicit) {
+      std::cerr << "Rank " << p.rank << ": local domain " << p.nx << "x" << p.ny << ": " << time << " s, "
+                << time / std::max(p.nit(), 1L) << " s per time step" << std::endl;
+  } else if (p.rank == 0) {
       // Output the local domain size and memory bandwidth for the current rank.
       std::cerr << "Rank " << p.rank << ": local domain " << p.nx << "x" << p.ny << " (" << grid_size << " GB): " 
                 << memory_bw << " GB/s" << std::endl;
@@ -255,6 +323,17 @@ int main(int argc, char *argv[]) {
                 << (grid_size * p.nranks) << " GB): " << memory_bw * p.nranks << " GB/s" << std::endl; 
   }
 
+  // Timing record for the scaling driver (05-PBS-algorithms_and_execution_policies/PBS/scaling.cpp):
+  // time of the slowest rank, size of the global grid, threads of the worker team or, without
+  // --threads, of std::execution::par on rank 0.
+  double max_time;
+  MPI_Reduce(&time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  if (p.rank == 0) {
+      std::cout << "TIMING app=heat ranks=" << p.nranks
+                << " threads=" << (p.team ? p.team->size() : par_threads())
+                << " size=" << p.nx_global() * p.ny_global() << " seconds=" << max_time << std::endl;
+  }
+
 
   // Write output to file, writing both header information and the computed data from each rank to a file named "output". Use non-blocking I/O and ensure synchronization
   
@@ -326,20 +405,63 @@ int main(int argc, char *argv[]) {
 
 // Constructor for the parameters class that reads command line arguments to initialize problem size
 parameters::parameters(int argc, char *argv[]) {
-  // Check if the correct number of arguments is provided
-  if (argc != 4) {
+  // Lambda printing the usage and terminating the program
+  auto usage = [argv]() {
     std::cerr << "ERROR: incorrect arguments" << std::endl; // Print error message
-    std::cerr << "  " << argv[0] << " <nx> <ny> <ni>" << std::endl; // Show usage
+    std::cerr << "  " << argv[0] << " <nx> <ny> <ni>"
+              << " [--snap <every>] [--stride <s>] [--sample]"
+              << " [--implicit <dt factor>] [--tol <tol>] [--mg]"
+              << " [--threads <n>] [--pin none|compact|scatter] [--huge]" << std::endl; // Show usage
     std::terminate(); // Terminate the program
+  };
+
+  // Check if the correct number of arguments is provided
+  if (argc < 4) {
+    usage();
   }
   // Convert command line arguments to long long integers for grid sizes
   nx = std::stoll(argv[1]); // Number of grid points in x-direction
   ny = std::stoll(argv[2]); // Number of grid points in y-direction
   ni = std::stoll(argv[3]); // Number of iterations 
-  
+
   // Calculate grid spacing and time step based on the number of grid points
   dx = 1.0 / nx; // Grid spacing in x-direction
   dt = dx * dx / (5. * alpha()); // Time step based on diffusion coefficient
+
+  // Parse the optional in-situ output and time integration flags
+  for (int i = 4; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--sample") {
+      average = false; // Keep one point per block instead of the block average
+    } else if (arg == "--snap" && i + 1 < argc) {
+      ns = std::stoll(argv[++i]); // Snapshot every 'ns' iterations
+    } else if (arg == "--stride" && i + 1 < argc) {
+      stride = std::stoll(argv[++i]); // Coarsening factor
+    } else if (arg == "--implicit" && i + 1 < argc) {
+      implicit = true; // Crank-Nicolson is unconditionally stable:
+      dt *= std::stod(argv[++i]); // the time step is a multiple of the explicit one
+    } else if (arg == "--threads" && i + 1 < argc) {
+      nthreads = std::stoi(argv[++i]); // Pinned worker team for the interior update
+    } else if (arg == "--pin" && i + 1 < argc) {
+      try {
+        pin = numa::parse_pinning(argv[++i]); // Pinning policy of the worker team
+      } catch (std::invalid_argument const& e) {
+        std::cerr << e.what() << std::endl;
+        usage();
+      }
+    } else if (arg == "--huge") {
+      huge = true; // Transparent huge pages for the fields
+    } else if (arg == "--mg") {
+      mg = true; // Multigrid preconditioner for the implicit solver
+    } else if (arg == "--tol" && i + 1 < argc) {
+      tol = std::stod(argv[++i]); // Relative residual tolerance of the linear solver
+    } else {
+      usage();
+    }
+  }
+  if (ns < 0 || stride < 1 || stride > nx || stride > ny || dt <= 0. || tol <= 0. || nthreads < 0) {
+    usage();
+  }
 }
 
 // Finite-difference stencil function to update the grid values
@@ -376,6 +498,16 @@ double stencil(double *u_new, double *u_old, long x, long y, parameters p) {
 }
 
 // Function to apply the stencil across the grid
+// With the TBB backend of libstdc++, std::execution::par runs in the default task arena, whose
+// concurrency follows the CPU mask of the process (e.g. as restricted by mpirun --bind-to)
+int par_threads() {
+#if __has_include(<tbb/task_arena.h>)
+  return tbb::this_task_arena::max_concurrency();
+#else
+  return static_cast<int>(std::thread::hardware_concurrency());
+#endif
+}
+
 double apply_stencil(double* u_new, double* u_old, grid g, parameters p) {
   // Create ranges for x and y indices
   auto xs = std::views::iota(g.x_begin, g.x_end);
@@ -391,11 +523,26 @@ double apply_stencil(double* u_new, double* u_old, grid g, parameters p) {
   });
 }
 
+// Apply the stencil with the pinned worker team: worker 'tid' updates the rows of its
+// numa::partition block, i.e. the same rows it touched first in 'initial_condition'
+double apply_stencil_team(double* u_new, double* u_old, grid g, parameters p) {
+  return p.team->run([=](int tid) {
+    auto b = numa::partition(p.nx + 2, tid, p.team->size());
+    double energy = 0.;
+    for (long x = std::max(g.x_begin, b.begin); x < std::min(g.x_end, b.end); ++x) {
+      for (long y = g.y_begin; y < g.y_end; ++y) {
+        energy += stencil(u_new, u_old, x, y, p);
+      }
+    }
+    return energy;
+  });
+}
+
 // Function to initialize the grid with initial conditions
-void initial_condition(double* u_new, double* u_old, long n) {
-  // Fill the old and new grid arrays with zeros in parallel
-  std::fill_n(std::execution::par, u_old, n, 0.0);
-  std::fill_n(std::execution::par, u_new, n, 0.0);
+void initial_condition(numa::buffer<double>& u_new, numa::buffer<double>& u_old, parameters p) {
+  // Fill the old and new grid arrays with zeros in parallel: this is the first touch of their pages
+  u_old.first_touch(p.team, 0.0);
+  u_new.first_touch(p.team, 0.0);
 }
 
 // Evolve the solution of the interior part of the domain
@@ -404,20 +551,16 @@ double inner(double *u_new, double *u_old, parameters p) {
   // Define the grid for the interior points, excluding boundaries
   grid g{.x_begin = 2, .x_end = p.nx, .y_begin = 1, .y_end = p.ny - 1};
   
-  // Apply the stencil to the interior grid points and return the result
-  return apply_stencil(u_new, u_old, g, p);
+  // Apply the stencil to the interior grid points and return the result.
+  // Only this (largest) update uses the worker team, which serves one caller at a time.
+  return p.team ? apply_stencil_team(u_new, u_old, g, p) : apply_stencil(u_new, u_old, g, p);
 }
 
 // Evolve the solution of the part of the domain that 
 // depends on data from the previous MPI rank (rank - 1)
 double prev(double *u_new, double *u_old, parameters p) {
-  // Check if the current rank is greater than 0 (not the first rank)
-  if (p.rank > 0) {
-    // Send the bottom boundary cells to the previous rank
-    MPI_Send(u_old + p.ny, p.ny, MPI_DOUBLE, p.rank - 1, 0, MPI_COMM_WORLD);
-    // Receive the top boundary cells from the previous rank
-    MPI_Recv(u_old + 0, p.ny, MPI_DOUBLE, p.rank - 1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-  }
+  // Exchange the halo with the previous rank
+  exchange_prev(u_old, p);
   
   // Define the grid for the boundary points that depend on the previous rank
   grid g{.x_begin = 1, .x_end = 2, .y_begin= 1, .y_end = p.ny - 1};
@@ -429,14 +572,8 @@ double prev(double *u_new, double *u_old, parameters p) {
 // Evolve the solution of the part of the domain that 
 // depends on data from the next MPI rank (rank + 1)
 double next(double *u_new, double *u_old, parameters p) {
-  // Check if the current rank is less than the last rank
-  if (p.rank < p.nranks - 1) {
-    // Receive the bottom boundary cells from the next rank
-    MPI_Recv(u_old + (p.nx + 1) * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 0, MPI_COMM_WORLD,
-             MPI_STATUS_IGNORE);
-    // Send the top boundary cells to the next rank
-    MPI_Send(u_old + p.nx * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 1, MPI_COMM_WORLD);
-  }
+  // Exchange the halo with the next rank
+  exchange_next(u_old, p);
   
   // Define the grid for the boundary points that depend on the next rank
   grid g{.x_begin = p.nx, .x_end = p.nx + 1, .y_begin = 1, .y_end = p.ny - 1};
@@ -444,3 +581,292 @@ double next(double *u_new, double *u_old, parameters p) {
   // Apply the stencil to the boundary grid points and return the result
   return apply_stencil(u_new, u_old, g, p);
 }
+
+// Exchange the halo with the previous MPI rank (rank - 1):
+// send the first interior column and receive the left ghost column
+void exchange_prev(double* u, parameters p) {
+  // Check if the current rank is greater than 0 (not the first rank)
+  if (p.rank > 0) {
+    // Send the bottom boundary cells to the previous rank
+    MPI_Send(u + p.ny, p.ny, MPI_DOUBLE, p.rank - 1, 0, MPI_COMM_WORLD);
+    // Receive the top boundary cells from the previous rank
+    MPI_Recv(u + 0, p.ny, MPI_DOUBLE, p.rank - 1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  }
+}
+
+// Exchange the halo with the next MPI rank (rank + 1):
+// receive the right ghost column and send the last interior column
+void exchange_next(double* u, parameters p) {
+  // Check if the current rank is less than the last rank
+  if (p.rank < p.nranks - 1) {
+    // Receive the bottom boundary cells from the next rank
+    MPI_Recv(u + (p.nx + 1) * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 0, MPI_COMM_WORLD,
+             MPI_STATUS_IGNORE);
+    // Send the top boundary cells to the next rank
+    MPI_Send(u + p.nx * p.ny, p.ny, MPI_DOUBLE, p.rank + 1, 1, MPI_COMM_WORLD);
+  }
+}
+
+// Exchange both halo columns at once, as mg::exchange does: calling exchange_prev and then
+// exchange_next, whose blocking sends wait for the neighbour, would make every rank wait for
+// rank 0 in a chain. MPI_Sendrecv pairs each send with a receive, so all the ranks shift to the
+// left, then to the right, concurrently. The ghost columns of the physical boundary are left alone.
+void exchange_halos(double* u, parameters p) {
+  int prev = p.rank > 0 ? p.rank - 1 : MPI_PROC_NULL;
+  int next = p.rank < p.nranks - 1 ? p.rank + 1 : MPI_PROC_NULL;
+
+  // First interior column to rank - 1, right ghost column from rank + 1
+  MPI_Sendrecv(u + p.ny, p.ny, MPI_DOUBLE, prev, 0, u + (p.nx + 1) * p.ny, p.ny, MPI_DOUBLE, next, 0,
+               MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+  // Last interior column to rank + 1, left ghost column from rank - 1
+  MPI_Sendrecv(u + p.nx * p.ny, p.ny, MPI_DOUBLE, next, 1, u, p.ny, MPI_DOUBLE, prev, 1,
+               MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+}
+
+// Write an in-situ snapshot of the local field 'u' at iteration 'it':
+//  - "snapshot_<it>": the field coarsened by 'p.stride' in x and y,
+//    either averaging each stride x stride block or sampling its first point;
+//  - "stats_<it>": min, max and mean over y of every local x-row.
+// Cells of a trailing partial block are dropped, so all ranks contribute the same
+// number of coarse rows and the rank-contiguous layout of "output" is preserved.
+void write_snapshot(double* u, long it, parameters p) {
+  long s = p.stride;
+  long cx = p.nx / s, cy = p.ny / s; // Local coarse grid dimensions
+
+  // Coarsen the interior columns 1..nx (the same values dumped to "output")
+  std::vector<double> coarse(cx * cy);
+  auto cxs = std::views::iota(0L, cx);
+  std::for_each(std::execution::par, cxs.begin(), cxs.end(), [&](long X) {
+    for (long Y = 0; Y < cy; ++Y) {
+      double value = 0.;
+      if (p.average) {
+        for (long i = 0; i < s; ++i)
+          for (long j = 0; j < s; ++j)
+            value += u[(1 + X * s + i) * p.ny + Y * s + j];
+        value /= static_cast<double>(s * s);
+      } else {
+        value = u[(1 + X * s) * p.ny + Y * s];
+      }
+      coarse[X * cy + Y] = value;
+    }
+  });
+
+  // Per-row statistics: one (min, max, mean) triple for each local x-row
+  std::vector<double> stats(3 * p.nx);
+  auto xs = std::views::iota(0L, p.nx);
+  std::for_each(std::execution::par, xs.begin(), xs.end(), [&](long x) {
+    double const* row = u + (x + 1) * p.ny;
+    auto [lo, hi] = std::minmax_element(row, row + p.ny);
+    stats[3 * x + 0] = *lo;
+    stats[3 * x + 1] = *hi;
+    stats[3 * x + 2] = std::reduce(row, row + p.ny) / static_cast<double>(p.ny);
+  });
+
+  double time = it * p.dt;
+  write_field("snapshot_" + std::to_string(it), coarse.data(), cx, cy, time, p);
+  write_field("stats_" + std::to_string(it), stats.data(), p.nx, 3, time, p);
+}
+
+// Collectively write a field distributed by rows across ranks: each rank owns 'rows' contiguous
+// rows of 'cols' values. The file layout matches "output": a header made of the global
+// dimensions (2 longs) and the time (1 double), followed by the rows of rank 0, 1, ...
+void write_field(std::string const& name, double const* values, long rows, long cols, double time,
+                 parameters p) {
+  // Ask for collective buffering, so that only a few aggregator ranks touch the file system
+  MPI_Info info;
+  MPI_Info_create(&info);
+  MPI_Info_set(info, "romio_cb_write", "enable");
+  MPI_Info_set(info, "collective_buffering", "true");
+
+  MPI_File f;
+  MPI_File_open(MPI_COMM_WORLD, name.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, info, &f);
+  MPI_Info_free(&info);
+
+  auto header_bytes = 2 * sizeof(long) + sizeof(double);
+  auto values_per_rank = rows * cols;
+  auto values_bytes_per_rank = values_per_rank * sizeof(double);
+  MPI_File_set_size(f, header_bytes + values_bytes_per_rank * p.nranks);
+
+  // The header is tiny: rank 0 writes it independently
+  if (p.rank == 0) {
+    long total[2] = {rows * p.nranks, cols};
+    MPI_File_write_at(f, 0, total, 2, MPI_UINT64_T, MPI_STATUS_IGNORE);
+    MPI_File_write_at(f, 2 * sizeof(long), &time, 1, MPI_DOUBLE, MPI_STATUS_IGNORE);
+  }
+
+  // The values are written collectively by all ranks
+  auto values_offset = header_bytes + p.rank * values_bytes_per_rank;
+  MPI_File_write_at_all(f, values_offset, values, values_per_rank, MPI_DOUBLE, MPI_STATUS_IGNORE);
+
+  MPI_File_close(&f);
+}
+
+// Impose the Dirichlet boundary values on the ghost cells of 'u', as done by 'stencil':
+// zero at the lower and upper boundaries, 'left' at the left boundary of the first rank
+// and zero at the right boundary of the last rank. Halo columns shared with other ranks are untouched.
+void set_boundary(double* u, double left, parameters p) {
+  for (long x = 0; x < p.nx + 2; ++x) {
+    u[x * p.ny] = 0.;
+    u[x * p.ny + p.ny - 1] = 0.;
+  }
+  if (p.rank == 0) {
+    std::fill_n(u + 1, p.ny - 2, left);
+  }
+  if (p.rank == p.nranks - 1) {
+    std::fill_n(u + (p.nx + 1) * p.ny + 1, p.ny - 2, 0.);
+  }
+}
+
+// Matrix-free application of out = sigma*in - kappa*D(in) on the interior points, where D is the
+// undivided 5-point Laplacian (the bracket in 'stencil'). Ghost cells and halos of 'in' must be up to date.
+void apply_operator(double* out, double* in, double sigma, double kappa, parameters p) {
+  auto xs = std::views::iota(1L, p.nx + 1);
+  std::for_each(std::execution::par, xs.begin(), xs.end(), [=](long x) {
+    for (long y = 1; y < p.ny - 1; ++y) {
+      long i = x * p.ny + y;
+      out[i] = (sigma + 4. * kappa) * in[i] -
+               kappa * (in[i + p.ny] + in[i - p.ny] + in[i + 1] + in[i - 1]);
+    }
+  });
+}
+
+// Global dot product over the interior columns 1..nx, ghost rows included: the operator and the
+// preconditioner write only the interior points, so the vectors of cg_solve are zero on the ghost rows.
+// The halo columns, owned by the neighbouring ranks, are excluded
+double dot(double const* a, double const* b, parameters p) {
+  double local = std::transform_reduce(std::execution::par, a + p.ny, a + (p.nx + 1) * p.ny, b + p.ny, 0.);
+  double global;
+  MPI_Allreduce(&local, &global, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  return global;
+}
+
+// Preconditioned conjugate gradient for (sigma - kappa*D) x = b with homogeneous Dirichlet ghosts.
+// 'x' holds the initial guess on input and the solution on output; the operator applications
+// exchange the halos of their input with exchange_halos. An empty 'precond' means no preconditioning.
+long cg_solve(double* x, double const* b, double sigma, double kappa, parameters p,
+              preconditioner const& precond) {
+  auto first = p.ny, last = (p.nx + 1) * p.ny; // Interior range
+  std::vector<double> r(p.n(), 0.), z(p.n(), 0.), d(p.n(), 0.), q(p.n(), 0.);
+
+  // Operator application including the halo exchange of its input
+  auto A = [&](double* out, double* in) {
+    exchange_halos(in, p);
+    set_boundary(in, 0., p);
+    apply_operator(out, in, sigma, kappa, p);
+  };
+  auto M = [&](double* out, double const* in) {
+    if (precond) {
+      precond(out, in);
+    } else {
+      std::copy(std::execution::par, in + first, in + last, out + first);
+    }
+  };
+
+  // r = b - A x
+  A(q.data(), x);
+  std::transform(std::execution::par, b + first, b + last, q.begin() + first, r.begin() + first,
+                 std::minus{});
+  M(z.data(), r.data());
+  std::copy(std::execution::par, z.begin() + first, z.begin() + last, d.begin() + first);
+
+  double rz = dot(r.data(), z.data(), p);
+  double b_norm = std::sqrt(dot(b, b, p));
+  if (b_norm == 0.) {
+    b_norm = 1.;
+  }
+
+  long max_it = 10 * (p.nx_global() + p.ny_global());
+  long k = 0;
+  double r_norm = std::sqrt(dot(r.data(), r.data(), p));
+  for (; k < max_it && r_norm > p.tol * b_norm; ++k) {
+    A(q.data(), d.data());
+    double step = rz / dot(d.data(), q.data(), p);
+
+    // x += step * d, r -= step * q
+    auto ids = std::views::iota(first, last);
+    std::for_each(std::execution::par, ids.begin(), ids.end(), [&, step](long i) {
+      x[i] += step * d[i];
+      r[i] -= step * q[i];
+    });
+
+    M(z.data(), r.data());
+    double rz_new = dot(r.data(), z.data(), p);
+    double beta = rz_new / rz;
+    rz = rz_new;
+
+    // d = z + beta * d
+    std::transform(std::execution::par, z.begin() + first, z.begin() + last, d.begin() + first,
+                   d.begin() + first, [beta](double zi, double di) { return zi + beta * di; });
+
+    r_norm = std::sqrt(dot(r.data(), r.data(), p));
+  }
+
+  // The iteration limit was hit: report how far from the tolerance the solution is
+  if (r_norm > p.tol * b_norm && p.rank == 0) {
+    std::cerr << "CG did not converge: relative residual " << r_norm / b_norm << " (tolerance "
+              << p.tol << ") after " << k << " iterations" << std::endl;
+  }
+
+  return k;
+}
+
+// Crank-Nicolson time loop: each step solves
+//   (1 + gamma/2 * D) u^{n+1} = (1 - gamma/2 * D) u^n + gamma * g,
+// where D = 4 - (sum of the neighbours) and g holds the (time-independent) Dirichlet data.
+// The energy diagnostic, the snapshots and the final content of 'u_new' match the explicit loop.
+void implicit_time_loop(double* u_new, double* u_old, parameters p) {
+  double* result = u_new; // Buffer that must hold the last solution on exit
+  double kappa = 0.5 * p.gamma(); // Half of the stencil goes to each time level
+  std::vector<double> rhs(p.n(), 0.);
+  long cg_iterations = 0;
+
+  // Optional multigrid preconditioner for the operator (1 + kappa * D) on the same layout
+  std::unique_ptr<mg::multigrid> multigrid;
+  preconditioner precond;
+  if (p.mg) {
+    multigrid = std::make_unique<mg::multigrid>(p.nx, p.ny, 1., kappa, MPI_COMM_WORLD);
+    precond = [&multigrid](double* z, double const* r) { multigrid->precondition(z, r); };
+  }
+
+  for (long it = 0; it < p.nit(); ++it) {
+    // Explicit half step: rhs = u^n + kappa * (sum of the neighbours - 4 u^n), with the boundary values
+    exchange_halos(u_old, p);
+    set_boundary(u_old, 1., p);
+    apply_operator(rhs.data(), u_old, 1., -kappa, p);
+
+    // Boundary contribution of the implicit half step (only the left boundary is non-zero)
+    if (p.rank == 0) {
+      std::for_each(rhs.begin() + p.ny + 1, rhs.begin() + 2 * p.ny - 1, [kappa](double& v) { v += kappa; });
+    }
+
+    // Implicit half step, starting from the previous solution
+    std::copy(std::execution::par, u_old, u_old + p.n(), u_new);
+    cg_iterations += cg_solve(u_new, rhs.data(), 1., kappa, p, precond);
+
+    // Energy diagnostic, computed on the same points updated by 'stencil'
+    auto xs = std::views::iota(1L, p.nx + 1);
+    double energy = std::transform_reduce(std::execution::par, xs.begin(), xs.end(), 0., std::plus{},
+      [&](long x) {
+        return std::reduce(u_new + x * p.ny + 1, u_new + (x + 1) * p.ny - 1) * p.dx * p.dx;
+    });
+    MPI_Reduce(p.rank == 0 ? MPI_IN_PLACE : &energy, &energy, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (p.rank == 0 && it % p.nout() == 0) {
+      std::cerr << "E(t=" << it * p.dt << ") = " << energy << std::endl;
+    }
+
+    if (p.nsnap() > 0 && it % p.nsnap() == 0) {
+      write_snapshot(u_new, it, p);
+    }
+
+    std::swap(u_new, u_old);
+  }
+  // Leave the last solution in 'result', which is the field written to "output"
+  if (u_old != result) {
+    std::copy(std::execution::par, u_old, u_old + p.n(), result);
+  }
+
+  if (p.rank == 0 && p.nit() > 0) {
+    std::cerr << "Crank-Nicolson: " << static_cast<double>(cg_iterations) / p.nit()
+              << " CG iterations per step" << std::endl;
+  }
+}